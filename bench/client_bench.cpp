@@ -0,0 +1,206 @@
+// 库接口基准: 在本进程里起本地测试服务器, 用 downloader::Client 把一批对象下载进内存(MemorySink),
+// 逐个校验内容, 报告每秒完成的对象数、吞吐和本进程的 CPU 时间. 同时演示嵌入式用法:
+// submit 拿句柄, on_complete 回调计数, 结束后从 sink 取数据
+#include "test_server.hpp"
+
+#include "downloader/client.hpp"
+
+#include <fmt/core.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using downloader::bench::TestServer;
+
+struct Config {
+    std::vector<std::uint64_t> sizes{4 * 1024, 64 * 1024, 1ULL << 20};
+    int count = 1000;
+    int max_active = 64;
+    int loops = 1;
+    int threads = 4;
+    bool http2 = false;
+    double cancel_fraction = 0.0;   // 提交后立即取消这个比例的下载, 检查取消路径
+    std::string server_query;
+};
+
+void printUsage(const char* program) {
+    fmt::print(stderr,
+               "Usage: {} [-s 4K,64K,1M] [-n <count>] [-a <max active>] [-e <loops>] [-t <threads>]\n"
+               "       [--http2] [--cancel <fraction>] [--server <query>]\n"
+               "  -s <sizes>        Comma-separated object sizes to sweep\n"
+               "  -n <count>        Objects per size (default: 1000)\n"
+               "  -a <max active>   Downloads in flight at once (default: 64)\n"
+               "  -e <loops>        Event loop threads (default: 1)\n"
+               "  -t <threads>      Connections per object (default: 4)\n"
+               "  --http2           Use HTTP/2 prior knowledge, objects share connections as streams\n"
+               "  --cancel <f>      Cancel this fraction of the objects right after submitting\n"
+               "  --server <query>  Server behaviour for every request, e.g. \"latency=5\"\n",
+               program);
+}
+
+std::vector<std::uint64_t> parseSizes(const std::string& text) {
+    std::vector<std::uint64_t> sizes;
+    std::size_t pos = 0;
+    while (pos <= text.size()) {
+        const auto comma = text.find(',', pos);
+        const std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        if (!item.empty()) {
+            const auto size = downloader::bench::parseSize(item);
+            if (!size) {
+                throw std::invalid_argument(item);
+            }
+            sizes.push_back(*size);
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return sizes;
+}
+
+double cpuSeconds() {
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    const auto seconds = [](const timeval& tv) {
+        return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+    };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+bool verify(std::string_view data, std::uint64_t size) {
+    if (data.size() != size) {
+        return false;
+    }
+    std::vector<char> expected(data.size());
+    TestServer::fill(expected.data(), 0, expected.size());
+    return std::equal(data.begin(), data.end(), expected.begin());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (option == "--http2") {
+                config.http2 = true;
+            } else if (i + 1 < argc && (option == "-s" || option == "-n" || option == "-a" || option == "-e" ||
+                                        option == "-t" || option == "--cancel" || option == "--server")) {
+                const std::string value = argv[++i];
+                if (option == "-s") {
+                    config.sizes = parseSizes(value);
+                } else if (option == "-n") {
+                    config.count = std::max(1, std::stoi(value));
+                } else if (option == "-a") {
+                    config.max_active = std::max(1, std::stoi(value));
+                } else if (option == "-e") {
+                    config.loops = std::max(1, std::stoi(value));
+                } else if (option == "-t") {
+                    config.threads = std::max(1, std::stoi(value));
+                } else if (option == "--cancel") {
+                    config.cancel_fraction = std::clamp(std::stod(value), 0.0, 1.0);
+                } else {
+                    config.server_query = value;
+                }
+            } else {
+                printUsage(argv[0]);
+                return option == "-h" || option == "--help" ? 0 : 1;
+            }
+        }
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    TestServer server;
+    std::string error;
+    if (!server.start(0, error)) {
+        fmt::print(stderr, "{}\n", error);
+        return 1;
+    }
+
+    downloader::ClientOptions client_options;
+    client_options.event_loops = config.loops;
+    client_options.max_active = config.max_active;
+    downloader::Client client(client_options);
+
+    fmt::print("{:>6} {:>7} {:>9} {:>10} {:>9} {:>8} {:>9} {:>8}\n", "size", "objects", "seconds", "objects/s",
+               "MiB/s", "cpu s", "cancelled", "failed");
+
+    bool all_ok = true;
+    for (const auto size : config.sizes) {
+        std::atomic<int> completed{0};
+        std::vector<downloader::DownloadHandle> handles;
+        handles.reserve(static_cast<std::size_t>(config.count));
+        const int cancel_every =
+            config.cancel_fraction > 0.0 ? std::max(1, static_cast<int>(1.0 / config.cancel_fraction)) : 0;
+
+        const double cpu_before = cpuSeconds();
+        const auto started = std::chrono::steady_clock::now();
+        for (int n = 0; n < config.count; ++n) {
+            downloader::DownloadRequest request;
+            request.url = fmt::format("http://127.0.0.1:{}/{}?n={}", server.port(), size, n);
+            if (!config.server_query.empty()) {
+                request.url += "&" + config.server_query;
+            }
+            request.options.thread_count = config.threads;
+            request.options.resume = false;
+            if (config.http2) {
+                request.options.http_version = downloader::HttpVersion::Http2PriorKnowledge;
+            }
+            request.on_complete = [&completed](const downloader::DownloadResult&) { ++completed; };
+            handles.push_back(client.submit(std::move(request)));
+            if (cancel_every > 0 && n % cancel_every == 0) {
+                handles.back().cancel();
+            }
+        }
+        client.waitAll();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        const double cpu = cpuSeconds() - cpu_before;
+
+        int cancelled = 0;
+        int failed = 0;
+        for (const auto& handle : handles) {
+            const auto& result = handle.wait();
+            if (result.cancelled) {
+                ++cancelled;
+                continue;
+            }
+            const auto* sink = dynamic_cast<const downloader::MemorySink*>(result.sink.get());
+            if (!result.ok || !sink || !verify(sink->view(), size)) {
+                if (failed == 0) {
+                    fmt::print(stderr, "{}: {}\n", result.url, result.ok ? "content mismatch" : result.error);
+                }
+                ++failed;
+            }
+        }
+        // 每个对象的回调都恰好调用一次
+        if (completed.load() != config.count) {
+            fmt::print(stderr, "{} completion callbacks for {} objects\n", completed.load(), config.count);
+            ++failed;
+        }
+        all_ok = all_ok && failed == 0;
+
+        const int done = config.count - cancelled;
+        const double mib = static_cast<double>(size) * done / (1024.0 * 1024.0);
+        fmt::print("{:>6} {:>7} {:>9.3f} {:>10.0f} {:>9.1f} {:>8.3f} {:>9} {:>8}\n", size, config.count, seconds,
+                   seconds > 0.0 ? done / seconds : 0.0, seconds > 0.0 ? mib / seconds : 0.0, cpu, cancelled,
+                   failed);
+        std::fflush(stdout);
+    }
+
+    server.stop();
+    return all_ok ? 0 : 1;
+}
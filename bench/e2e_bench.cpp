@@ -0,0 +1,304 @@
+// 端到端基准: 在本进程里起一个本地测试服务器(test_server.hpp), 对每组 文件大小 x 任务数 x 连接数
+// 各运行若干次 mdown 子进程, 报告墙钟时间、吞吐、子进程的用户态/内核态 CPU 时间和峰值 RSS
+// (取各次的中位数, RSS 取最大值). 服务器和 mdown 在同一台机器上, 测的是客户端自身的开销,
+// 用来比较对 MultiDownloader 的改动, 不代表真实网络上的速度.
+#include "test_server.hpp"
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using downloader::bench::TestServer;
+
+struct Config {
+    std::string mdown;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "mdown-bench";
+    std::vector<int> threads{1, 4, 8, 16};
+    std::vector<std::uint64_t> sizes{64 * 1024, 16ULL << 20, 256ULL << 20};
+    std::vector<int> tasks{1, 8};
+    int repeats = 3;
+    std::string server_query;   // 附加到每个 URL 的服务器行为, 如 "rate=10M&latency=20"
+    std::vector<std::string> extra;
+    double min_rate = 0.0;      // MiB/s, 低于它的组合算失败, 用作回归检查
+    bool verify = true;
+    bool csv = false;
+};
+
+struct RunResult {
+    bool ok{false};
+    double seconds{0.0};
+    double user{0.0};
+    double system{0.0};
+    long max_rss_kb{0};
+};
+
+void printUsage(const char* program) {
+    fmt::print(stderr,
+               "Usage: {} [--mdown <path>] [-t 1,4,8,16] [-s 64K,16M,256M] [-n 1,8] [-r <repeats>]\n"
+               "       [-d <dir>] [--server <query>] [--min-rate <MiB/s>] [--no-verify] [--csv]\n"
+               "       [-- <extra mdown options>]\n"
+               "  --mdown <path>   mdown binary to run (default: next to this program)\n"
+               "  -t/-s/-n         Comma-separated connection counts, file sizes and task counts to sweep\n"
+               "  -r <repeats>     Runs per combination, the median is reported (default: 3)\n"
+               "  -d <dir>         Where downloads are written (default: $TMPDIR/mdown-bench)\n"
+               "  --server <query> Server behaviour for every request, e.g. \"rate=20M&latency=10\"\n"
+               "  --min-rate <n>   Fail (exit 1) when a combination is slower than <n> MiB/s\n"
+               "  --no-verify      Do not compare downloaded files with the expected content\n",
+               program);
+}
+
+template <typename T, typename Parse>
+std::vector<T> parseList(const std::string& text, Parse parse) {
+    std::vector<T> values;
+    std::size_t pos = 0;
+    while (pos <= text.size()) {
+        const auto comma = text.find(',', pos);
+        const std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        if (!item.empty()) {
+            values.push_back(parse(item));
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return values;
+}
+
+std::string sizeLabel(std::uint64_t bytes) {
+    if (bytes >= (1ULL << 30) && bytes % (1ULL << 30) == 0) {
+        return fmt::format("{}G", bytes >> 30);
+    }
+    if (bytes >= (1ULL << 20) && bytes % (1ULL << 20) == 0) {
+        return fmt::format("{}M", bytes >> 20);
+    }
+    if (bytes >= 1024 && bytes % 1024 == 0) {
+        return fmt::format("{}K", bytes >> 10);
+    }
+    return std::to_string(bytes);
+}
+
+double toSeconds(const timeval& tv) {
+    return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+}
+
+RunResult runMdown(const std::vector<std::string>& args) {
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    RunResult result;
+    const auto started = std::chrono::steady_clock::now();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        return result;
+    }
+    if (pid == 0) {
+        const int null_fd = ::open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            ::dup2(null_fd, STDOUT_FILENO);
+        }
+        ::execv(argv[0], argv.data());
+        std::perror("execv");
+        ::_exit(127);
+    }
+
+    int status = 0;
+    rusage usage{};
+    if (::wait4(pid, &status, 0, &usage) != pid) {
+        return result;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    result.user = toSeconds(usage.ru_utime);
+    result.system = toSeconds(usage.ru_stime);
+    result.max_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+bool verifyFile(const std::filesystem::path& path, std::uint64_t size) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    constexpr std::size_t kBlock = 1 << 20;
+    std::vector<char> actual(kBlock);
+    std::vector<char> expected(kBlock);
+    std::uint64_t offset = 0;
+    while (offset < size) {
+        const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(kBlock, size - offset));
+        if (!file.read(actual.data(), static_cast<std::streamsize>(n))) {
+            return false;
+        }
+        TestServer::fill(expected.data(), offset, n);
+        if (!std::equal(actual.begin(), actual.begin() + static_cast<std::ptrdiff_t>(n), expected.begin())) {
+            return false;
+        }
+        offset += n;
+    }
+    return file.peek() == std::char_traits<char>::eof();
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0.0 : values[values.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (option == "--") {
+                config.extra.assign(argv + i + 1, argv + argc);
+                break;
+            }
+            if (option == "--no-verify") {
+                config.verify = false;
+            } else if (option == "--csv") {
+                config.csv = true;
+            } else if (i + 1 < argc && (option == "--mdown" || option == "-d" || option == "--server" ||
+                                        option == "--min-rate" || option == "-t" || option == "-s" ||
+                                        option == "-n" || option == "-r")) {
+                const std::string value = argv[++i];
+                if (option == "--mdown") {
+                    config.mdown = value;
+                } else if (option == "-d") {
+                    config.dir = value;
+                } else if (option == "--server") {
+                    config.server_query = value;
+                } else if (option == "--min-rate") {
+                    config.min_rate = std::stod(value);
+                } else if (option == "-t") {
+                    config.threads = parseList<int>(value, [](const std::string& s) { return std::stoi(s); });
+                } else if (option == "-n") {
+                    config.tasks = parseList<int>(value, [](const std::string& s) { return std::stoi(s); });
+                } else if (option == "-s") {
+                    config.sizes = parseList<std::uint64_t>(value, [](const std::string& s) {
+                        const auto size = downloader::bench::parseSize(s);
+                        if (!size) {
+                            throw std::invalid_argument(s);
+                        }
+                        return *size;
+                    });
+                } else {
+                    config.repeats = std::max(1, std::stoi(value));
+                }
+            } else {
+                printUsage(argv[0]);
+                return option == "-h" || option == "--help" ? 0 : 1;
+            }
+        }
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (config.mdown.empty()) {
+        std::error_code ec;
+        config.mdown = (std::filesystem::read_symlink("/proc/self/exe", ec).parent_path() / "mdown").string();
+    }
+    if (::access(config.mdown.c_str(), X_OK) != 0) {
+        fmt::print(stderr, "mdown not found at {}, use --mdown <path>\n", config.mdown);
+        return 1;
+    }
+
+    TestServer server;
+    std::string error;
+    if (!server.start(0, error)) {
+        fmt::print(stderr, "{}\n", error);
+        return 1;
+    }
+    std::filesystem::create_directories(config.dir);
+
+    if (config.csv) {
+        fmt::print("size,tasks,threads,seconds,mib_per_s,user_s,sys_s,peak_rss_mib,ok\n");
+    } else {
+        fmt::print("{:>6} {:>6} {:>8} {:>9} {:>9} {:>8} {:>8} {:>10}\n", "size", "tasks", "threads", "seconds",
+                   "MiB/s", "user s", "sys s", "peak RSS");
+    }
+
+    bool all_ok = true;
+    for (const auto size : config.sizes) {
+        for (const int tasks : config.tasks) {
+            for (const int threads : config.threads) {
+                std::vector<std::string> args{config.mdown, "-d", config.dir.string(), "--progress", "none",
+                                              "--no-resume", "-t", std::to_string(threads)};
+                args.insert(args.end(), config.extra.begin(), config.extra.end());
+                std::vector<std::filesystem::path> files;
+                for (int task = 0; task < tasks; ++task) {
+                    std::string url = fmt::format("http://127.0.0.1:{}/{}?n={}", server.port(), size, task);
+                    if (!config.server_query.empty()) {
+                        url += "&" + config.server_query;
+                    }
+                    const std::string name = fmt::format("bench-{}.bin", task);
+                    args.push_back(url);
+                    args.push_back(name);
+                    files.push_back(config.dir / name);
+                }
+
+                std::vector<double> seconds, user, system;
+                long max_rss_kb = 0;
+                bool ok = true;
+                for (int run = 0; run < config.repeats; ++run) {
+                    const RunResult result = runMdown(args);
+                    ok = ok && result.ok;
+                    for (const auto& file : files) {
+                        if (ok && config.verify && run == 0 && !verifyFile(file, size)) {
+                            fmt::print(stderr, "content mismatch: {}\n", file.string());
+                            ok = false;
+                        }
+                        std::error_code ec;
+                        std::filesystem::remove(file, ec);
+                    }
+                    seconds.push_back(result.seconds);
+                    user.push_back(result.user);
+                    system.push_back(result.system);
+                    max_rss_kb = std::max(max_rss_kb, result.max_rss_kb);
+                }
+
+                const double wall = median(seconds);
+                const double mib = static_cast<double>(size) * tasks / (1024.0 * 1024.0);
+                const double rate = wall > 0.0 ? mib / wall : 0.0;
+                if (ok && rate < config.min_rate) {
+                    fmt::print(stderr, "too slow: {:.1f} MiB/s, expected at least {:.1f} MiB/s\n", rate,
+                               config.min_rate);
+                    ok = false;
+                }
+                all_ok = all_ok && ok;
+                const double rss_mib = static_cast<double>(max_rss_kb) / 1024.0;
+                if (config.csv) {
+                    fmt::print("{},{},{},{:.4f},{:.1f},{:.3f},{:.3f},{:.1f},{}\n", size, tasks, threads, wall, rate,
+                               median(user), median(system), rss_mib, ok ? 1 : 0);
+                } else {
+                    fmt::print("{:>6} {:>6} {:>8} {:>9.3f} {:>9.1f} {:>8.3f} {:>8.3f} {:>7.1f} MiB{}\n",
+                               sizeLabel(size), tasks, threads, wall, rate, median(user), median(system), rss_mib,
+                               ok ? "" : "  FAILED");
+                }
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    server.stop();
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+#include "hpack.hpp"
+
+#include <array>
+
+namespace downloader::bench {
+
+namespace {
+
+constexpr std::size_t kEntryOverhead = 32;
+
+// RFC 7541 附录 A
+const std::array<std::pair<const char*, const char*>, 61> kStaticTable{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+// RFC 7541 附录 B 中各符号(0~255 与 EOS)的码长. 这是一个规范 Huffman 码: 按 (码长, 符号) 排序后依次编号,
+// 所以只存码长就能还原出码表
+constexpr std::array<std::uint8_t, 257> kHuffmanLengths{
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+constexpr int kMaxCodeLength = 30;
+constexpr int kEos = 256;
+
+// 规范码的逐位解码表: 码长为 L 的码从 first[L] 开始连续编号, 对应 symbols[offset[L]...]
+struct HuffmanTable {
+    std::array<std::uint32_t, kMaxCodeLength + 1> first{};
+    std::array<std::uint32_t, kMaxCodeLength + 1> count{};
+    std::array<std::uint32_t, kMaxCodeLength + 1> offset{};
+    std::array<std::uint16_t, 257> symbols{};
+
+    HuffmanTable() {
+        for (const auto length : kHuffmanLengths) {
+            ++count[length];
+        }
+        std::uint32_t code = 0;
+        std::uint32_t index = 0;
+        for (int length = 1; length <= kMaxCodeLength; ++length) {
+            code <<= 1;
+            first[length] = code;
+            offset[length] = index;
+            code += count[length];
+            index += count[length];
+        }
+        std::array<std::uint32_t, kMaxCodeLength + 1> next = offset;
+        for (int length = 1; length <= kMaxCodeLength; ++length) {
+            for (int symbol = 0; symbol <= kEos; ++symbol) {
+                if (kHuffmanLengths[symbol] == length) {
+                    symbols[next[length]++] = static_cast<std::uint16_t>(symbol);
+                }
+            }
+        }
+    }
+};
+
+bool huffmanDecode(const std::uint8_t* data, std::size_t length, std::string& out) {
+    static const HuffmanTable table;
+    std::uint32_t code = 0;
+    int bits = 0;
+    for (std::size_t i = 0; i < length; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((data[i] >> bit) & 1U);
+            ++bits;
+            if (bits > kMaxCodeLength) {
+                return false;
+            }
+            if (code - table.first[bits] < table.count[bits]) {
+                const auto symbol = table.symbols[table.offset[bits] + code - table.first[bits]];
+                if (symbol == kEos) {
+                    return false;
+                }
+                out.push_back(static_cast<char>(symbol));
+                code = 0;
+                bits = 0;
+            }
+        }
+    }
+    // 末尾的填充是不超过 7 位的 EOS 前缀(全 1)
+    return bits < 8 && code == (1U << bits) - 1;
+}
+
+bool readInteger(const std::uint8_t*& p, const std::uint8_t* end, int prefix_bits, std::uint64_t& value) {
+    if (p == end) {
+        return false;
+    }
+    const std::uint8_t mask = static_cast<std::uint8_t>((1U << prefix_bits) - 1);
+    value = *p++ & mask;
+    if (value < mask) {
+        return true;
+    }
+    for (int shift = 0; shift < 56; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        const std::uint8_t byte = *p++;
+        value += static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readString(const std::uint8_t*& p, const std::uint8_t* end, std::string& out) {
+    if (p == end) {
+        return false;
+    }
+    const bool huffman = (*p & 0x80) != 0;
+    std::uint64_t length = 0;
+    if (!readInteger(p, end, 7, length) || length > static_cast<std::uint64_t>(end - p)) {
+        return false;
+    }
+    out.clear();
+    const bool ok = huffman ? huffmanDecode(p, static_cast<std::size_t>(length), out)
+                            : (out.assign(reinterpret_cast<const char*>(p), static_cast<std::size_t>(length)), true);
+    p += length;
+    return ok;
+}
+
+void writeInteger(std::string& out, std::uint8_t first_byte, int prefix_bits, std::uint64_t value) {
+    const std::uint64_t mask = (1U << prefix_bits) - 1;
+    if (value < mask) {
+        out.push_back(static_cast<char>(first_byte | value));
+        return;
+    }
+    out.push_back(static_cast<char>(first_byte | mask));
+    value -= mask;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+} // namespace
+
+bool HpackDecoder::lookup(std::uint64_t index, std::pair<std::string, std::string>& field) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= kStaticTable.size()) {
+        field = {kStaticTable[index - 1].first, kStaticTable[index - 1].second};
+        return true;
+    }
+    index -= kStaticTable.size() + 1;
+    if (index >= dynamic_.size()) {
+        return false;
+    }
+    field = dynamic_[static_cast<std::size_t>(index)];
+    return true;
+}
+
+void HpackDecoder::insert(std::pair<std::string, std::string> field) {
+    const std::size_t size = field.first.size() + field.second.size() + kEntryOverhead;
+    dynamic_size_ += size;
+    dynamic_.push_front(std::move(field));
+    evict();
+}
+
+void HpackDecoder::evict() {
+    while (dynamic_size_ > max_size_ && !dynamic_.empty()) {
+        const auto& last = dynamic_.back();
+        dynamic_size_ -= last.first.size() + last.second.size() + kEntryOverhead;
+        dynamic_.pop_back();
+    }
+}
+
+bool HpackDecoder::decode(const std::uint8_t* data, std::size_t length, HeaderList& headers) {
+    const std::uint8_t* p = data;
+    const std::uint8_t* end = data + length;
+    while (p < end) {
+        const std::uint8_t byte = *p;
+        std::pair<std::string, std::string> field;
+        std::uint64_t index = 0;
+        if (byte & 0x80) {
+            // 索引字段
+            if (!readInteger(p, end, 7, index) || !lookup(index, field)) {
+                return false;
+            }
+            headers.push_back(std::move(field));
+            continue;
+        }
+        if ((byte & 0xe0) == 0x20) {
+            // 动态表大小更新; 这里按自己在 SETTINGS 中声明的默认上限 4096 检查
+            if (!readInteger(p, end, 5, index) || index > 4096) {
+                return false;
+            }
+            max_size_ = static_cast<std::size_t>(index);
+            evict();
+            continue;
+        }
+
+        // 字面量: 01 带增量索引, 0000 不索引, 0001 永不索引
+        const bool indexing = (byte & 0xc0) == 0x40;
+        if (!readInteger(p, end, indexing ? 6 : 4, index)) {
+            return false;
+        }
+        if (index == 0) {
+            if (!readString(p, end, field.first)) {
+                return false;
+            }
+        } else if (!lookup(index, field)) {
+            return false;
+        }
+        if (!readString(p, end, field.second)) {
+            return false;
+        }
+        if (indexing) {
+            insert(field);
+        }
+        headers.push_back(std::move(field));
+    }
+    return true;
+}
+
+void hpackEncode(std::string& out, const std::string& name, const std::string& value) {
+    out.push_back(0x00);
+    writeInteger(out, 0x00, 7, name.size());
+    out += name;
+    writeInteger(out, 0x00, 7, value.size());
+    out += value;
+}
+
+} // namespace downloader::bench
@@ -0,0 +1,34 @@
+#pragma once
+
+// 测试服务器 HTTP/2 模式用的最小 HPACK (RFC 7541) 实现: 完整的解码(静态表、动态表、Huffman),
+// 编码只用"不索引的字面量", 不压缩, 够用而且不需要维护对端的动态表
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace downloader::bench {
+
+using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+class HpackDecoder {
+public:
+    // 解码一个完整的头部块并追加到 headers, 格式错误时返回 false(按 HTTP/2 规定整个连接应当关闭)
+    bool decode(const std::uint8_t* data, std::size_t length, HeaderList& headers);
+
+private:
+    bool lookup(std::uint64_t index, std::pair<std::string, std::string>& field) const;
+    void insert(std::pair<std::string, std::string> field);
+    void evict();
+
+    std::deque<std::pair<std::string, std::string>> dynamic_;   // 最新的在前面
+    std::size_t dynamic_size_{0};
+    std::size_t max_size_{4096};
+};
+
+// 追加一个"不索引的字面量"头部字段, name 必须是小写
+void hpackEncode(std::string& out, const std::string& name, const std::string& value);
+
+} // namespace downloader::bench
@@ -0,0 +1,538 @@
+#include "test_server.hpp"
+#include "test_server_internal.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace downloader::bench {
+
+using detail::Reply;
+using detail::Request;
+using detail::reason;
+using detail::sendAll;
+
+namespace {
+constexpr std::size_t kChunk = 64 * 1024;
+constexpr std::size_t kMaxHeader = 64 * 1024;
+
+std::uint64_t splitmix64(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+std::string lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+std::string trim(const std::string& text) {
+    const auto begin = text.find_first_not_of(" \t");
+    const auto end = text.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? std::string{} : text.substr(begin, end - begin + 1);
+}
+
+std::optional<Request> parseRequest(const std::string& head) {
+    Request request;
+    std::size_t line_end = head.find("\r\n");
+    const std::string first = head.substr(0, line_end);
+    const auto space1 = first.find(' ');
+    const auto space2 = first.find(' ', space1 + 1);
+    if (space1 == std::string::npos || space2 == std::string::npos) {
+        return std::nullopt;
+    }
+    request.method = first.substr(0, space1);
+    const std::string target = first.substr(space1 + 1, space2 - space1 - 1);
+    const auto question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string::npos) {
+        request.query = target.substr(question + 1);
+    }
+    request.close = first.compare(space2 + 1, std::string::npos, "HTTP/1.0") == 0;
+
+    while (line_end != std::string::npos) {
+        const std::size_t start = line_end + 2;
+        line_end = head.find("\r\n", start);
+        const std::string line = head.substr(start, line_end == std::string::npos ? std::string::npos : line_end - start);
+        const auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        const std::string name = lower(line.substr(0, colon));
+        const std::string value = trim(line.substr(colon + 1));
+        if (name == "range") {
+            request.range = value;
+        } else if (name == "if-none-match") {
+            request.if_none_match = value;
+        } else if (name == "connection") {
+            request.close = lower(value) == "close";
+        } else if (name == "upgrade") {
+            request.upgrade_h2c = lower(value) == "h2c";
+        }
+    }
+    return request;
+}
+
+// 返回 false 表示参数格式不对
+bool applyQuery(const std::string& query, ServerBehavior& behavior, int& status) {
+    std::size_t pos = 0;
+    while (pos <= query.size() && !query.empty()) {
+        const auto amp = query.find('&', pos);
+        const std::string item = query.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+        pos = amp == std::string::npos ? query.size() + 1 : amp + 1;
+        if (item.empty()) {
+            continue;
+        }
+        const auto eq = item.find('=');
+        const std::string key = item.substr(0, eq);
+        const std::string value = eq == std::string::npos ? std::string{} : item.substr(eq + 1);
+        try {
+            if (key == "norange") {
+                behavior.ranges = false;
+            } else if (key == "noh2") {
+                behavior.h2c = false;
+            } else if (key == "nolength") {
+                behavior.content_length = false;
+            } else if (key == "rate" || key == "tail" || key == "tailrate") {
+                const auto size = parseSize(value);
+                if (!size) {
+                    return false;
+                }
+                (key == "rate" ? behavior.rate : key == "tail" ? behavior.tail : behavior.tail_rate) = *size;
+            } else if (key == "latency") {
+                behavior.latency_ms = std::stoi(value);
+            } else if (key == "reset") {
+                behavior.reset_probability = std::stod(value);
+            } else if (key == "status") {
+                status = std::stoi(value);
+            }
+            // 其他参数忽略, 调用方可以用它们让 URL 互不相同
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 只支持单个区间: bytes=a-b, bytes=a-, bytes=-n
+bool parseRange(const std::string& header, std::uint64_t size, std::uint64_t& from, std::uint64_t& to) {
+    if (header.rfind("bytes=", 0) != 0 || header.find(',') != std::string::npos) {
+        return false;
+    }
+    const std::string spec = header.substr(6);
+    const auto dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return false;
+    }
+    try {
+        if (dash == 0) {
+            const std::uint64_t suffix = std::stoull(spec.substr(1));
+            if (suffix == 0 || size == 0) {
+                return false;
+            }
+            from = size - std::min(suffix, size);
+            to = size;
+            return true;
+        }
+        from = std::stoull(spec.substr(0, dash));
+        to = dash + 1 < spec.size() ? std::stoull(spec.substr(dash + 1)) + 1 : size;
+    } catch (const std::exception&) {
+        return false;
+    }
+    to = std::min(to, size);
+    return from < to;
+}
+
+} // namespace
+
+namespace detail {
+
+bool sendAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = ::send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+const char* reason(int status) {
+    switch (status) {
+    case 200:
+        return "OK";
+    case 206:
+        return "Partial Content";
+    case 304:
+        return "Not Modified";
+    case 404:
+        return "Not Found";
+    case 416:
+        return "Range Not Satisfiable";
+    case 429:
+        return "Too Many Requests";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Status";
+    }
+}
+Reply planReply(const Request& request, const ServerBehavior& defaults) {
+    Reply reply;
+    reply.behavior = defaults;
+    int status = 0;
+    const auto size = parseSize(request.path.substr(request.path.empty() ? 0 : 1));
+    if (!size || !applyQuery(request.query, reply.behavior, status)) {
+        status = 404;
+    }
+    reply.size = size.value_or(0);
+    reply.to = reply.size;
+
+    const std::string etag = fmt::format("\"mdown-test-{}\"", reply.size);
+    if (status == 0 && !request.if_none_match.empty() && request.if_none_match == etag) {
+        status = 304;
+    }
+    if (status == 0 && reply.behavior.ranges && !request.range.empty() &&
+        !parseRange(request.range, reply.size, reply.from, reply.to)) {
+        status = 416;
+    }
+    if (status != 0) {
+        reply.status = status;
+        reply.body = false;
+        return reply;
+    }
+
+    reply.status = reply.behavior.ranges && !request.range.empty() ? 206 : 200;
+    reply.body = request.method != "HEAD";
+    return reply;
+}
+
+std::vector<std::pair<std::string, std::string>> replyHeaders(const Reply& reply) {
+    const std::string etag = fmt::format("\"mdown-test-{}\"", reply.size);
+    if (reply.status == 416) {
+        return {{"content-range", fmt::format("bytes */{}", reply.size)}, {"content-length", "0"}};
+    }
+    if (reply.status != 200 && reply.status != 206) {
+        return {{"content-length", "0"}, {"etag", etag}};
+    }
+
+    std::vector<std::pair<std::string, std::string>> headers;
+    if (reply.status == 206) {
+        headers.emplace_back("content-range", fmt::format("bytes {}-{}/{}", reply.from, reply.to - 1, reply.size));
+    }
+    if (reply.behavior.ranges) {
+        headers.emplace_back("accept-ranges", "bytes");
+    }
+    if (reply.behavior.content_length) {
+        headers.emplace_back("content-length", std::to_string(reply.to - reply.from));
+    }
+    headers.emplace_back("etag", etag);
+    headers.emplace_back("last-modified", "Wed, 01 Jan 2020 00:00:00 GMT");
+    return headers;
+}
+
+std::uint64_t resetPoint(const Reply& reply, std::mt19937_64& rng) {
+    if (reply.behavior.reset_probability > 0.0 && reply.to > reply.from &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(rng) < reply.behavior.reset_probability) {
+        return reply.from + std::uniform_int_distribution<std::uint64_t>(0, reply.to - reply.from - 1)(rng);
+    }
+    return reply.to;
+}
+
+std::uint64_t tailStart(const Reply& reply) {
+    const ServerBehavior& behavior = reply.behavior;
+    return behavior.tail > 0 && behavior.tail_rate > 0 ? reply.size - std::min(behavior.tail, reply.size)
+                                                       : reply.size;
+}
+
+} // namespace detail
+
+std::optional<std::uint64_t> parseSize(const std::string& text) {
+    std::size_t consumed = 0;
+    std::uint64_t value = 0;
+    try {
+        value = std::stoull(text, &consumed);
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+    const std::string suffix = lower(text.substr(consumed));
+    if (suffix.empty() || suffix == "b") {
+        return value;
+    }
+    if (suffix == "k") {
+        return value << 10;
+    }
+    if (suffix == "m") {
+        return value << 20;
+    }
+    if (suffix == "g") {
+        return value << 30;
+    }
+    return std::nullopt;
+}
+
+// 第 i 个 8 字节是 splitmix64(i) 的小端表示; 对齐的部分整字拷贝, 服务器才不会先成为瓶颈
+void TestServer::fill(char* out, std::uint64_t offset, std::size_t length) {
+    const auto partial = [&](std::size_t skip, std::size_t n) {
+        const std::uint64_t word = splitmix64(offset / 8);
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = static_cast<char>(word >> (8 * (skip + i)));
+        }
+        out += n;
+        offset += n;
+        length -= n;
+    };
+
+    if (offset % 8 != 0 && length > 0) {
+        const auto skip = static_cast<std::size_t>(offset % 8);
+        partial(skip, std::min<std::size_t>(8 - skip, length));
+    }
+    for (std::uint64_t index = offset / 8; length >= 8; ++index) {
+        unsigned char bytes[8];
+        const std::uint64_t word = splitmix64(index);
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<unsigned char>(word >> (8 * i));
+        }
+        std::memcpy(out, bytes, 8);
+        out += 8;
+        offset += 8;
+        length -= 8;
+    }
+    if (length > 0) {
+        partial(0, length);
+    }
+}
+
+TestServer::~TestServer() {
+    stop();
+}
+
+bool TestServer::start(std::uint16_t port, std::string& error) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+    const int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 256) != 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        error = fmt::format("Cannot listen on 127.0.0.1:{}: {}", port, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    listen_fd_ = fd;
+    port_ = ntohs(address.sin_port);
+    stopping_.store(false);
+    accept_thread_ = std::thread([this] { acceptLoop(); });
+    return true;
+}
+
+void TestServer::stop() {
+    stopping_.store(true);
+    if (accept_thread_.joinable()) {
+        accept_thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (auto& connection : connections_) {
+            if (connection.fd >= 0) {
+                ::shutdown(connection.fd, SHUT_RDWR);
+            }
+        }
+    }
+    reapConnections(true);
+}
+
+void TestServer::acceptLoop() {
+    while (!stopping_.load()) {
+        pollfd entry{listen_fd_, POLLIN, 0};
+        if (::poll(&entry, 1, 200) <= 0) {
+            reapConnections(false);
+            continue;
+        }
+        const int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        const int nodelay = 1;
+        ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        auto& connection = connections_.emplace_back();
+        connection.fd = client;
+        connection.thread = std::thread([this, &connection] { serve(connection); });
+    }
+}
+
+void TestServer::reapConnections(bool all) {
+    std::list<Connection> finished;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            const auto next = std::next(it);
+            if (all || it->done.load()) {
+                finished.splice(finished.end(), connections_, it);
+            }
+            it = next;
+        }
+    }
+    for (auto& connection : finished) {
+        connection.thread.join();
+    }
+}
+
+// 一个连接一个线程, 支持 keep-alive; 返回时关闭连接. 以 HTTP/2 preface 开头或者请求升级到 h2c 时
+// 交给 serveHttp2
+void TestServer::serve(Connection& connection) {
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    const int fd = connection.fd;
+    std::string input;
+    std::vector<char> body(kChunk);
+    bool reset = false;
+
+    while (!stopping_.load() && !reset) {
+        std::size_t header_end = 0;
+        while ((header_end = input.find("\r\n\r\n")) == std::string::npos) {
+            char buffer[4096];
+            const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0 || input.size() > kMaxHeader) {
+                header_end = std::string::npos;
+                break;
+            }
+            input.append(buffer, static_cast<std::size_t>(n));
+        }
+        if (header_end == std::string::npos) {
+            break;
+        }
+        const auto request = parseRequest(input.substr(0, header_end));
+        input.erase(0, header_end + 4);
+        if (!request) {
+            break;
+        }
+        // "PRI * HTTP/2.0\r\n\r\n" 是 HTTP/2 客户端 preface 的前半截
+        if (request->method == "PRI" && request->path == "*") {
+            detail::serveHttp2(fd, std::move(input), "SM\r\n\r\n", std::nullopt, defaults_, stopping_);
+            break;
+        }
+
+        const Reply reply = detail::planReply(*request, defaults_);
+        if (request->upgrade_h2c && reply.behavior.h2c) {
+            constexpr std::string_view kSwitch =
+                "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+            if (sendAll(fd, kSwitch.data(), kSwitch.size())) {
+                detail::serveHttp2(fd, std::move(input), "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", request, defaults_,
+                                   stopping_);
+            }
+            break;
+        }
+        if (reply.behavior.latency_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{reply.behavior.latency_ms});
+        }
+
+        const bool close_after = request->close || (reply.body && !reply.behavior.content_length);
+        std::string head = fmt::format("HTTP/1.1 {} {}\r\n", reply.status, reason(reply.status));
+        for (const auto& [name, value] : detail::replyHeaders(reply)) {
+            head += fmt::format("{}: {}\r\n", name, value);
+        }
+        head += close_after ? "Connection: close\r\n\r\n" : "\r\n";
+        if (!sendAll(fd, head.data(), head.size())) {
+            break;
+        }
+        if (!reply.body) {
+            if (close_after) {
+                break;
+            }
+            continue;
+        }
+
+        // 需要重置时在响应体中随机选一个位置断开
+        const std::uint64_t cut = detail::resetPoint(reply, rng);
+
+        // 按速率分段发送: 每段发完后等到它按速率"应该"发完的时刻
+        const ServerBehavior& behavior = reply.behavior;
+        const std::uint64_t tail_start = detail::tailStart(reply);
+        auto deadline = std::chrono::steady_clock::now();
+        std::uint64_t offset = reply.from;
+        const std::uint64_t to = reply.to;
+        bool in_tail = false;
+        while (offset < to && !stopping_.load()) {
+            if (offset >= cut) {
+                reset = true;
+                break;
+            }
+            if (!in_tail && offset >= tail_start) {
+                in_tail = true;
+                deadline = std::chrono::steady_clock::now();
+            }
+            const std::uint64_t rate = in_tail ? behavior.tail_rate : behavior.rate;
+            std::uint64_t limit = std::min<std::uint64_t>({kChunk, to - offset, cut - offset});
+            if (!in_tail && tail_start > offset) {
+                limit = std::min(limit, tail_start - offset);
+            }
+            if (rate > 0) {
+                limit = std::min<std::uint64_t>(limit, std::max<std::uint64_t>(rate / 20, 1));
+            }
+
+            fill(body.data(), offset, static_cast<std::size_t>(limit));
+            if (!sendAll(fd, body.data(), static_cast<std::size_t>(limit))) {
+                reset = true;
+                break;
+            }
+            offset += limit;
+            if (rate > 0) {
+                deadline += std::chrono::nanoseconds{limit * 1000000000ULL / rate};
+                std::this_thread::sleep_until(deadline);
+            }
+        }
+        if (close_after) {
+            break;
+        }
+    }
+
+    if (reset) {
+        // SO_LINGER 为 0 时 close 发送 RST, 客户端看到的是连接被重置而不是正常结束
+        const linger option{1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+    }
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connection.fd = -1;
+    }
+    ::close(fd);
+    connection.done.store(true);
+}
+
+} // namespace downloader::bench
@@ -0,0 +1,78 @@
+#pragma once
+
+// 测量和手工测试用的本地 HTTP/1.1 与 HTTP/2 (h2c) 服务器. 响应体按偏移确定性生成, 不需要准备文件:
+//   GET|HEAD /<size>[?选项]      size 如 4096、64K、1G
+// 查询参数覆盖构造时给的默认行为:
+//   norange         忽略 Range, 不返回 Accept-Ranges
+//   nolength        不返回 Content-Length, 发完后关闭连接
+//   rate=<size>     每个连接每秒最多发送的字节数
+//   latency=<ms>    收到请求后等待这么久再回复
+//   reset=<p>       以概率 p (0~1) 在响应体中途重置连接
+//   tail=<size>     文件最后 <size> 字节按 tailrate=<size> 的速率发送(慢尾巴)
+//   status=<code>   直接返回该状态码和空响应体
+//   noh2            不接受这个请求的 Upgrade: h2c, 用来测试退回 HTTP/1.1
+// 带 If-None-Match 且与 ETag 相同时返回 304.
+// HTTP/2 只支持明文: 以客户端 preface 开头的连接(prior knowledge)或带 Upgrade: h2c 的请求. 各个流交错发送,
+// 遵守对端的流量控制窗口, 速率限制按流计算, reset 对应 RST_STREAM 而不是断开连接.
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace downloader::bench {
+
+struct ServerBehavior {
+    bool ranges{true};
+    bool content_length{true};
+    bool h2c{true};                // 接受 Upgrade: h2c
+    std::uint64_t rate{0};         // 0 表示不限速
+    int latency_ms{0};
+    double reset_probability{0.0};
+    std::uint64_t tail{0};
+    std::uint64_t tail_rate{0};
+};
+
+// "4096", "64K", "1G" 这样的大小(按 1024 进位), 格式不对时返回空
+std::optional<std::uint64_t> parseSize(const std::string& text);
+
+class TestServer {
+public:
+    explicit TestServer(ServerBehavior defaults = {}) : defaults_(defaults) {}
+    ~TestServer();
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    // 监听 127.0.0.1:port (0 表示任选空闲端口)并开始接受连接, 失败时返回 false 并写入 error
+    bool start(std::uint16_t port, std::string& error);
+    void stop();
+    [[nodiscard]] std::uint16_t port() const { return port_; }
+
+    // 偏移 offset 起的 length 字节内容, 与服务器发出的完全一致, 用于校验下载结果
+    static void fill(char* out, std::uint64_t offset, std::size_t length);
+
+private:
+    struct Connection {
+        int fd{-1};
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    void acceptLoop();
+    void serve(Connection& connection);
+    void reapConnections(bool all);
+
+    const ServerBehavior defaults_;
+    int listen_fd_{-1};
+    std::uint16_t port_{0};
+    std::atomic<bool> stopping_{false};
+    std::thread accept_thread_;
+    std::mutex connections_mutex_;
+    std::list<Connection> connections_;
+};
+
+} // namespace downloader::bench
@@ -0,0 +1,437 @@
+// 测试服务器的 HTTP/2 (h2c) 连接: 单线程, 读帧和按轮转给各个流发 DATA 交替进行. 只实现下载客户端
+// 用得到的部分: SETTINGS/PING/WINDOW_UPDATE/RST_STREAM/GOAWAY 和 GET/HEAD 请求, 不支持服务器推送和请求体
+#include "hpack.hpp"
+#include "test_server_internal.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+namespace downloader::bench::detail {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum FrameType : std::uint8_t {
+    kData = 0x0,
+    kHeaders = 0x1,
+    kRstStream = 0x3,
+    kSettings = 0x4,
+    kPing = 0x6,
+    kGoaway = 0x7,
+    kWindowUpdate = 0x8,
+    kContinuation = 0x9,
+};
+
+constexpr std::uint8_t kFlagEndStream = 0x1;
+constexpr std::uint8_t kFlagAck = 0x1;
+constexpr std::uint8_t kFlagEndHeaders = 0x4;
+constexpr std::uint8_t kFlagPadded = 0x8;
+constexpr std::uint8_t kFlagPriority = 0x20;
+
+constexpr std::uint16_t kSettingsMaxConcurrentStreams = 0x3;
+constexpr std::uint16_t kSettingsInitialWindowSize = 0x4;
+
+constexpr std::uint32_t kErrorProtocol = 0x1;
+constexpr std::uint32_t kErrorInternal = 0x2;
+
+constexpr std::size_t kFrameHeader = 9;
+constexpr std::size_t kMaxFrame = 16384;   // 没有声明更大的 SETTINGS_MAX_FRAME_SIZE, 双方都按默认值
+constexpr std::int64_t kDefaultWindow = 65535;
+constexpr std::uint32_t kMaxStreams = 128;
+
+std::uint32_t readU32(const std::uint8_t* p) {
+    return (static_cast<std::uint32_t>(p[0]) << 24) | (static_cast<std::uint32_t>(p[1]) << 16) |
+           (static_cast<std::uint32_t>(p[2]) << 8) | p[3];
+}
+
+void appendU32(std::string& out, std::uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+struct Stream {
+    Reply reply;
+    std::uint64_t offset{0};
+    std::uint64_t cut{0};
+    std::uint64_t tail_start{0};
+    std::int64_t window{kDefaultWindow};
+    bool headers_sent{false};
+    bool in_tail{false};
+    Clock::time_point due;   // 在此之前不发送(模拟延迟和限速)
+};
+
+class Http2Connection {
+public:
+    Http2Connection(int fd, const ServerBehavior& defaults, const std::atomic<bool>& stopping)
+        : fd_(fd), defaults_(defaults), stopping_(stopping), buffer_(kFrameHeader + kMaxFrame) {}
+
+    void run(std::string input, std::string_view preface, const std::optional<Request>& upgraded) {
+        input_ = std::move(input);
+        std::string settings;
+        settings.push_back(static_cast<char>(kSettingsMaxConcurrentStreams >> 8));
+        settings.push_back(static_cast<char>(kSettingsMaxConcurrentStreams & 0xff));
+        appendU32(settings, kMaxStreams);
+        if (!sendFrame(kSettings, 0, 0, settings)) {
+            return;
+        }
+        // 升级来的请求是流 1, 对端已经半关闭
+        if (upgraded) {
+            openStream(1, *upgraded);
+        }
+
+        bool preface_seen = false;
+        while (!stopping_.load()) {
+            if (!preface_seen && input_.size() >= preface.size()) {
+                if (input_.compare(0, preface.size(), preface) != 0) {
+                    return;
+                }
+                input_.erase(0, preface.size());
+                preface_seen = true;
+            }
+            if (preface_seen && !processFrames()) {
+                return;
+            }
+            if (!sendRound()) {
+                return;
+            }
+
+            pollfd entry{fd_, POLLIN, 0};
+            if (::poll(&entry, 1, pollTimeout()) < 0) {
+                return;
+            }
+            if (entry.revents & (POLLIN | POLLHUP | POLLERR)) {
+                char chunk[16384];
+                const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    return;
+                }
+                input_.append(chunk, static_cast<std::size_t>(n));
+            }
+        }
+        goaway(0);
+    }
+
+private:
+    bool sendFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream, std::string_view payload) {
+        std::string frame;
+        frame.reserve(kFrameHeader + payload.size());
+        frame.push_back(static_cast<char>(payload.size() >> 16));
+        frame.push_back(static_cast<char>(payload.size() >> 8));
+        frame.push_back(static_cast<char>(payload.size()));
+        frame.push_back(static_cast<char>(type));
+        frame.push_back(static_cast<char>(flags));
+        appendU32(frame, stream & 0x7fffffffU);
+        frame.append(payload);
+        return sendAll(fd_, frame.data(), frame.size());
+    }
+
+    void goaway(std::uint32_t error) {
+        std::string payload;
+        appendU32(payload, last_stream_);
+        appendU32(payload, error);
+        sendFrame(kGoaway, 0, 0, payload);
+    }
+
+    bool resetStream(std::uint32_t id, std::uint32_t error) {
+        streams_.erase(id);
+        std::string payload;
+        appendU32(payload, error);
+        return sendFrame(kRstStream, 0, id, payload);
+    }
+
+    void openStream(std::uint32_t id, const Request& request) {
+        last_stream_ = std::max(last_stream_, id);
+        Stream stream;
+        stream.reply = planReply(request, defaults_);
+        stream.offset = stream.reply.from;
+        stream.cut = resetPoint(stream.reply, rng_);
+        stream.tail_start = tailStart(stream.reply);
+        stream.window = initial_window_;
+        stream.due = Clock::now() + std::chrono::milliseconds{stream.reply.behavior.latency_ms};
+        streams_[id] = std::move(stream);
+    }
+
+    // 处理 input_ 中所有完整的帧, 协议错误时发送 GOAWAY 并返回 false
+    bool processFrames() {
+        while (input_.size() >= kFrameHeader) {
+            const auto* head = reinterpret_cast<const std::uint8_t*>(input_.data());
+            const std::size_t length = (static_cast<std::size_t>(head[0]) << 16) | (head[1] << 8) | head[2];
+            if (length > kMaxFrame) {
+                goaway(kErrorProtocol);
+                return false;
+            }
+            if (input_.size() < kFrameHeader + length) {
+                return true;
+            }
+            const std::uint8_t type = head[3];
+            const std::uint8_t flags = head[4];
+            const std::uint32_t stream = readU32(head + 5) & 0x7fffffffU;
+            const std::string payload = input_.substr(kFrameHeader, length);
+            input_.erase(0, kFrameHeader + length);
+            if (!handleFrame(type, flags, stream, reinterpret_cast<const std::uint8_t*>(payload.data()),
+                             payload.size())) {
+                goaway(kErrorProtocol);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool handleFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream, const std::uint8_t* payload,
+                     std::size_t length) {
+        // 头部块没结束时只能跟 CONTINUATION
+        if (continuation_stream_ != 0 && (type != kContinuation || stream != continuation_stream_)) {
+            return false;
+        }
+
+        switch (type) {
+        case kHeaders: {
+            std::size_t pad = 0;
+            if (flags & kFlagPadded) {
+                if (length < 1) {
+                    return false;
+                }
+                pad = payload[0];
+                ++payload;
+                --length;
+            }
+            if (flags & kFlagPriority) {
+                if (length < 5) {
+                    return false;
+                }
+                payload += 5;
+                length -= 5;
+            }
+            if (pad > length || stream == 0) {
+                return false;
+            }
+            header_block_.assign(reinterpret_cast<const char*>(payload), length - pad);
+            continuation_stream_ = stream;
+            return (flags & kFlagEndHeaders) == 0 || finishHeaders();
+        }
+        case kContinuation:
+            header_block_.append(reinterpret_cast<const char*>(payload), length);
+            return (flags & kFlagEndHeaders) == 0 || finishHeaders();
+        case kSettings:
+            if (flags & kFlagAck) {
+                return true;
+            }
+            if (length % 6 != 0) {
+                return false;
+            }
+            for (std::size_t i = 0; i < length; i += 6) {
+                const std::uint16_t id = static_cast<std::uint16_t>((payload[i] << 8) | payload[i + 1]);
+                const std::uint32_t value = readU32(payload + i + 2);
+                if (id == kSettingsInitialWindowSize) {
+                    // 已有流的窗口按差值调整
+                    const std::int64_t delta = static_cast<std::int64_t>(value) - initial_window_;
+                    initial_window_ = value;
+                    for (auto& [id_, s] : streams_) {
+                        s.window += delta;
+                    }
+                }
+            }
+            settings_received_ = true;
+            return sendFrame(kSettings, kFlagAck, 0, {});
+        case kWindowUpdate: {
+            if (length != 4) {
+                return false;
+            }
+            const std::uint32_t increment = readU32(payload) & 0x7fffffffU;
+            if (stream == 0) {
+                connection_window_ += increment;
+            } else if (auto it = streams_.find(stream); it != streams_.end()) {
+                it->second.window += increment;
+            }
+            return true;
+        }
+        case kRstStream:
+            streams_.erase(stream);
+            return true;
+        case kPing:
+            if (length != 8) {
+                return false;
+            }
+            return (flags & kFlagAck) != 0 ||
+                   sendFrame(kPing, kFlagAck, 0, {reinterpret_cast<const char*>(payload), length});
+        case kGoaway:
+            return false;
+        default:
+            // DATA(没有请求体)、PRIORITY 和未知类型都忽略
+            return true;
+        }
+    }
+
+    bool finishHeaders() {
+        const std::uint32_t id = continuation_stream_;
+        continuation_stream_ = 0;
+        HeaderList headers;
+        if (!decoder_.decode(reinterpret_cast<const std::uint8_t*>(header_block_.data()), header_block_.size(),
+                             headers)) {
+            return false;
+        }
+
+        Request request;
+        for (const auto& [name, value] : headers) {
+            if (name == ":method") {
+                request.method = value;
+            } else if (name == ":path") {
+                const auto question = value.find('?');
+                request.path = value.substr(0, question);
+                request.query = question == std::string::npos ? std::string{} : value.substr(question + 1);
+            } else if (name == "range") {
+                request.range = value;
+            } else if (name == "if-none-match") {
+                request.if_none_match = value;
+            }
+        }
+        if (streams_.size() >= kMaxStreams) {
+            return resetStream(id, kErrorInternal);
+        }
+        openStream(id, request);
+        return true;
+    }
+
+    [[nodiscard]] bool ready(const Stream& stream, Clock::time_point now) const {
+        if (stream.due > now) {
+            return false;
+        }
+        return !stream.headers_sent || (stream.window > 0 && connection_window_ > 0);
+    }
+
+    // 有流可以立即发送时不等待, 否则等到最早的到期时刻(最多 200ms), 期间有数据到达会提前返回
+    [[nodiscard]] int pollTimeout() const {
+        if (!settings_received_) {
+            return 200;
+        }
+        const auto now = Clock::now();
+        auto wake = now + std::chrono::milliseconds{200};
+        for (const auto& [id, stream] : streams_) {
+            if (ready(stream, now)) {
+                return 0;
+            }
+            if (!stream.headers_sent || (stream.window > 0 && connection_window_ > 0)) {
+                wake = std::min(wake, stream.due);
+            }
+        }
+        return static_cast<int>(
+            std::chrono::ceil<std::chrono::milliseconds>(wake - now).count());
+    }
+
+    // 每个就绪的流最多发一帧, 流之间交错. 响应头在流到期后先发
+    bool sendRound() {
+        if (!settings_received_) {
+            return true;
+        }
+        const auto now = Clock::now();
+        for (auto it = streams_.begin(); it != streams_.end();) {
+            const std::uint32_t id = it->first;
+            Stream& stream = it->second;
+            ++it;
+            if (!ready(stream, now)) {
+                continue;
+            }
+
+            const Reply& reply = stream.reply;
+            if (!stream.headers_sent) {
+                std::string block;
+                hpackEncode(block, ":status", std::to_string(reply.status));
+                for (const auto& [name, value] : replyHeaders(reply)) {
+                    hpackEncode(block, name, value);
+                }
+                const bool done = !reply.body || reply.from == reply.to;
+                if (!sendFrame(kHeaders, kFlagEndHeaders | (done ? kFlagEndStream : 0), id, block)) {
+                    return false;
+                }
+                stream.headers_sent = true;
+                if (done) {
+                    streams_.erase(id);
+                }
+                continue;
+            }
+
+            if (stream.offset >= stream.cut) {
+                if (!resetStream(id, kErrorInternal)) {
+                    return false;
+                }
+                continue;
+            }
+            if (!stream.in_tail && stream.offset >= stream.tail_start) {
+                stream.in_tail = true;
+                stream.due = now;
+            }
+            const std::uint64_t rate = stream.in_tail ? reply.behavior.tail_rate : reply.behavior.rate;
+            std::uint64_t limit = std::min<std::uint64_t>({kMaxFrame, reply.to - stream.offset,
+                                                           stream.cut - stream.offset,
+                                                           static_cast<std::uint64_t>(stream.window),
+                                                           static_cast<std::uint64_t>(connection_window_)});
+            if (!stream.in_tail && stream.tail_start > stream.offset) {
+                limit = std::min(limit, stream.tail_start - stream.offset);
+            }
+            if (rate > 0) {
+                limit = std::min<std::uint64_t>(limit, std::max<std::uint64_t>(rate / 20, 1));
+            }
+
+            const auto n = static_cast<std::size_t>(limit);
+            const bool last = stream.offset + limit == reply.to;
+            char* frame = buffer_.data();
+            frame[0] = static_cast<char>(n >> 16);
+            frame[1] = static_cast<char>(n >> 8);
+            frame[2] = static_cast<char>(n);
+            frame[3] = static_cast<char>(kData);
+            frame[4] = static_cast<char>(last ? kFlagEndStream : 0);
+            for (int i = 0; i < 4; ++i) {
+                frame[5 + i] = static_cast<char>(id >> (24 - 8 * i));
+            }
+            TestServer::fill(frame + kFrameHeader, stream.offset, n);
+            if (!sendAll(fd_, frame, kFrameHeader + n)) {
+                return false;
+            }
+
+            stream.offset += limit;
+            stream.window -= static_cast<std::int64_t>(limit);
+            connection_window_ -= static_cast<std::int64_t>(limit);
+            if (rate > 0) {
+                stream.due = std::max(stream.due, now - std::chrono::milliseconds{100}) +
+                             std::chrono::nanoseconds{limit * 1000000000ULL / rate};
+            }
+            if (last) {
+                streams_.erase(id);
+            }
+        }
+        return true;
+    }
+
+    const int fd_;
+    const ServerBehavior& defaults_;
+    const std::atomic<bool>& stopping_;
+    std::mt19937_64 rng_{std::random_device{}()};
+
+    std::string input_;
+    std::vector<char> buffer_;
+    HpackDecoder decoder_;
+    std::string header_block_;
+    std::uint32_t continuation_stream_{0};
+    std::uint32_t last_stream_{0};
+    bool settings_received_{false};
+    std::int64_t initial_window_{kDefaultWindow};
+    std::int64_t connection_window_{kDefaultWindow};
+    std::map<std::uint32_t, Stream> streams_;
+};
+
+} // namespace
+
+void serveHttp2(int fd, std::string input, std::string_view preface, const std::optional<Request>& upgraded,
+                const ServerBehavior& defaults, const std::atomic<bool>& stopping) {
+    Http2Connection(fd, defaults, stopping).run(std::move(input), preface, upgraded);
+}
+
+} // namespace downloader::bench::detail
@@ -0,0 +1,57 @@
+#pragma once
+
+// test_server.cpp (HTTP/1.1) 与 test_server_h2.cpp (HTTP/2) 共用的请求解析和应答规划
+#include "test_server.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace downloader::bench::detail {
+
+struct Request {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::string range;
+    std::string if_none_match;
+    bool upgrade_h2c{false};   // Upgrade: h2c
+    bool close{false};
+};
+
+// 一个请求的应答: 状态码、响应体区间以及对它生效的行为(默认行为加查询参数)
+struct Reply {
+    int status{200};
+    std::uint64_t size{0};
+    std::uint64_t from{0};
+    std::uint64_t to{0};
+    bool body{true};   // false 时只有头部(HEAD、错误状态、304、416)
+    ServerBehavior behavior;
+};
+
+Reply planReply(const Request& request, const ServerBehavior& defaults);
+
+// 应答的头部字段(不含状态行和连接管理), 名字为小写
+std::vector<std::pair<std::string, std::string>> replyHeaders(const Reply& reply);
+
+// 需要模拟重置时返回响应体中随机的断开位置, 否则返回 reply.to
+std::uint64_t resetPoint(const Reply& reply, std::mt19937_64& rng);
+
+// 慢尾巴开始的偏移, 没有慢尾巴时为文件大小
+std::uint64_t tailStart(const Reply& reply);
+
+const char* reason(int status);
+bool sendAll(int fd, const char* data, std::size_t length);
+
+// 按 HTTP/2 (h2c) 处理一个连接直到对端关闭或服务器停止. input 是已经读到但还没处理的数据, 应当以
+// preface 开头(不完整时继续读); upgraded 为通过 Upgrade: h2c 升级来的请求, 作为流 1 应答
+void serveHttp2(int fd, std::string input, std::string_view preface, const std::optional<Request>& upgraded,
+                const ServerBehavior& defaults, const std::atomic<bool>& stopping);
+
+} // namespace downloader::bench::detail
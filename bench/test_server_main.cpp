@@ -0,0 +1,97 @@
+// 独立运行的本地测试服务器, 命令行参数是所有请求的默认行为, 单个请求还可以用查询参数覆盖
+// (见 test_server.hpp). 运行到 Ctrl-C 为止.
+#include "test_server.hpp"
+
+#include <fmt/core.h>
+
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void printUsage(const char* program) {
+    fmt::print(stderr,
+               "Usage: {} [-p <port>] [--no-range] [--no-length] [--no-h2c] [--rate <size>] [--latency <ms>]\n"
+               "       [--reset <probability>] [--tail <size> --tail-rate <size>]\n"
+               "Serves GET/HEAD /<size> (e.g. /64M) with deterministic content on 127.0.0.1 over HTTP/1.1\n"
+               "or HTTP/2 cleartext (prior knowledge, or Upgrade: h2c unless --no-h2c).\n"
+               "Per-request overrides: ?norange&nolength&rate=1M&latency=50&reset=0.1&tail=1M&tailrate=64K\n"
+               "&status=503&noh2\n",
+               program);
+}
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void onSignal(int) {
+    g_stop = 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using downloader::bench::parseSize;
+
+    downloader::bench::ServerBehavior behavior;
+    int port = 8080;
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--no-range") {
+            behavior.ranges = false;
+        } else if (option == "--no-length") {
+            behavior.content_length = false;
+        } else if (option == "--no-h2c") {
+            behavior.h2c = false;
+        } else if ((option == "-p" || option == "--rate" || option == "--latency" || option == "--reset" ||
+                    option == "--tail" || option == "--tail-rate") &&
+                   i + 1 < argc) {
+            const std::string value = argv[++i];
+            try {
+                if (option == "-p") {
+                    port = std::stoi(value);
+                } else if (option == "--latency") {
+                    behavior.latency_ms = std::stoi(value);
+                } else if (option == "--reset") {
+                    behavior.reset_probability = std::stod(value);
+                } else {
+                    const auto size = parseSize(value);
+                    if (!size) {
+                        throw std::invalid_argument(value);
+                    }
+                    (option == "--rate" ? behavior.rate : option == "--tail" ? behavior.tail : behavior.tail_rate) =
+                        *size;
+                }
+            } catch (const std::exception&) {
+                fmt::print(stderr, "Invalid value for {}: {}\n", option, value);
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return option == "-h" || option == "--help" ? 0 : 1;
+        }
+    }
+    if (port < 0 || port > 65535) {
+        fmt::print(stderr, "Invalid port: {}\n", port);
+        return 1;
+    }
+
+    downloader::bench::TestServer server(behavior);
+    std::string error;
+    if (!server.start(static_cast<std::uint16_t>(port), error)) {
+        fmt::print(stderr, "{}\n", error);
+        return 1;
+    }
+    fmt::print("listening on http://127.0.0.1:{}/  (try /64M)\n", server.port());
+    std::fflush(stdout);
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    while (!g_stop) {
+        ::pause();
+    }
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,244 @@
+// 写盘路径基准: 模拟多个连接各自顺序写自己的分片, 每次回调 16KB, 比较
+//   pwrite    - 在网络线程上每次回调直接 pwrite(不用写入流水线时的做法)
+//   behind    - 拷进写入流水线的缓冲区, 由写线程 pwrite
+//   io_uring  - 拷进写入流水线的缓冲区, 批量提交给 io_uring
+// 输出总耗时、"网络线程"占用的 CPU 时间和整个进程的 CPU 时间.
+#include "downloader/detail/write_behind.hpp"
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using downloader::detail::WriteBehind;
+
+constexpr std::size_t kChunk = 16 * 1024;
+
+struct Config {
+    std::string path = "mdown-write-bench.tmp";
+    std::size_t total = 1024ULL * 1024 * 1024;
+    int streams = 8;
+    bool direct_io = false;
+};
+
+double threadCpuSeconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+double processCpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    const auto seconds = [](const timeval& tv) {
+        return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+    };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+bool writeAll(int fd, const char* data, std::size_t length, off_t offset) {
+    while (length > 0) {
+        const ssize_t n = ::pwrite(fd, data, length, offset);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+        offset += n;
+    }
+    return true;
+}
+
+// 等所有交给写线程的缓冲区完成
+class Pending {
+public:
+    void add() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++count_;
+    }
+    void done(bool ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = failed_ || !ok;
+        if (--count_ == 0) {
+            cv_.notify_all();
+        }
+    }
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return count_ == 0; });
+        return !failed_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int count_{0};
+    bool failed_{false};
+};
+
+// 和 MultiDownloader::bufferWrite 一样: 缓冲区写满就提交, 借不到缓冲区就直接写
+void produce(WriteBehind* writer, int fd, int direct_fd, off_t first, off_t last, Pending& pending,
+             std::atomic<double>& producer_cpu, std::atomic<bool>& failed) {
+    std::vector<char> chunk(kChunk, 'x');
+    WriteBehind::Buffer* buffer = nullptr;
+    const auto flush = [&] {
+        if (buffer) {
+            pending.add();
+            writer->submit(fd, direct_fd, buffer, [&pending](bool ok) { pending.done(ok); });
+            buffer = nullptr;
+        }
+    };
+
+    for (off_t at = first; at < last;) {
+        const auto length = static_cast<std::size_t>(std::min<off_t>(kChunk, last - at));
+        std::size_t done = 0;
+        while (done < length) {
+            if (!writer) {
+                if (!writeAll(fd, chunk.data() + done, length - done, at)) {
+                    failed = true;
+                }
+                done = length;
+                break;
+            }
+            if (!buffer) {
+                buffer = writer->tryAcquire(at);
+                if (!buffer) {
+                    if (!writeAll(fd, chunk.data() + done, length - done, at)) {
+                        failed = true;
+                    }
+                    done = length;
+                    break;
+                }
+            }
+            const std::size_t n = std::min(length - done, buffer->room());
+            std::memcpy(buffer->data + buffer->end, chunk.data() + done, n);
+            buffer->end += n;
+            done += n;
+            if (buffer->room() == 0) {
+                flush();
+            }
+        }
+        at += static_cast<off_t>(length);
+    }
+    flush();
+
+    double expected = producer_cpu.load();
+    const double used = threadCpuSeconds();
+    while (!producer_cpu.compare_exchange_weak(expected, expected + used)) {
+    }
+}
+
+void runCase(const Config& config, const char* name, bool use_writer, WriteBehind::Backend backend) {
+    ::unlink(config.path.c_str());
+    const int fd = ::open(config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(config.total)) != 0) {
+        fmt::print(stderr, "cannot create {}\n", config.path);
+        return;
+    }
+    const int direct_fd =
+        (use_writer && config.direct_io) ? ::open(config.path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC) : -1;
+
+    std::unique_ptr<WriteBehind> writer;
+    if (use_writer) {
+        writer = std::make_unique<WriteBehind>(1024 * 1024, 64 * 1024 * 1024, 1, backend);
+        if (writer->backend() != backend) {
+            fmt::print("{:<10} io_uring not available, skipped\n", name);
+            ::close(fd);
+            return;
+        }
+        writer->attachFile(fd);
+        writer->attachFile(direct_fd);
+    }
+
+    Pending pending;
+    std::atomic<double> producer_cpu{0};
+    std::atomic<bool> failed{false};
+    const double cpu_before = processCpuSeconds();
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    const auto slice = static_cast<off_t>(config.total / static_cast<std::size_t>(config.streams));
+    for (int i = 0; i < config.streams; ++i) {
+        const off_t first = slice * i;
+        const off_t last = i + 1 == config.streams ? static_cast<off_t>(config.total) : first + slice;
+        threads.emplace_back(produce, writer.get(), fd, direct_fd, first, last, std::ref(pending),
+                             std::ref(producer_cpu), std::ref(failed));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const bool ok = pending.wait() && !failed;
+    ::fdatasync(fd);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double cpu = processCpuSeconds() - cpu_before;
+    if (writer) {
+        writer->detachFile(direct_fd);
+        writer->detachFile(fd);
+    }
+    writer.reset();
+    if (direct_fd >= 0) {
+        ::close(direct_fd);
+    }
+    ::close(fd);
+    ::unlink(config.path.c_str());
+
+    const double mib = static_cast<double>(config.total) / (1024.0 * 1024.0);
+    fmt::print("{:<10} {:>8.2f} s {:>9.1f} MiB/s   network threads cpu {:>6.2f} s   process cpu {:>6.2f} s{}\n",
+               name, seconds, mib / seconds, producer_cpu.load(), cpu, ok ? "" : "   (write errors)");
+}
+
+void printUsage(const char* program) {
+    fmt::print(stderr,
+               "Usage: {} [-f <file>] [-s <MiB>] [-n <streams>] [--direct-io]\n"
+               "  -f <file>     Scratch file (default: mdown-write-bench.tmp in the current directory)\n"
+               "  -s <MiB>      Total bytes to write (default: 1024)\n"
+               "  -n <streams>  Concurrent writers, one per simulated connection (default: 8)\n"
+               "  --direct-io   Let the write-behind cases use O_DIRECT for aligned parts\n",
+               program);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--direct-io") {
+            config.direct_io = true;
+        } else if ((option == "-f" || option == "-s" || option == "-n") && i + 1 < argc) {
+            const std::string value = argv[++i];
+            if (option == "-f") {
+                config.path = value;
+            } else if (option == "-s") {
+                config.total = std::stoull(value) * 1024 * 1024;
+            } else {
+                config.streams = std::max(1, std::stoi(value));
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    fmt::print("writing {} MiB with {} streams{}\n", config.total / (1024 * 1024), config.streams,
+               config.direct_io ? ", O_DIRECT" : "");
+    runCase(config, "pwrite", false, WriteBehind::Backend::Pwrite);
+    runCase(config, "behind", true, WriteBehind::Backend::Pwrite);
+    runCase(config, "io_uring", true, WriteBehind::Backend::IoUring);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "download_options.hpp"
+#include "progress.hpp"
+#include "sink.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+
+namespace downloader {
+
+// 嵌入到其他程序时使用的异步接口: 一个 Client 持有事件循环线程和连接池, submit 立即返回,
+// 下载在后台进行, 结果通过回调或 future 取得. 数据默认写进内存, 小对象全程不碰文件系统
+struct ClientOptions {
+    int event_loops{1};          // 事件循环线程数
+    int max_active{64};          // 同时进行的下载数, 其余按提交顺序排队
+    std::size_t idle_handles{64};   // 连接池中保留的空闲 easy 句柄(连同它们的连接)
+    std::size_t pool_idle_bytes{64 * 1024 * 1024};   // MemorySink 用的缓冲池最多保留的空闲内存
+    std::chrono::milliseconds progress_interval{200};   // on_progress 的调用间隔
+    // 不为空时写文件(destination)的下载使用这个目录下的本地缓存, 同 mdown --cache-dir; 目录建不起来时构造函数抛出
+    // std::runtime_error
+    std::string cache_dir;
+};
+
+struct DownloadResult {
+    std::string url;
+    bool ok{false};
+    bool cancelled{false};
+    std::string error;
+    std::uint64_t bytes{0};
+    double seconds{0.0};          // 从开始下载(不含排队)到结束
+    std::shared_ptr<Sink> sink;   // 数据所在的 sink, 没有指定 sink 和 destination 时是 MemorySink
+};
+
+struct DownloadRequest {
+    std::string url;
+    // 为空时: destination 也为空则写进 Client 缓冲池上的 MemorySink, 否则写文件 destination
+    // (这时和命令行一样使用断点日志和 options 中的文件选项)
+    std::shared_ptr<Sink> sink;
+    std::string destination;
+    DownloadOptions options;   // options.sink 和 options.stream_fd 不起作用
+    // 下载进行中按 ClientOptions::progress_interval 在 Client 的监视线程上调用
+    std::function<void(const ProgressSnapshot&)> on_progress;
+    // 结束(成功、失败或取消)时调用一次, 之后 future 才就绪. 可能在事件循环线程、调用 cancel 的线程
+    // 或提交的线程上调用, 不要在里面阻塞或等待其他下载
+    std::function<void(const DownloadResult&)> on_complete;
+};
+
+// submit 返回的句柄, 可以复制, 在 Client 销毁后仍可读取结果
+class DownloadHandle {
+public:
+    DownloadHandle() = default;
+
+    [[nodiscard]] bool valid() const { return static_cast<bool>(state_); }
+    // 排队中的下载直接以取消结束, 进行中的在下一次回调时中止. 已经结束的不受影响
+    void cancel() const;
+    [[nodiscard]] ProgressSnapshot progress() const;
+    [[nodiscard]] std::shared_future<DownloadResult> future() const;
+    // 等到下载结束
+    const DownloadResult& wait() const;
+
+private:
+    friend class Client;
+    struct State;
+
+    explicit DownloadHandle(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<State> state_;
+};
+
+class Client {
+public:
+    explicit Client(ClientOptions options = {});
+    // 取消所有未结束的下载并等它们结束
+    ~Client();
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    // 线程安全, 可以在回调中调用
+    DownloadHandle submit(DownloadRequest request);
+    void cancelAll();
+    // 等到目前提交的下载全部结束, 不能在回调中调用
+    void waitAll();
+
+    [[nodiscard]] const std::shared_ptr<BufferPool>& bufferPool() const;
+
+private:
+    friend class DownloadHandle;
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace downloader
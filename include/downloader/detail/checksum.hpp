@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace downloader::detail {
+
+class ChecksumState;
+
+// 流式摘要: 数据按文件顺序分多次喂进来, 最后得到十六进制摘要.
+// sha256 用 OpenSSL, crc32c 在支持 SSE4.2 的 CPU 上用硬件指令, xxh3 需要编译时找到 xxhash.h
+class Checksum {
+public:
+    enum class Algorithm {
+        Sha256,
+        Crc32c,
+        Xxh3,
+    };
+
+    struct Spec {
+        Algorithm algorithm;
+        std::string expected;   // 小写十六进制
+    };
+
+    // 解析 "sha256:<hex>" 这样的写法, 格式不对或算法没有编译进来时返回空并写入 error
+    static std::optional<Spec> parse(const std::string& text, std::string* error = nullptr);
+    static const char* name(Algorithm algorithm);
+
+    explicit Checksum(Algorithm algorithm);
+    ~Checksum();
+
+    Checksum(const Checksum&) = delete;
+    Checksum& operator=(const Checksum&) = delete;
+
+    void update(const char* data, std::size_t length);
+    // 结束计算并返回十六进制摘要, 之后需要 reset 才能重新使用
+    std::string hexDigest();
+    void reset();
+
+    [[nodiscard]] Algorithm algorithm() const { return algorithm_; }
+
+private:
+    const Algorithm algorithm_;
+    std::unique_ptr<ChecksumState> state_;
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace downloader::detail {
+
+// 按需分配下载区间的调度器.
+// 未分配的部分按剩余量切成逐渐变小的分片; 分完以后, 空闲的连接会窃取预计最晚完成的
+// 分片的后半段; 再也切不动时(endgame), 对最慢的分片剩余部分并行发起一次重复请求.
+class ChunkScheduler {
+public:
+    struct Options {
+        curl_off_t min_chunk_size{512 * 1024};
+        curl_off_t max_chunk_size{32 * 1024 * 1024};
+        int worker_count{1};
+        bool endgame{true};
+    };
+
+    struct Chunk;
+    using Range = std::pair<curl_off_t, curl_off_t>;   // [first, second)
+
+    // 一个连接当前负责的工作: 从 from 开始请求, 写到分片的 end 为止(end 可能被窃取方缩短)
+    struct Lease {
+        Chunk* chunk{nullptr};
+        curl_off_t from{0};
+        curl_off_t to{0};
+        curl_off_t cursor{0};
+        bool duplicate{false};
+    };
+
+    // completed 为已经写好的区间(断点续传), 这些部分不会再分配
+    ChunkScheduler(curl_off_t total, Options options, const std::vector<Range>& completed = {});
+    ~ChunkScheduler();
+
+    ChunkScheduler(const ChunkScheduler&) = delete;
+    ChunkScheduler& operator=(const ChunkScheduler&) = delete;
+
+    // 领取下一段工作, 没有可做的工作时返回 false
+    bool acquire(Lease& lease);
+    // 写入前预留: 返回从 lease.cursor 开始允许写入的字节数, 0 表示该分片已结束或已被截断
+    std::size_t reserve(Lease& lease, std::size_t length);
+    // 写入后提交: 推进 lease.cursor, 返回新增的有效字节数(重复请求写入的重叠部分不重复计数)
+    curl_off_t commit(Lease& lease, std::size_t written);
+    // 归还工作, 返回该分片是否已经完整写入
+    bool release(Lease& lease);
+    // 该工作是否已经不需要继续(分片已完成, 或已被窃取截断到光标处)
+    [[nodiscard]] bool finished(const Lease& lease) const;
+    // 传输失败后从已写入的位置继续同一段工作(不重复下载已写入的部分).
+    // 重复请求不续传, 返回 false
+    bool resume(Lease& lease);
+
+    // 停止分配新工作, 进行中的连接不受影响
+    void cancel();
+    [[nodiscard]] bool complete() const;
+    // 构造时传入的已完成字节数
+    [[nodiscard]] curl_off_t resumedBytes() const { return resumed_bytes_; }
+    // 当前已写入的所有区间(已合并), 用于写断点日志
+    [[nodiscard]] std::vector<Range> writtenRanges() const;
+
+private:
+    Chunk& addChunk(curl_off_t start, curl_off_t end);
+    bool trySteal(Lease& lease);
+    bool tryEndgame(Lease& lease);
+    void assignPrimary(Chunk& chunk, curl_off_t from, Lease& lease);
+
+    const curl_off_t total_;
+    const Options options_;
+
+    // 保护分配与窃取; 写入路径只使用每个分片自己的锁
+    mutable std::mutex mutex_;
+    std::deque<std::unique_ptr<Chunk>> chunks_;
+    std::deque<Range> unassigned_;
+    curl_off_t unassigned_bytes_{0};
+    std::vector<Range> completed_;
+    curl_off_t resumed_bytes_{0};
+    bool cancelled_{false};
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace downloader::detail {
+
+// -t auto: 按主机自动调整每个任务的连接数.
+// 从少量连接开始(先逐级翻倍), 每个统计窗口比较该主机所有任务的总吞吐: 比上一级明显提高就继续加连接,
+// 不再提高(或单连接速度明显下降)就退回上一级并保持一段时间后再试探; 收到 429/503 时减半.
+// 调好的级别在整个运行期间按主机保留, 后来的同主机任务直接从这个级别开始.
+class ConcurrencyTuner {
+public:
+    struct Host;
+
+    explicit ConcurrencyTuner(int initial_level = 2, int max_level = 64);
+    ~ConcurrencyTuner();
+
+    ConcurrencyTuner(const ConcurrencyTuner&) = delete;
+    ConcurrencyTuner& operator=(const ConcurrencyTuner&) = delete;
+
+    // 返回的引用在 tuner 的生命周期内有效
+    Host& host(const std::string& key);
+
+    [[nodiscard]] int target(const Host& host) const;
+    [[nodiscard]] int maxLevel() const { return max_level_; }
+
+    // 热路径: 只做 relaxed 原子操作
+    void addBytes(Host& host, std::uint64_t bytes);
+    void connectionOpened(Host& host);
+    void connectionClosed(Host& host);
+
+    // 由传输线程定期调用, 窗口未到或其他线程正在调整时立即返回
+    void maybeAdjust(Host& host);
+    // 服务器返回 429/503
+    void onThrottled(Host& host);
+
+private:
+    const int initial_level_;
+    const int max_level_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<Host>> hosts_;
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace downloader::detail {
+
+// 所有任务共享的连接名额: 全局上限与每个主机的上限(0 表示不限制).
+// 排队中的任务优先拿到名额(每个任务至少一个连接), 剩余的名额再分给正在下载的任务扩充连接.
+class ConnectionBudget {
+public:
+    ConnectionBudget(int max_total, int max_per_host);
+
+    ConnectionBudget(const ConnectionBudget&) = delete;
+    ConnectionBudget& operator=(const ConnectionBudget&) = delete;
+
+    // 管理器: 任务进入等待队列
+    void enqueue(const std::string& host);
+    // 管理器: 为排队中的任务预留首个连接, 成功后该任务出队
+    bool tryReserve(const std::string& host);
+    // 管理器: 受任务数上限约束, 眼下还能启动几个任务(负数表示不限).
+    // 排队任务中只有这么多会被留出名额, 预读进来但暂时启动不了的任务不挤占扩充连接
+    void setStartableTasks(int count);
+
+    // 任务开始时领取首个连接: 优先使用预留的名额, 没有预留时(直接调用 start)不受上限约束
+    void acquireInitial(const std::string& host);
+    // 任务扩充连接, 不超过上限, 并给排队中还能启动的任务留出名额
+    bool tryAcquire(const std::string& host);
+    void release(const std::string& host, int count = 1);
+
+    // 等待有名额被释放(或 wake), 最多等 timeout
+    void waitForRelease(std::chrono::milliseconds timeout);
+    // 不释放名额, 只唤醒 waitForRelease, 例如任务结束时通知管理器
+    void wake();
+
+    [[nodiscard]] int inUse() const;
+    [[nodiscard]] int maxTotal() const { return max_total_; }
+
+private:
+    struct HostState {
+        int used{0};       // 包含已预留但任务还没领取的名额
+        int reserved{0};
+        int queued{0};
+    };
+
+    [[nodiscard]] int startableQueuedLocked() const;
+    [[nodiscard]] int startableQueuedLocked(const HostState& state) const;
+
+    const int max_total_;
+    const int max_per_host_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    std::uint64_t release_generation_{0};
+    int used_{0};
+    int startable_tasks_{-1};
+    std::unordered_map<std::string, HostState> hosts_;
+};
+
+} // namespace downloader::detail
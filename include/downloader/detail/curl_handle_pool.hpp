@@ -0,0 +1,81 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace downloader::detail {
+
+class CurlHandlePool;
+
+// 归还到池中(有池时)或直接释放的 easy 句柄
+struct EasyHandleDeleter {
+    std::shared_ptr<CurlHandlePool> pool;
+    std::string host;
+    void operator()(CURL* easy) const;
+};
+using EasyHandle = std::unique_ptr<CURL, EasyHandleDeleter>;
+
+// pool 为空时新建一个不复用的句柄, 失败时返回空
+EasyHandle acquireEasy(const std::shared_ptr<CurlHandlePool>& pool, const std::string& host);
+
+// 所有任务共享的 easy 句柄池. 句柄归还时 curl_easy_reset, 它自己的连接缓存仍然保留,
+// 下次优先借给同一主机, 从而复用上一次的连接(包括探测请求的连接);
+// DNS 缓存和 TLS 会话通过 CURLSH 在所有句柄间共享.
+class CurlHandlePool {
+public:
+    struct Stats {
+        std::uint64_t handles_created{0};
+        std::uint64_t handles_reused{0};
+        std::uint64_t connections_new{0};
+        std::uint64_t connections_reused{0};
+    };
+
+    explicit CurlHandlePool(std::size_t max_idle = 64);
+    ~CurlHandlePool();
+
+    CurlHandlePool(const CurlHandlePool&) = delete;
+    CurlHandlePool& operator=(const CurlHandlePool&) = delete;
+
+    // 借出一个已设置共享对象的句柄, 失败时返回 nullptr
+    CURL* acquire(const std::string& host);
+    void release(CURL* easy, const std::string& host);
+
+    // 一次传输结束后记录它是新建连接还是复用了已有连接
+    void recordTransfer(CURL* easy);
+    [[nodiscard]] Stats stats() const;
+
+    // 已经协商到 HTTP/2 的主机. libcurl 8.0 之前 PRIOR_KNOWLEDGE 请求复用 h2c 连接会出错,
+    // 而且出错后这个连接对之后的请求都不可用, 所以已知是 HTTP/2 的主机不再用 PRIOR_KNOWLEDGE
+    [[nodiscard]] bool isHttp2Host(const std::string& host) const;
+    // 请求完成后 CURLINFO_HTTP_VERSION 报告 HTTP/2 时登记
+    void recordHttp2(const std::string& host);
+
+private:
+    static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr);
+    static void unlockShare(CURL*, curl_lock_data data, void* userptr);
+
+    const std::size_t max_idle_;
+    CURLSH* share_;
+    std::mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<CURL*>> idle_;   // 按上次访问的主机分组
+    std::size_t idle_count_{0};
+    std::unordered_set<std::string> http2_hosts_;
+
+    std::atomic<std::uint64_t> handles_created_{0};
+    std::atomic<std::uint64_t> handles_reused_{0};
+    std::atomic<std::uint64_t> connections_new_{0};
+    std::atomic<std::uint64_t> connections_reused_{0};
+};
+
+} // namespace downloader::detail
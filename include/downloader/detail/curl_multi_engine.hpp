@@ -0,0 +1,46 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace downloader::detail {
+
+// 事件驱动的传输引擎: 少量事件循环线程通过 curl_multi 驱动所有任务的所有传输,
+// 取代"每个分片一个阻塞线程"的模式.
+class CurlMultiEngine {
+public:
+    // 传输结束(成功/失败/引擎关闭)时在事件循环线程上调用, 调用时 easy 句柄已从 multi 中移除
+    using Completion = std::function<void(CURL* easy, CURLcode result)>;
+
+    explicit CurlMultiEngine(int loop_count = 1);
+    ~CurlMultiEngine();
+
+    CurlMultiEngine(const CurlMultiEngine&) = delete;
+    CurlMultiEngine& operator=(const CurlMultiEngine&) = delete;
+
+    // 线程安全, 可以在完成回调中再次提交. easy 句柄的所有权仍归调用方.
+    // delay 大于 0 时延迟开始(用于重试退避), 不占用事件循环线程
+    void submit(CURL* easy, Completion on_done,
+                std::chrono::milliseconds delay = std::chrono::milliseconds{0});
+
+    // 写回调返回 CURL_WRITEFUNC_PAUSE 暂停的传输, 在 delay 后于它所在的事件循环线程上恢复(限速用).
+    // 只能对已提交且尚未结束的句柄调用
+    void resumeAfter(CURL* easy, std::chrono::nanoseconds delay);
+
+    [[nodiscard]] std::size_t activeTransfers() const;
+    [[nodiscard]] int loopCount() const { return static_cast<int>(loops_.size()); }
+
+private:
+    class Loop;
+
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::atomic<std::size_t> next_loop_{0};
+};
+
+} // namespace downloader::detail
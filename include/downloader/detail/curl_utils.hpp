@@ -1,7 +1,28 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
 namespace downloader::detail {
 
 void ensureCurlInitialized();
 
-} // namespace downloader::detail
\ No newline at end of file
+// 在原始响应头中查找字段(不区分大小写), 有多个响应(重定向)时取最后一个, 找不到返回空
+std::string findHeader(std::string_view raw_headers, std::string_view name);
+
+// URL 的 "主机:端口"(小写), 用于按主机统计连接; 解析失败时返回 URL 本身
+std::string hostKey(const std::string& url);
+
+// Content-Range 字段值 "bytes first-last/total", total 为 "*" 时记为 -1
+struct ContentRange {
+    std::int64_t first{0};
+    std::int64_t last{0};
+    std::int64_t total{-1};
+};
+
+// 格式不对(包括 "bytes */total" 这种 416 响应)时返回空
+std::optional<ContentRange> parseContentRange(std::string_view value);
+
+} // namespace downloader::detail
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace downloader::detail {
+
+// 按 URL 索引的本地缓存, 目录结构:
+//   <dir>/index/<sha256(url)>   该 URL 上次完整下载时的 ETag/Last-Modified、大小、内容的 sha256
+//                               以及对象存入时的 inode 和修改时间
+//   <dir>/objects/<sha256>      内容本身(只读), 按摘要存放, 不同 URL 的相同内容只存一份
+// 下载前用索引中的校验信息发条件请求, 服务器返回 304 时直接把对象放到目标位置.
+// 所有文件都先写临时文件再 rename, 多个任务(或多个进程)可以同时使用同一个目录
+class DownloadCache {
+public:
+    struct Entry {
+        std::string etag;
+        std::string last_modified;
+        std::uint64_t size{0};
+        std::string sha256;   // 小写十六进制
+
+        // 没有 ETag 也没有 Last-Modified 时无法发条件请求, 不值得记录
+        [[nodiscard]] bool usable() const { return !etag.empty() || !last_modified.empty(); }
+    };
+
+    explicit DownloadCache(std::string directory);
+
+    // 创建目录, 失败时写 error 并返回 false
+    bool open(std::string& error) const;
+
+    // 索引存在、对象也在且大小一致时返回记录; 对象的 inode 或修改时间与记录不符时删掉对象
+    [[nodiscard]] std::optional<Entry> lookup(const std::string& url) const;
+    // 把对象放到 destination, 替换已有文件: 优先 reflink, 不行就复制. 不用硬链接, 改目标文件不影响缓存
+    bool materialize(const Entry& entry, const std::string& destination, std::string& error) const;
+    // 把刚下载完的 source 记为 url 的内容; 相同摘要的对象已经存在时只更新索引
+    bool store(const std::string& url, const Entry& entry, const std::string& source) const;
+
+    [[nodiscard]] const std::string& directory() const { return directory_; }
+
+private:
+    [[nodiscard]] std::string indexPath(const std::string& url) const;
+    [[nodiscard]] std::string objectPath(const std::string& sha256) const;
+
+    const std::string directory_;
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace downloader::detail {
+
+// 直接用系统调用驱动的最小 io_uring 封装, 只支持写文件(不依赖 liburing).
+// 提交队列和完成队列都只由一个线程操作; 注册文件表的更新可以在其他线程进行.
+class IoUring {
+public:
+    struct Completion {
+        std::uint64_t user_data;
+        int result;   // 写入的字节数, 失败时为 -errno
+    };
+
+    // 内核或头文件不支持时返回空
+    static std::unique_ptr<IoUring> create(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // 把固定的一组缓冲区注册给内核, 之后可以用 buf_index 提交, 省掉每次的页锁定. 受 RLIMIT_MEMLOCK 限制, 失败返回 false
+    bool registerBuffers(const std::vector<iovec>& buffers);
+    // 注册一个空的文件表, 之后用 updateFile 填入 fd
+    bool registerFileTable(unsigned slots);
+    // fd 为 -1 表示清空该槽位
+    bool updateFile(unsigned slot, int fd);
+
+    [[nodiscard]] unsigned capacity() const { return sq_entries_; }
+    [[nodiscard]] unsigned pending() const { return unsubmitted_; }
+
+    // 准备一个 pwrite, 提交队列满时返回 false. fixed_file 时 fd 是文件表槽位, buf_index < 0 表示不用注册缓冲区
+    bool prepareWrite(int fd, bool fixed_file, const char* data, std::size_t length, std::uint64_t offset,
+                      int buf_index, std::uint64_t user_data);
+    // 提交已准备的请求, 并至少等到 wait_for 个完成. 返回 false 表示 io_uring_enter 出错
+    bool submit(unsigned wait_for);
+    // 取一个已完成的请求, 没有时返回 false
+    bool popCompletion(Completion& out);
+
+private:
+    IoUring() = default;
+
+    int fd_{-1};
+    void* sq_ring_{nullptr};
+    std::size_t sq_ring_size_{0};
+    void* cq_ring_{nullptr};
+    std::size_t cq_ring_size_{0};
+    void* sqes_{nullptr};
+    std::size_t sqes_size_{0};
+
+    unsigned sq_entries_{0};
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_mask_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned* cq_mask_{nullptr};
+    void* cqes_{nullptr};
+
+    unsigned unsubmitted_{0};
+};
+
+} // namespace downloader::detail
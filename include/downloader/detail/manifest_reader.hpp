@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace downloader::detail {
+
+// 逐行读取下载清单, 不会把整个清单读进内存. 每行:
+//   <url> <目标文件> [key=value ...]
+// 字段之间用空白分隔, 空行和 # 开头的行忽略. key=value 的含义由调用方解释
+class ManifestReader {
+public:
+    struct Entry {
+        std::size_t line{0};
+        std::string url;
+        std::string destination;
+        std::vector<std::pair<std::string, std::string>> attributes;
+    };
+
+    explicit ManifestReader(std::istream& input) : input_(input) {}
+
+    // 返回下一条记录, 读完时返回空. 格式不对的行也返回记录(带行号), 原因写入 error, 正常时 error 为空
+    std::optional<Entry> next(std::string& error);
+
+private:
+    std::istream& input_;
+    std::size_t line_{0};
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace downloader::detail {
+
+// 把乱序到达的分片数据按文件顺序写到不能 seek 的输出(管道、标准输出).
+// 正好接在已输出位置后面的数据直接写出, 并带出缓冲区里随之接上的部分; 其余数据整块落在
+// [已输出位置, 已输出位置 + window) 之内时拷贝进缓冲区, 否则不接收, 由调用方暂停这个连接.
+// 这样被限流的总是离已输出位置最远的分片, 缓冲区最多占用 window 字节.
+class OrderedStream {
+public:
+    // 每段数据按顺序写出后调用, 参数为数据、长度和它在文件中的偏移
+    using Observer = std::function<void(const char*, std::size_t, curl_off_t)>;
+
+    OrderedStream(int fd, std::size_t window, Observer on_emit = {});
+
+    OrderedStream(const OrderedStream&) = delete;
+    OrderedStream& operator=(const OrderedStream&) = delete;
+
+    // [offset, offset + length) 现在能否被 push 接收. 已输出位置只会前进, 返回 true 之后一直成立
+    [[nodiscard]] bool hasRoom(curl_off_t offset, std::size_t length) const;
+    // 等到 hasRoom 成立、输出失败或超时, 返回 hasRoom 的结果
+    bool waitForRoom(curl_off_t offset, std::size_t length, std::chrono::milliseconds timeout);
+
+    // 接收一段数据, 要么全部接收要么不接收(返回 false). 除了已经输出过的部分, 各段不能互相重叠.
+    // 写输出失败后一直返回 false
+    bool push(const char* data, std::size_t length, curl_off_t offset);
+
+    [[nodiscard]] curl_off_t emitted() const;
+    [[nodiscard]] std::size_t buffered() const;
+    [[nodiscard]] bool failed() const;
+
+private:
+    bool hasRoomLocked(curl_off_t offset, std::size_t length) const;
+    bool emitLocked(const char* data, std::size_t length);
+
+    const int fd_;
+    const std::size_t window_;
+    const Observer on_emit_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable room_cv_;
+    curl_off_t emitted_{0};
+    std::size_t buffered_{0};
+    bool failed_{false};
+    std::map<curl_off_t, std::string> pending_;   // 起点 -> 数据, 都在已输出位置之后
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace downloader::detail {
+
+// 令牌桶限速(按 GCRA 实现): 用一个原子的"理论到达时间"代替令牌计数, 预约额度只需一次 CAS, 不加锁.
+// 所有连接按到达顺序排队领取额度, 接收得多的连接等得也多, 带宽在连接之间大致平均分配;
+// 空闲时最多攒下 burst 时长的额度.
+class RateLimiter {
+public:
+    explicit RateLimiter(std::uint64_t bytes_per_second,
+                         std::chrono::nanoseconds burst = std::chrono::milliseconds(100));
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // 预约 bytes 字节的额度, 返回还要等多久才应该接收这些数据(0 表示立即)
+    std::chrono::nanoseconds acquire(std::uint64_t bytes);
+
+    [[nodiscard]] std::uint64_t rate() const { return bytes_per_second_; }
+
+private:
+    const std::uint64_t bytes_per_second_;
+    const std::int64_t burst_ns_;
+    std::atomic<std::int64_t> tat_ns_{0};
+};
+
+} // namespace downloader::detail
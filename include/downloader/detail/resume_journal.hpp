@@ -0,0 +1,44 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace downloader::detail {
+
+// 断点续传日志, 保存在 <destination>.mdown.
+// 记录服务器的校验信息(ETag/Last-Modified/大小)和已经落盘的字节区间;
+// 重新下载时只有校验信息完全一致才复用这些区间.
+class ResumeJournal {
+public:
+    using Range = std::pair<curl_off_t, curl_off_t>;   // [first, second)
+
+    struct Validators {
+        curl_off_t size{0};
+        std::string etag;
+        std::string last_modified;
+
+        // 没有 ETag 也没有 Last-Modified 时无法判断内容是否变化, 不允许续传
+        [[nodiscard]] bool usable() const { return size > 0 && (!etag.empty() || !last_modified.empty()); }
+        [[nodiscard]] bool operator==(const Validators& other) const {
+            return size == other.size && etag == other.etag && last_modified == other.last_modified;
+        }
+    };
+
+    explicit ResumeJournal(const std::string& destination);
+
+    // 读取已有日志; url 或校验信息不一致、日志损坏时返回空
+    [[nodiscard]] std::vector<Range> load(const std::string& url, const Validators& current) const;
+    // 先写临时文件再 rename, 保证日志本身不会写坏
+    bool save(const std::string& url, const Validators& validators, const std::vector<Range>& ranges) const;
+    void remove() const;
+
+    [[nodiscard]] const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+} // namespace downloader::detail
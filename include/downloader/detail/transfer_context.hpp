@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+
+namespace downloader::detail {
+
+class ConcurrencyTuner;
+class ConnectionBudget;
+class CurlHandlePool;
+class CurlMultiEngine;
+class DownloadCache;
+class RateLimiter;
+class TransferMetrics;
+class WriteBehind;
+
+// 同一批任务共享的资源, 由调用方创建后交给 DownloadManager 和每个任务. 成员为空表示不使用
+struct TransferContext {
+    std::shared_ptr<CurlMultiEngine> engine;    // 为空时每个连接一个阻塞线程
+    std::shared_ptr<ConnectionBudget> budget;   // 为空时不限制连接数
+    std::shared_ptr<CurlHandlePool> handles;    // 为空时每次新建 easy 句柄, 不复用连接
+    std::shared_ptr<ConcurrencyTuner> tuner;    // thread_count 为 0 (自动) 的任务按主机共享调好的级别
+    std::shared_ptr<RateLimiter> rate_limiter;  // 所有任务共享的总带宽上限, 为空时不限速
+    std::shared_ptr<WriteBehind> writer;        // 分片数据先进缓冲区由写线程落盘, 为空时在网络线程上直接 pwrite
+    std::shared_ptr<TransferMetrics> metrics;   // 每次请求结束时记录耗时分解和速率, 为空时不统计
+    std::shared_ptr<DownloadCache> cache;       // 按 URL 的本地缓存, 发条件请求, 为空时不使用
+};
+
+} // namespace downloader::detail
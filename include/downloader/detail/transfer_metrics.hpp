@@ -0,0 +1,109 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace downloader::detail {
+
+// 固定桶的直方图, 桶上界按升序排列, 最后一个桶是 +Inf
+class Histogram {
+public:
+    explicit Histogram(const std::vector<double>& bounds) : bounds_(&bounds), counts_(bounds.size() + 1, 0) {}
+
+    void observe(double value);
+    // 在桶内线性插值估算分位数, 没有数据时返回 0
+    [[nodiscard]] double quantile(double q) const;
+
+    [[nodiscard]] const std::vector<double>& bounds() const { return *bounds_; }
+    [[nodiscard]] const std::vector<std::uint64_t>& counts() const { return counts_; }
+    [[nodiscard]] std::uint64_t count() const { return count_; }
+    [[nodiscard]] double sum() const { return sum_; }
+
+private:
+    const std::vector<double>* bounds_;
+    std::vector<std::uint64_t> counts_;   // 各桶自己的计数(非累计)
+    std::uint64_t count_{0};
+    double sum_{0.0};
+};
+
+// 按主机汇总每次 HTTP 传输的耗时分解(DNS、建连、TLS、首字节、传输)、字节数、速率和重试,
+// 供 MetricsExporter 定期写成 JSON 或以 Prometheus 文本格式提供. 每次传输结束记录一次, 加锁开销可以忽略
+class TransferMetrics {
+public:
+    enum Phase {
+        Dns,
+        Connect,
+        Tls,
+        Ttfb,       // 请求发出到收到第一个字节, 即服务器的等待时间
+        Transfer,   // 第一个字节到传输结束
+        Total,
+        PhaseCount,
+    };
+
+    TransferMetrics() = default;
+
+    // 传输结束时调用, ok 为 false 表示这次请求失败(之后可能重试)
+    void record(const std::string& host, CURL* easy, bool ok);
+    void recordRetry(const std::string& host);
+
+    [[nodiscard]] std::string toJson() const;
+    [[nodiscard]] std::string toPrometheus() const;
+
+private:
+    struct HostMetrics {
+        HostMetrics();
+
+        std::uint64_t transfers{0};
+        std::uint64_t errors{0};
+        std::uint64_t retries{0};
+        std::uint64_t new_connections{0};
+        std::uint64_t bytes{0};
+        std::vector<Histogram> phases;
+        Histogram transfer_bytes;
+        Histogram speed;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, HostMetrics> hosts_;
+};
+
+// 后台线程: 每隔 interval 把指标原子地写入 JSON 文件(先写临时文件再改名), 以及/或者在本机端口上
+// 响应 GET /metrics. 析构时停止线程, 有 JSON 文件时最后再写一次
+class MetricsExporter {
+public:
+    explicit MetricsExporter(std::shared_ptr<TransferMetrics> metrics);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // 监听 127.0.0.1:port, 失败时返回 false 并写入 error. 需要在 start 之前调用
+    bool listen(std::uint16_t port, std::string& error);
+    void writeFile(std::string path, std::chrono::milliseconds interval);
+    void start();
+
+private:
+    void run();
+    void serveClient(int fd) const;
+    void writeJson() const;
+
+    std::shared_ptr<TransferMetrics> metrics_;
+    int listen_fd_{-1};
+    std::string json_path_;
+    std::chrono::milliseconds interval_{1000};
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+} // namespace downloader::detail
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace downloader::detail {
+
+class IoUring;
+
+// 写入流水线: 网络线程把数据拷进预分配的大块对齐缓冲区, 写满(或不再连续)后交给专门的写线程
+// 用一次大的 pwrite 落盘, 网络线程不再为每 16KB 做一次系统调用. 缓冲区总量固定,
+// 用完时 tryAcquire 返回空, 调用方自己直接写(相当于反压).
+// 落盘方式有两种: 写线程逐个 pwrite, 或者由一个写线程把排队的缓冲区批量提交给 io_uring 异步完成.
+class WriteBehind {
+public:
+    static constexpr std::size_t kAlignment = 4096;
+
+    enum class Backend {
+        Pwrite,
+        IoUring,
+    };
+
+    // data[begin, end) 是有效数据, 对应文件中从 offset 开始的区间.
+    // begin 取 offset 对 kAlignment 的余数, 使内存地址与文件偏移同余, O_DIRECT 可以直接写中间对齐的部分
+    struct Buffer {
+        char* data{nullptr};
+        std::size_t capacity{0};
+        std::size_t begin{0};
+        std::size_t end{0};
+        curl_off_t offset{0};
+
+        [[nodiscard]] std::size_t size() const { return end - begin; }
+        [[nodiscard]] std::size_t room() const { return capacity - end; }
+        [[nodiscard]] curl_off_t endOffset() const { return offset + static_cast<curl_off_t>(size()); }
+    };
+
+    // 写完(或失败)后在写线程上调用, 此时缓冲区已经归还
+    using Completion = std::function<void(bool ok)>;
+
+    // 要求 IoUring 但内核不支持时退回 Pwrite, 用 backend() 查看实际使用的方式.
+    // IoUring 只用一个写线程, writer_threads 不起作用
+    WriteBehind(std::size_t buffer_size, std::size_t memory_budget, int writer_threads = 1,
+                Backend backend = Backend::Pwrite);
+    ~WriteBehind();
+
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind& operator=(const WriteBehind&) = delete;
+
+    // 借一个空缓冲区并定位到文件偏移 offset, 预算用完时返回 nullptr
+    Buffer* tryAcquire(curl_off_t offset);
+    // 不写入直接归还
+    void release(Buffer* buffer);
+    // 交给写线程. direct_fd >= 0 时对齐的部分用它(O_DIRECT)写, 其余部分和失败时退回 fd
+    void submit(int fd, int direct_fd, Buffer* buffer, Completion on_done);
+
+    // io_uring 后端把文件登记到注册文件表(满了就不登记), 提交时省掉每次查找 fd 的开销.
+    // detachFile 之前调用方要保证这个 fd 上已经没有未完成的写
+    void attachFile(int fd);
+    void detachFile(int fd);
+
+    [[nodiscard]] std::size_t bufferSize() const { return buffer_size_; }
+    [[nodiscard]] Backend backend() const { return ring_ ? Backend::IoUring : Backend::Pwrite; }
+
+private:
+    struct Job {
+        int fd;
+        int direct_fd;
+        Buffer* buffer;
+        Completion on_done;
+    };
+    struct InFlight;
+
+    void run();
+    void runRing();
+    std::size_t startRingJob(InFlight* op);
+    void finishRingWrite(InFlight* op, int result, int piece_index);
+    static bool writeBuffer(int fd, int direct_fd, const Buffer& buffer);
+
+    const std::size_t buffer_size_;
+    std::vector<Buffer> buffers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Buffer*> free_;
+    std::deque<Job> jobs_;
+    bool stopping_{false};
+    std::vector<std::thread> writers_;
+
+    std::unique_ptr<IoUring> ring_;
+    bool fixed_buffers_{false};
+    std::unordered_map<int, int> file_slots_;   // fd -> 注册文件表槽位, 受 mutex_ 保护
+    std::vector<int> free_slots_;
+};
+
+} // namespace downloader::detail
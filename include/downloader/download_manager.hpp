@@ -1,31 +1,154 @@
 #pragma once
 
 #include "download_task.hpp"
+#include "detail/curl_handle_pool.hpp"
+#include "detail/transfer_context.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
 #include <vector>
 
 namespace downloader {
 
+// 一个任务结束(成功或失败)时交给 ResultCallback 的结果
+struct TaskResult {
+    std::string url;
+    std::string filename;
+    bool ok{false};
+    std::string error;
+    std::uint64_t bytes{0};
+    double seconds{0.0};
+};
+
+// 按需提供的任务: 排队时只保存这些字段, make 在任务真正启动时才调用
+struct PendingTask {
+    std::string url;
+    std::string filename;
+    int priority{0};   // 越大越先启动
+    std::function<DownloadTaskPtr()> make;
+};
+
 class DownloadManager {
 public:
+    // 进度显示方式. Auto: 终端上任务行放得下时用 Full, 否则用 Compact; 输出不是终端时用 Plain
+    enum class ProgressMode {
+        Auto,
+        Full,      // 每个任务一行
+        Compact,   // 汇总行加最慢的 K 个任务
+        Plain,     // 不用光标控制, 定期输出 key=value 行, 任务结束时各输出一行
+        None,
+    };
+
+    // 返回下一个任务, 没有更多任务时返回空
+    using TaskSource = std::function<std::optional<PendingTask>()>;
+    using ResultCallback = std::function<void(const TaskResult&)>;
+
+    DownloadManager() = default;
+    // context.budget 不为空时任务排队启动: 只有拿到连接名额的任务才开始下载
+    explicit DownloadManager(detail::TransferContext context);
+
     void addTask(DownloadTaskPtr task);
+    // 清单模式: 从 source 边读边启动, 最多预读 kLookahead 个排队任务(优先级只在这个窗口内生效).
+    // 结束的任务交给结果回调后即释放, 内存只随同时进行的任务增长
+    void setTaskSource(TaskSource source);
+    void setResultCallback(ResultCallback callback);
+    // 同时进行的任务数上限, 0 表示不限制(仍受连接预算约束)
+    void setMaxActiveTasks(int count);
+    // top_k 是 Compact 模式下列出的任务数
+    void setProgressMode(ProgressMode mode, std::size_t top_k = 10);
+
     void start();
     void printError() const;
 
+    static constexpr std::size_t kLookahead = 1024;
+
 private:
+    struct TaskEntry {
+        DownloadTaskPtr task;   // 来自 TaskSource 的任务启动前为空
+        std::function<DownloadTaskPtr()> make;
+        std::string url;
+        std::string filename;
+        std::string host;
+        int priority{0};
+        bool started{false};
+        bool reported{false};
+        std::chrono::steady_clock::time_point started_at{};
+        // 每帧取样一次, 结束后保留最后一次的值
+        ProgressSnapshot progress{};
+        double rate{0.0};
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished = std::make_shared<std::atomic<bool>>(false);
+    };
+
+    void refillFromSource();
+    void enqueue(TaskEntry entry);
+    void launchPending();
+    bool launch(TaskEntry& entry);
+    void collectFinished();
+    void report(TaskEntry& entry, bool ok, std::string error);
+    void waitForChange(std::uint64_t seen_generation, std::chrono::milliseconds timeout);
+    void notifyChange();
     void renderProgressLoop();
-    std::string buildProgressPanel() const;
-    static std::string formatTaskLine(const Progress& progress);
+    void sampleProgress();
+    void renderFrame();
+    std::vector<std::string> buildProgressPanel(bool compact);
+    std::string buildPlainLine() const;
+    void updateRate(std::uint64_t downloaded);
+    static std::string formatTaskLine(const std::string& filename,
+                                      const ProgressSnapshot& progress,
+                                      const std::string& error_message);
+    static std::string formatPoolStats(const detail::CurlHandlePool::Stats& stats);
+    static std::string displayName(const std::string& filename);
     static std::string formatSize(std::uint64_t bytes);
+    static std::string formatDuration(double seconds);
     bool hasActiveTasks() const;
-    void redrawPanel(const std::string& panel, std::size_t& previous_lines);
+    void redrawPanel(const std::vector<std::string>& lines);
+
+    detail::TransferContext context_;
+    std::list<TaskEntry> tasks_;   // 排队中的任务按启动顺序排列
+    std::size_t queued_{0};
+    std::size_t running_{0};
+    int max_active_{0};
+
+    TaskSource source_;
+    bool source_done_{true};
+    ResultCallback on_result_;
+    std::size_t succeeded_{0};
+    std::size_t failed_{0};
+    std::size_t unreported_{0};
+
+    ProgressMode progress_mode_{ProgressMode::Auto};
+    ProgressMode active_mode_{ProgressMode::Auto};   // 本次运行实际使用的方式(Auto 已解析)
+    std::size_t top_k_{10};
+    std::vector<std::string> drawn_lines_;   // 终端上当前显示的面板, 重绘时只改变化的行
+    std::chrono::steady_clock::time_point run_started_at_{};
+    std::chrono::steady_clock::time_point progress_sampled_at_{};
+
+    // 没有连接预算时, 任务结束用它唤醒管理器
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::uint64_t wake_generation_{0};
+
+    // 汇总进度: 已结束任务的字节数累加在这里, 每帧只需要遍历进行中的任务
+    std::uint64_t finished_total_{0};
+    std::uint64_t finished_downloaded_{0};
+    std::uint64_t total_all_{0};
+    std::uint64_t downloaded_all_{0};
 
-    std::vector<std::thread> threads_;
-    std::vector<DownloadTaskPtr> tasks_;
+    // 面板上显示的总速率(指数平滑)
+    std::chrono::steady_clock::time_point rate_sampled_at_{};
+    std::uint64_t rate_sampled_bytes_{0};
+    double rate_{0.0};
 };
 
 } // namespace downloader
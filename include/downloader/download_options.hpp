@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace downloader {
+
+class Sink;
+
+// 请求使用的 HTTP 版本. 协商到 HTTP/2 且由事件循环驱动时, 同一主机的分片作为并行的流复用少数几个连接;
+// 协商不到时照常每个分片一个 HTTP/1.1 连接
+enum class HttpVersion {
+    Default,               // libcurl 默认: https 经 ALPN 协商 HTTP/2, http 用 HTTP/1.1
+    Http2,                 // 另外对 http 尝试 Upgrade: h2c
+    Http2PriorKnowledge,   // 明文直接说 HTTP/2 (h2c), 服务器必须支持
+};
+
+struct DownloadOptions {
+    int thread_count{8};                              // 每个任务的并发连接数, 0 表示按主机自动调整
+    std::uint64_t min_chunk_size{512 * 1024};         // 按需分配/窃取的最小分片
+    std::uint64_t max_chunk_size{32 * 1024 * 1024};   // 按需分配的最大分片
+    bool endgame{true};                               // 收尾阶段对最慢的分片并行重复请求
+    // 拆分策略: 每个分片连接至少分到 split_threshold 字节, 探测请求之后剩余部分不大于它时只再发一个请求;
+    // max_ranges 是单个文件同时进行的分片请求上限, 0 表示只受 thread_count 限制
+    std::uint64_t split_threshold{1024 * 1024};
+    int max_ranges{0};
+    bool resume{true};                                // 使用 <destination>.mdown 日志断点续传
+    std::uint64_t limit_rate{0};                      // 该任务的带宽上限(字节/秒), 0 表示不限
+    bool direct_io{false};                            // 有写入流水线时, 对齐的部分用 O_DIRECT 写
+    bool mmap_output{false};                          // 大小已知的分片下载直接写进目标文件的内存映射
+    std::string checksum;                             // "算法:十六进制摘要", 下载过程中计算并校验, 为空表示不校验
+    std::uint64_t expected_size{0};                   // 预期的文件大小(如来自清单), 与实际不符时任务失败, 0 表示不检查
+    std::vector<std::string> mirrors;                 // 与主 URL 内容相同的其他地址, 分片在各源之间按速度分配
+    HttpVersion http_version{HttpVersion::Default};
+    // 不小于 0 时不写目标文件, 而是把数据按顺序写到这个描述符(管道、标准输出, 不要求能 seek, 不会被关闭);
+    // 乱序到达的数据最多缓存 reorder_window 字节, 更靠后的分片暂停接收. 不写断点日志
+    int stream_fd{-1};
+    std::uint64_t reorder_window{64 * 1024 * 1024};
+    // 不为空时数据交给它(内存、调用方的缓冲区等), 不打开目标文件也不写断点日志, 优先于 stream_fd.
+    // 一个 sink 同一时间只能给一个任务用
+    std::shared_ptr<Sink> sink;
+
+    // 单个分片失败后的重试: 指数退避加抖动, 从已写入的位置续传
+    int max_retries{5};
+    std::uint64_t retry_base_delay_ms{500};
+    std::uint64_t retry_max_delay_ms{30'000};
+    long connect_timeout{30};                         // 秒
+    long low_speed_limit{1024};                       // 字节/秒, 低于此速度...
+    long low_speed_time{30};                          // ...持续这么多秒视为卡死, 0 关闭
+};
+
+} // namespace downloader
@@ -2,7 +2,9 @@
 
 #include "progress.hpp"
 
+#include <functional>
 #include <memory>
+#include <string>
 
 namespace downloader {
 
@@ -11,7 +13,24 @@ public:
     virtual ~DownloadTask() = default;
 
     virtual void start() = 0;
+    // 非阻塞启动, 结束时调用 on_finished. 返回 false 表示任务不支持异步执行,
+    // 调用方应改为在独立线程中调用 start()
+    virtual bool startAsync(std::function<void()> on_finished) {
+        (void)on_finished;
+        return false;
+    }
+    // 请求任务尽快结束(任何线程都可以调用, 可以在启动前调用), 任务以 "Cancelled" 错误结束.
+    // 不等待: 正在进行的传输在下一次进度或数据回调时中止, 结束照常通过 on_finished 或 start() 返回得知
+    virtual void cancel() {}
+    // 完整拷贝(含字符串), 适合偶尔调用; 周期性刷新请使用 snapshot()
     [[nodiscard]] virtual Progress getProgress() const = 0;
+    // 无锁读取计数器, 不拷贝任何字符串
+    [[nodiscard]] virtual ProgressSnapshot snapshot() const = 0;
+    // 任务创建后不再改变, 可以直接引用
+    [[nodiscard]] virtual const std::string& url() const = 0;
+    [[nodiscard]] virtual const std::string& filename() const = 0;
+    // 没有错误时返回空字符串
+    [[nodiscard]] virtual std::string errorMessage() const = 0;
     [[nodiscard]] virtual bool isRunning() const = 0;
     [[nodiscard]] virtual bool hasError() const = 0;
 };
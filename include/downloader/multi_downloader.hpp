@@ -1,20 +1,34 @@
 #pragma once
 
+#include "download_options.hpp"
 #include "download_task.hpp"
+#include "detail/transfer_context.hpp"
 
+#include <functional>
 #include <memory>
 #include <string>
 
 
 namespace downloader {
-    
+
     class MultiDownloader final : public DownloadTask {
     public:
-        MultiDownloader(std::string url, std::string destination, int thread_count = 8);
+        // context.engine 为空时每个分片使用一个阻塞线程, 否则所有传输交给共享的事件驱动引擎;
+        // context.budget 不为空时连接数受共享预算约束, thread_count 只是上限
+        MultiDownloader(std::string url, std::string destination, int thread_count = 8,
+                        detail::TransferContext context = {});
+        MultiDownloader(std::string url, std::string destination, const DownloadOptions& options,
+                        detail::TransferContext context = {});
         ~MultiDownloader() override;
 
         void start() override;
+        bool startAsync(std::function<void()> on_finished) override;
+        void cancel() override;
         [[nodiscard]] Progress getProgress() const override;
+        [[nodiscard]] ProgressSnapshot snapshot() const override;
+        [[nodiscard]] const std::string& url() const override;
+        [[nodiscard]] const std::string& filename() const override;
+        [[nodiscard]] std::string errorMessage() const override;
         [[nodiscard]] bool isRunning() const override;
         [[nodiscard]] bool hasError() const override;
 
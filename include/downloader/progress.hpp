@@ -15,4 +15,12 @@ struct Progress {
     std::string error_message;
 };
 
+// Progress 中会变化的部分, 由原子计数器读出, 复制代价很低
+struct ProgressSnapshot {
+    std::uint64_t total_bytes{0};
+    std::uint64_t downloaded_bytes{0};
+    bool is_running{false};
+    bool has_error{false};
+};
+
 } // namespace downloader
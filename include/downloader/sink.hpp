@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace downloader {
+
+// 下载数据的去处, 代替目标文件. 一次运行的调用顺序:
+//   open(大小) -> 若干 write -> close(是否成功, 最终大小)
+// 不支持分片的下载重试时会再次 open, 之前写的内容作废. 分片下载时多个连接并发调用 write,
+// 各次写入的区间互不重叠; 大小未知时只有一个连接按顺序写. 用了 Sink 的任务不写断点日志
+class Sink {
+public:
+    static constexpr std::uint64_t kUnknownSize = std::numeric_limits<std::uint64_t>::max();
+
+    virtual ~Sink() = default;
+
+    // 准备接收 size 字节(kUnknownSize 表示大小未知, 数据从 0 开始依次追加), 失败时写 error 并返回 false
+    virtual bool open(std::uint64_t size, std::string& error) = 0;
+    // 把数据写到 offset 处, 返回 false 时任务失败
+    virtual bool write(const char* data, std::size_t length, std::uint64_t offset) = 0;
+    // 读回已经写入的数据, 边下边算校验和时用. 不支持时返回 false, 这时 --checksum 校验会失败
+    virtual bool read(char* out, std::size_t length, std::uint64_t offset) const {
+        (void)out;
+        (void)length;
+        (void)offset;
+        return false;
+    }
+    // 每次运行结束时调用一次(open 之后), size 是写入的总字节数
+    virtual void close(bool ok, std::uint64_t size) {
+        (void)ok;
+        (void)size;
+    }
+};
+
+// 可重复使用的内存块: 大小按 2 的幂取整, 归还后留给下一个请求, 大量小对象下载时不反复向系统要内存.
+// 新块不清零. 线程安全
+class BufferPool {
+public:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        std::size_t capacity{0};
+    };
+
+    // 空闲块总量超过 max_idle_bytes 时归还的块直接释放
+    explicit BufferPool(std::size_t max_idle_bytes = 64 * 1024 * 1024);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // 借一个容量不小于 capacity 的块
+    Block acquire(std::size_t capacity);
+    void release(Block block);
+
+    [[nodiscard]] std::size_t idleBytes() const;
+
+private:
+    static constexpr std::size_t kMinBlock = 4096;
+
+    const std::size_t max_idle_bytes_;
+    mutable std::mutex mutex_;
+    std::multimap<std::size_t, std::unique_ptr<char[]>> idle_;   // 容量 -> 块
+    std::size_t idle_bytes_{0};
+};
+
+// 写进内存, 块从 pool 借(没有 pool 时自己分配), sink 销毁时归还. 大小已知时一次分配好,
+// 各连接直接拷贝到自己的区间; 大小未知时按需加倍扩容
+class MemorySink final : public Sink {
+public:
+    explicit MemorySink(std::shared_ptr<BufferPool> pool = nullptr);
+    ~MemorySink() override;
+
+    MemorySink(const MemorySink&) = delete;
+    MemorySink& operator=(const MemorySink&) = delete;
+
+    bool open(std::uint64_t size, std::string& error) override;
+    bool write(const char* data, std::size_t length, std::uint64_t offset) override;
+    bool read(char* out, std::size_t length, std::uint64_t offset) const override;
+
+    // 下载结束后读取; 运行中读取得到的是不完整的数据
+    [[nodiscard]] const char* data() const { return block_.data.get(); }
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] std::string_view view() const { return {block_.data.get(), size_}; }
+
+private:
+    bool reserve(std::size_t capacity);
+
+    std::shared_ptr<BufferPool> pool_;
+    BufferPool::Block block_;
+    std::size_t size_{0};
+    bool fixed_{false};   // 大小已知, 块不再扩容
+};
+
+// 写进调用方提供的缓冲区, 不分配内存; 文件比缓冲区大时任务失败
+class BufferSink final : public Sink {
+public:
+    BufferSink(char* data, std::size_t capacity) : data_(data), capacity_(capacity) {}
+
+    bool open(std::uint64_t size, std::string& error) override;
+    bool write(const char* data, std::size_t length, std::uint64_t offset) override;
+    bool read(char* out, std::size_t length, std::uint64_t offset) const override;
+
+    [[nodiscard]] std::size_t size() const { return size_; }
+
+private:
+    char* const data_;
+    const std::size_t capacity_;
+    std::size_t size_{0};
+    bool fixed_{false};
+};
+
+// 写进文件(截断后用 pwrite 写各自的偏移), 与不用 Sink 时的目标文件相同, 只是没有断点日志
+class FileSink final : public Sink {
+public:
+    explicit FileSink(std::string path) : path_(std::move(path)) {}
+    ~FileSink() override;
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    bool open(std::uint64_t size, std::string& error) override;
+    bool write(const char* data, std::size_t length, std::uint64_t offset) override;
+    bool read(char* out, std::size_t length, std::uint64_t offset) const override;
+    void close(bool ok, std::uint64_t size) override;
+
+    [[nodiscard]] const std::string& path() const { return path_; }
+
+private:
+    const std::string path_;
+    int fd_{-1};
+};
+
+} // namespace downloader
@@ -0,0 +1,344 @@
+#include "downloader/client.hpp"
+#include "downloader/multi_downloader.hpp"
+#include "downloader/detail/curl_handle_pool.hpp"
+#include "downloader/detail/curl_multi_engine.hpp"
+#include "downloader/detail/download_cache.hpp"
+#include "downloader/detail/transfer_context.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace downloader {
+
+namespace {
+constexpr const char* kCancelled = "Cancelled";
+} // namespace
+
+// 一次下载的共享状态, 句柄和 Client 各持有一份. 除 future 外都由 mutex 保护
+struct DownloadHandle::State {
+    DownloadRequest request;
+    Client::Impl* owner{nullptr};   // 结束之前一定有效; 锁内读到非空时先 enterCancel, Client 会等它返回
+    std::promise<DownloadResult> promise;
+    std::shared_future<DownloadResult> future{promise.get_future().share()};
+
+    std::mutex mutex;
+    std::shared_ptr<MultiDownloader> task;   // 运行期间才有
+    bool started{false};
+    bool cancelled{false};
+    bool finished{false};
+    ProgressSnapshot last{};   // 结束时的进度
+    std::chrono::steady_clock::time_point started_at{};
+};
+
+class Client::Impl {
+public:
+    using StatePtr = std::shared_ptr<DownloadHandle::State>;
+
+    explicit Impl(ClientOptions options)
+        : options_(options),
+          pool_(std::make_shared<BufferPool>(options.pool_idle_bytes)) {
+        context_.engine = std::make_shared<detail::CurlMultiEngine>(std::max(1, options_.event_loops));
+        context_.handles = std::make_shared<detail::CurlHandlePool>(options_.idle_handles);
+        if (!options_.cache_dir.empty()) {
+            context_.cache = std::make_shared<detail::DownloadCache>(options_.cache_dir);
+            std::string error;
+            if (!context_.cache->open(error)) {
+                throw std::runtime_error(error);
+            }
+        }
+        monitor_ = std::thread([this] { monitorLoop(); });
+    }
+
+    ~Impl() {
+        cancelAll();
+        waitAll();
+        {
+            // 下载都结束后不会再有新的 DownloadHandle::cancel 进来, 只等已经进来的返回
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return handle_cancels_ == 0; });
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        monitor_.join();
+        // 任务的析构要等它彻底退出, 必须在引擎之前
+        graveyard_.clear();
+    }
+
+    DownloadHandle submit(DownloadRequest request) {
+        auto state = std::make_shared<DownloadHandle::State>();
+        state->owner = this;
+        state->request = std::move(request);
+
+        std::vector<StatePtr> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(state);
+            ready = takeReadyLocked();
+        }
+        launch(ready);
+        return DownloadHandle(std::move(state));
+    }
+
+    // 排队中的直接结束; 已经启动的交给任务自己中止, 结束时照常走 onFinished
+    void cancel(const StatePtr& state) {
+        bool queued = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find(queue_.begin(), queue_.end(), state);
+            if (it != queue_.end()) {
+                queue_.erase(it);
+                queued = true;
+            }
+        }
+        if (queued) {
+            DownloadResult result;
+            result.url = state->request.url;
+            result.cancelled = true;
+            result.error = kCancelled;
+            complete(*state, std::move(result));
+            cv_.notify_all();
+            return;
+        }
+
+        std::shared_ptr<MultiDownloader> task;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->cancelled = true;
+            task = state->task;
+        }
+        // 还没拿到任务时由 launch 补上
+        if (task) {
+            task->cancel();
+        }
+    }
+
+    // DownloadHandle::cancel 在 state 的锁内调用 enterCancel, 此时 owner 还没被 complete 清空,
+    // 析构要等到对应的 leaveCancel 之后
+    void enterCancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++handle_cancels_;
+    }
+
+    void leaveCancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--handle_cancels_ == 0) {
+            cv_.notify_all();
+        }
+    }
+
+    void cancelAll() {
+        std::vector<StatePtr> all;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            all.assign(queue_.begin(), queue_.end());
+            all.insert(all.end(), running_.begin(), running_.end());
+        }
+        for (const auto& state : all) {
+            cancel(state);
+        }
+    }
+
+    void waitAll() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return queue_.empty() && running_.empty(); });
+    }
+
+    [[nodiscard]] const std::shared_ptr<BufferPool>& bufferPool() const { return pool_; }
+
+private:
+    // 按提交顺序取出能启动的下载, 调用方需持有 mutex_
+    std::vector<StatePtr> takeReadyLocked() {
+        std::vector<StatePtr> ready;
+        const auto limit = static_cast<std::size_t>(std::max(1, options_.max_active));
+        while (!queue_.empty() && running_.size() < limit) {
+            ready.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+            running_.push_back(ready.back());
+        }
+        return ready;
+    }
+
+    // 在锁外启动, 任务可能在 startAsync 里就结束并回调 onFinished
+    void launch(const std::vector<StatePtr>& ready) {
+        for (const auto& state : ready) {
+            DownloadOptions options = state->request.options;
+            options.stream_fd = -1;
+            options.sink = state->request.sink;
+            if (!options.sink && state->request.destination.empty()) {
+                options.sink = std::make_shared<MemorySink>(pool_);
+            }
+            auto task = std::make_shared<MultiDownloader>(state->request.url, state->request.destination, options,
+                                                          context_);
+            bool cancelled = false;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->task = task;
+                state->started = true;
+                state->started_at = std::chrono::steady_clock::now();
+                state->request.sink = options.sink;
+                cancelled = state->cancelled;
+            }
+            if (cancelled) {
+                task->cancel();
+            }
+            task->startAsync([this, state] { onFinished(state); });
+        }
+    }
+
+    // 运行在事件循环线程上(或启动失败时在 launch 的线程上). 任务此时还不能销毁, 先放进 graveyard_
+    // 由监视线程释放; 接着启动排队的下载
+    void onFinished(const StatePtr& state) {
+        std::shared_ptr<MultiDownloader> task;
+        bool cancelled = false;
+        std::chrono::steady_clock::time_point started_at;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            task = std::move(state->task);
+            cancelled = state->cancelled;
+            started_at = state->started_at;
+            state->last = task->snapshot();
+        }
+
+        DownloadResult result;
+        result.url = state->request.url;
+        result.ok = !task->hasError();
+        result.cancelled = cancelled && !result.ok;
+        result.error = task->errorMessage();
+        result.bytes = task->snapshot().downloaded_bytes;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+        result.sink = state->request.sink;
+        complete(*state, std::move(result));
+
+        std::vector<StatePtr> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_.erase(std::find(running_.begin(), running_.end(), state));
+            graveyard_.push_back(std::move(task));
+            ready = takeReadyLocked();
+        }
+        cv_.notify_all();
+        launch(ready);
+    }
+
+    // 先回调再让 future 就绪, 等待 future 的人能看到回调的效果
+    static void complete(DownloadHandle::State& state, DownloadResult result) {
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.finished) {
+                return;
+            }
+            state.finished = true;
+            state.owner = nullptr;
+        }
+        if (state.request.on_complete) {
+            state.request.on_complete(result);
+        }
+        state.promise.set_value(std::move(result));
+    }
+
+    // 定期回调进度并释放已结束的任务
+    void monitorLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            cv_.wait_for(lock, options_.progress_interval);
+            auto graveyard = std::move(graveyard_);
+            graveyard_.clear();
+            std::vector<StatePtr> running = running_;
+            lock.unlock();
+
+            graveyard.clear();
+            for (const auto& state : running) {
+                if (!state->request.on_progress) {
+                    continue;
+                }
+                std::shared_ptr<MultiDownloader> task;
+                {
+                    std::lock_guard<std::mutex> state_lock(state->mutex);
+                    task = state->task;
+                }
+                if (task) {
+                    state->request.on_progress(task->snapshot());
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    const ClientOptions options_;
+    detail::TransferContext context_;
+    const std::shared_ptr<BufferPool> pool_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;   // 有下载结束或要停止时通知
+    std::deque<StatePtr> queue_;
+    std::vector<StatePtr> running_;
+    std::vector<std::shared_ptr<MultiDownloader>> graveyard_;
+    int handle_cancels_{0};   // 正在执行的 DownloadHandle::cancel
+    bool stopping_{false};
+    std::thread monitor_;
+};
+
+// ---- DownloadHandle ----
+
+void DownloadHandle::cancel() const {
+    if (!state_) {
+        return;
+    }
+    Client::Impl* owner = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        owner = state_->owner;
+        if (owner) {
+            owner->enterCancel();
+        }
+    }
+    if (owner) {
+        owner->cancel(state_);
+        owner->leaveCancel();
+    }
+}
+
+ProgressSnapshot DownloadHandle::progress() const {
+    if (!state_) {
+        return {};
+    }
+    std::shared_ptr<MultiDownloader> task;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!state_->task) {
+            return state_->last;
+        }
+        task = state_->task;
+    }
+    return task->snapshot();
+}
+
+std::shared_future<DownloadResult> DownloadHandle::future() const {
+    return state_ ? state_->future : std::shared_future<DownloadResult>{};
+}
+
+const DownloadResult& DownloadHandle::wait() const {
+    return state_->future.get();
+}
+
+// ---- Client ----
+
+Client::Client(ClientOptions options) : impl_(std::make_unique<Impl>(options)) {}
+
+Client::~Client() = default;
+
+DownloadHandle Client::submit(DownloadRequest request) { return impl_->submit(std::move(request)); }
+
+void Client::cancelAll() { impl_->cancelAll(); }
+
+void Client::waitAll() { impl_->waitAll(); }
+
+const std::shared_ptr<BufferPool>& Client::bufferPool() const { return impl_->bufferPool(); }
+
+} // namespace downloader
@@ -0,0 +1,270 @@
+#include "downloader/detail/checksum.hpp"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+#ifdef MDOWN_HAVE_XXHASH
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define DOWNLOADER_HAS_SSE42_CRC 1
+#endif
+
+namespace downloader::detail {
+
+namespace {
+std::string toHex(const unsigned char* bytes, std::size_t length) {
+    static constexpr char kDigits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(length * 2);
+    for (std::size_t i = 0; i < length; ++i) {
+        hex.push_back(kDigits[bytes[i] >> 4]);
+        hex.push_back(kDigits[bytes[i] & 0x0f]);
+    }
+    return hex;
+}
+
+// 按大端输出, 与 crc32c / xxhsum 等工具的显示方式一致
+template <typename T>
+std::string toHex(T value) {
+    unsigned char bytes[sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        bytes[i] = static_cast<unsigned char>(value >> (8 * (sizeof(T) - 1 - i)));
+    }
+    return toHex(bytes, sizeof(T));
+}
+
+// CRC-32C (Castagnoli), 反射多项式 0x82F63B78, 软件实现按 slicing-by-8 查表
+using Crc32cTable = std::array<std::array<std::uint32_t, 256>, 8>;
+
+Crc32cTable makeCrc32cTable() {
+    Crc32cTable table{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+        }
+        table[0][i] = crc;
+    }
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        for (std::size_t k = 1; k < 8; ++k) {
+            table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+        }
+    }
+    return table;
+}
+
+std::uint32_t crc32cSoftware(std::uint32_t crc, const unsigned char* data, std::size_t length) {
+    static const Crc32cTable table = makeCrc32cTable();
+    while (length >= 8) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, data, 8);
+        word ^= crc;
+        crc = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^ table[5][(word >> 16) & 0xff] ^
+              table[4][(word >> 24) & 0xff] ^ table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^
+              table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef DOWNLOADER_HAS_SSE42_CRC
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cHardware(std::uint32_t crc, const unsigned char* data, std::size_t length) {
+    std::uint64_t crc64 = crc;
+    while (length >= 8) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+    while (length-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+std::uint32_t crc32cUpdate(std::uint32_t crc, const unsigned char* data, std::size_t length) {
+#ifdef DOWNLOADER_HAS_SSE42_CRC
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) {
+        return crc32cHardware(crc, data, length);
+    }
+#endif
+    return crc32cSoftware(crc, data, length);
+}
+
+std::size_t digestLength(Checksum::Algorithm algorithm) {
+    switch (algorithm) {
+    case Checksum::Algorithm::Sha256:
+        return 64;
+    case Checksum::Algorithm::Crc32c:
+        return 8;
+    case Checksum::Algorithm::Xxh3:
+        return 16;
+    }
+    return 0;
+}
+} // namespace
+
+class ChecksumState {
+public:
+    virtual ~ChecksumState() = default;
+    virtual void update(const char* data, std::size_t length) = 0;
+    virtual std::string hexDigest() = 0;
+    virtual void reset() = 0;
+};
+
+namespace {
+class Sha256State final : public ChecksumState {
+public:
+    Sha256State() : ctx_(EVP_MD_CTX_new()) { reset(); }
+    ~Sha256State() override { EVP_MD_CTX_free(ctx_); }
+
+    void update(const char* data, std::size_t length) override { EVP_DigestUpdate(ctx_, data, length); }
+
+    std::string hexDigest() override {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_DigestFinal_ex(ctx_, digest, &length);
+        return toHex(digest, length);
+    }
+
+    void reset() override { EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr); }
+
+private:
+    EVP_MD_CTX* ctx_;
+};
+
+class Crc32cState final : public ChecksumState {
+public:
+    void update(const char* data, std::size_t length) override {
+        crc_ = crc32cUpdate(crc_, reinterpret_cast<const unsigned char*>(data), length);
+    }
+    std::string hexDigest() override { return toHex(~crc_); }
+    void reset() override { crc_ = 0xffffffffu; }
+
+private:
+    std::uint32_t crc_{0xffffffffu};
+};
+
+#ifdef MDOWN_HAVE_XXHASH
+class Xxh3State final : public ChecksumState {
+public:
+    Xxh3State() : state_(XXH3_createState()) { reset(); }
+    ~Xxh3State() override { XXH3_freeState(state_); }
+
+    void update(const char* data, std::size_t length) override { XXH3_64bits_update(state_, data, length); }
+    std::string hexDigest() override { return toHex(static_cast<std::uint64_t>(XXH3_64bits_digest(state_))); }
+    void reset() override { XXH3_64bits_reset(state_); }
+
+private:
+    XXH3_state_t* state_;
+};
+#endif
+} // namespace
+
+std::optional<Checksum::Spec> Checksum::parse(const std::string& text, std::string* error) {
+    const auto fail = [&](std::string message) -> std::optional<Spec> {
+        if (error) {
+            *error = std::move(message);
+        }
+        return std::nullopt;
+    };
+
+    const auto colon = text.find(':');
+    if (colon == std::string::npos) {
+        return fail("Checksum must look like <algorithm>:<hex digest>: " + text);
+    }
+
+    std::string algorithm = text.substr(0, colon);
+    std::transform(algorithm.begin(), algorithm.end(), algorithm.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    Spec spec{};
+    if (algorithm == "sha256") {
+        spec.algorithm = Algorithm::Sha256;
+    } else if (algorithm == "crc32c") {
+        spec.algorithm = Algorithm::Crc32c;
+    } else if (algorithm == "xxh3") {
+#ifdef MDOWN_HAVE_XXHASH
+        spec.algorithm = Algorithm::Xxh3;
+#else
+        return fail("xxh3 checksums are not available in this build (xxhash.h not found)");
+#endif
+    } else {
+        return fail("Unknown checksum algorithm: " + algorithm);
+    }
+
+    spec.expected = text.substr(colon + 1);
+    std::transform(spec.expected.begin(), spec.expected.end(), spec.expected.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    const bool is_hex = std::all_of(spec.expected.begin(), spec.expected.end(),
+                                    [](unsigned char c) { return std::isxdigit(c) != 0; });
+    if (!is_hex || spec.expected.size() != digestLength(spec.algorithm)) {
+        return fail("Invalid " + algorithm + " digest: " + spec.expected);
+    }
+    return spec;
+}
+
+const char* Checksum::name(Algorithm algorithm) {
+    switch (algorithm) {
+    case Algorithm::Sha256:
+        return "sha256";
+    case Algorithm::Crc32c:
+        return "crc32c";
+    case Algorithm::Xxh3:
+        return "xxh3";
+    }
+    return "unknown";
+}
+
+Checksum::Checksum(Algorithm algorithm) : algorithm_(algorithm) {
+    switch (algorithm) {
+    case Algorithm::Sha256:
+        state_ = std::make_unique<Sha256State>();
+        break;
+    case Algorithm::Crc32c:
+        state_ = std::make_unique<Crc32cState>();
+        break;
+    case Algorithm::Xxh3:
+#ifdef MDOWN_HAVE_XXHASH
+        state_ = std::make_unique<Xxh3State>();
+#endif
+        break;
+    }
+}
+
+Checksum::~Checksum() = default;
+
+void Checksum::update(const char* data, std::size_t length) {
+    if (state_ && length > 0) {
+        state_->update(data, length);
+    }
+}
+
+std::string Checksum::hexDigest() {
+    return state_ ? state_->hexDigest() : std::string{};
+}
+
+void Checksum::reset() {
+    if (state_) {
+        state_->reset();
+    }
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,301 @@
+#include "downloader/detail/chunk_scheduler.hpp"
+
+#include <algorithm>
+
+namespace downloader::detail {
+
+struct ChunkScheduler::Chunk {
+    const curl_off_t start;
+
+    std::mutex mutex;
+    curl_off_t end;
+    curl_off_t pos;        // 主连接已提交的位置
+    curl_off_t reserved;   // 主连接已预留(可能正在写)的位置, 窃取只能从这之后切
+    curl_off_t credited;   // 已计入进度的连续位置
+    int active_leases{0};
+    bool has_duplicate{false};
+    bool done{false};
+
+    // 主连接的起点与开始时间, 用来估算速度
+    curl_off_t lease_from;
+    std::chrono::steady_clock::time_point lease_started;
+
+    Chunk(curl_off_t begin, curl_off_t finish)
+        : start(begin), end(finish), pos(begin), reserved(begin), credited(begin), lease_from(begin) {}
+
+    // 按当前速度估算的剩余秒数, 调用方需持有 mutex
+    [[nodiscard]] double estimatedRemaining(std::chrono::steady_clock::time_point now) const {
+        const double elapsed = std::chrono::duration<double>(now - lease_started).count();
+        const double speed = elapsed > 0.0 ? static_cast<double>(pos - lease_from) / elapsed : 0.0;
+        return static_cast<double>(end - reserved) / std::max(speed, 1.0);
+    }
+};
+
+namespace {
+std::vector<ChunkScheduler::Range> mergeRanges(std::vector<ChunkScheduler::Range> ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<ChunkScheduler::Range> merged;
+    for (const auto& range : ranges) {
+        if (range.first >= range.second) {
+            continue;
+        }
+        if (!merged.empty() && range.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    return merged;
+}
+} // namespace
+
+ChunkScheduler::ChunkScheduler(curl_off_t total, Options options, const std::vector<Range>& completed)
+    : total_(total), options_(options) {
+    std::vector<Range> clipped;
+    for (const auto& range : completed) {
+        clipped.emplace_back(std::max<curl_off_t>(0, range.first), std::min(range.second, total_));
+    }
+    completed_ = mergeRanges(std::move(clipped));
+
+    // 未分配的空洞 = 总区间减去已完成区间
+    curl_off_t cursor = 0;
+    for (const auto& range : completed_) {
+        if (range.first > cursor) {
+            unassigned_.emplace_back(cursor, range.first);
+        }
+        resumed_bytes_ += range.second - range.first;
+        cursor = range.second;
+    }
+    if (cursor < total_) {
+        unassigned_.emplace_back(cursor, total_);
+    }
+    unassigned_bytes_ = total_ - resumed_bytes_;
+}
+
+ChunkScheduler::~ChunkScheduler() = default;
+
+bool ChunkScheduler::acquire(Lease& lease) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_) {
+        return false;
+    }
+
+    if (!unassigned_.empty()) {
+        // 分片大小随剩余量递减, 让尾部的分片足够小
+        const curl_off_t workers = std::max(1, options_.worker_count);
+        curl_off_t size = std::clamp(unassigned_bytes_ / workers, options_.min_chunk_size,
+                                     std::max(options_.min_chunk_size, options_.max_chunk_size));
+
+        Range& gap = unassigned_.front();
+        const curl_off_t gap_size = gap.second - gap.first;
+        if (gap_size - size < options_.min_chunk_size) {
+            size = gap_size;
+        }
+
+        Chunk& chunk = addChunk(gap.first, gap.first + size);
+        gap.first += size;
+        unassigned_bytes_ -= size;
+        if (gap.first >= gap.second) {
+            unassigned_.pop_front();
+        }
+
+        std::lock_guard<std::mutex> chunk_lock(chunk.mutex);
+        assignPrimary(chunk, chunk.start, lease);
+        return true;
+    }
+
+    if (trySteal(lease)) {
+        return true;
+    }
+    return options_.endgame && tryEndgame(lease);
+}
+
+std::size_t ChunkScheduler::reserve(Lease& lease, std::size_t length) {
+    Chunk& chunk = *lease.chunk;
+    std::lock_guard<std::mutex> lock(chunk.mutex);
+    if (chunk.done || lease.cursor >= chunk.end) {
+        return 0;
+    }
+
+    const auto allowed = static_cast<std::size_t>(
+        std::min<curl_off_t>(static_cast<curl_off_t>(length), chunk.end - lease.cursor));
+    if (!lease.duplicate) {
+        chunk.reserved = std::max(chunk.reserved, lease.cursor + static_cast<curl_off_t>(allowed));
+    }
+    return allowed;
+}
+
+curl_off_t ChunkScheduler::commit(Lease& lease, std::size_t written) {
+    Chunk& chunk = *lease.chunk;
+    std::lock_guard<std::mutex> lock(chunk.mutex);
+
+    lease.cursor += static_cast<curl_off_t>(written);
+    if (!lease.duplicate) {
+        chunk.pos = std::max(chunk.pos, lease.cursor);
+    }
+
+    curl_off_t credit = 0;
+    if (lease.from <= chunk.credited && lease.cursor > chunk.credited) {
+        credit = lease.cursor - chunk.credited;
+        chunk.credited = lease.cursor;
+    }
+
+    if (!chunk.done && lease.cursor >= chunk.end) {
+        // 任意一个连接写到末尾即视为完成, 另一个连接的剩余部分不再计数
+        chunk.done = true;
+        credit += chunk.end - chunk.credited;
+        chunk.credited = chunk.end;
+    }
+    return credit;
+}
+
+bool ChunkScheduler::release(Lease& lease) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Chunk& chunk = *lease.chunk;
+    std::lock_guard<std::mutex> chunk_lock(chunk.mutex);
+    --chunk.active_leases;
+    const bool done = chunk.done;
+    lease = Lease{};
+    return done;
+}
+
+bool ChunkScheduler::finished(const Lease& lease) const {
+    Chunk& chunk = *lease.chunk;
+    std::lock_guard<std::mutex> lock(chunk.mutex);
+    return chunk.done || lease.cursor >= chunk.end;
+}
+
+bool ChunkScheduler::resume(Lease& lease) {
+    Chunk& chunk = *lease.chunk;
+    std::lock_guard<std::mutex> lock(chunk.mutex);
+    if (lease.duplicate || chunk.done || lease.cursor >= chunk.end) {
+        return false;
+    }
+
+    lease.from = lease.cursor;
+    lease.to = chunk.end;
+    chunk.lease_from = lease.cursor;
+    chunk.lease_started = std::chrono::steady_clock::now();
+    return true;
+}
+
+void ChunkScheduler::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+}
+
+bool ChunkScheduler::complete() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!unassigned_.empty()) {
+        return false;
+    }
+    for (const auto& chunk : chunks_) {
+        std::lock_guard<std::mutex> chunk_lock(chunk->mutex);
+        if (!chunk->done) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ChunkScheduler::Range> ChunkScheduler::writtenRanges() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Range> ranges = completed_;
+    for (const auto& chunk : chunks_) {
+        std::lock_guard<std::mutex> chunk_lock(chunk->mutex);
+        ranges.emplace_back(chunk->start, chunk->done ? chunk->end : chunk->credited);
+    }
+    return mergeRanges(std::move(ranges));
+}
+
+ChunkScheduler::Chunk& ChunkScheduler::addChunk(curl_off_t start, curl_off_t end) {
+    chunks_.push_back(std::make_unique<Chunk>(start, end));
+    return *chunks_.back();
+}
+
+void ChunkScheduler::assignPrimary(Chunk& chunk, curl_off_t from, Lease& lease) {
+    ++chunk.active_leases;
+    chunk.lease_from = from;
+    chunk.lease_started = std::chrono::steady_clock::now();
+
+    lease.chunk = &chunk;
+    lease.from = from;
+    lease.to = chunk.end;
+    lease.cursor = from;
+    lease.duplicate = false;
+}
+
+bool ChunkScheduler::trySteal(Lease& lease) {
+    const auto now = std::chrono::steady_clock::now();
+
+    Chunk* victim = nullptr;
+    double worst = 0.0;
+    for (auto& chunk : chunks_) {
+        std::lock_guard<std::mutex> chunk_lock(chunk->mutex);
+        if (chunk->done || chunk->active_leases == 0 || chunk->has_duplicate) {
+            continue;
+        }
+        if (chunk->end - chunk->reserved < 2 * options_.min_chunk_size) {
+            continue;
+        }
+        const double remaining = chunk->estimatedRemaining(now);
+        if (!victim || remaining > worst) {
+            victim = chunk.get();
+            worst = remaining;
+        }
+    }
+
+    if (!victim) {
+        return false;
+    }
+
+    curl_off_t mid = 0;
+    curl_off_t end = 0;
+    {
+        std::lock_guard<std::mutex> chunk_lock(victim->mutex);
+        mid = victim->reserved + (victim->end - victim->reserved) / 2;
+        end = victim->end;
+        victim->end = mid;
+    }
+
+    Chunk& stolen = addChunk(mid, end);
+    std::lock_guard<std::mutex> chunk_lock(stolen.mutex);
+    assignPrimary(stolen, mid, lease);
+    return true;
+}
+
+bool ChunkScheduler::tryEndgame(Lease& lease) {
+    const auto now = std::chrono::steady_clock::now();
+
+    Chunk* victim = nullptr;
+    double worst = 0.0;
+    for (auto& chunk : chunks_) {
+        std::lock_guard<std::mutex> chunk_lock(chunk->mutex);
+        if (chunk->done || chunk->active_leases == 0 || chunk->has_duplicate ||
+            chunk->reserved >= chunk->end) {
+            continue;
+        }
+        const double remaining = chunk->estimatedRemaining(now);
+        if (!victim || remaining > worst) {
+            victim = chunk.get();
+            worst = remaining;
+        }
+    }
+
+    if (!victim) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> chunk_lock(victim->mutex);
+    victim->has_duplicate = true;
+    ++victim->active_leases;
+
+    lease.chunk = victim;
+    lease.from = victim->reserved;
+    lease.to = victim->end;
+    lease.cursor = victim->reserved;
+    lease.duplicate = true;
+    return true;
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,154 @@
+#include "downloader/detail/concurrency_tuner.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace downloader::detail {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kWindow = std::chrono::milliseconds(500); // 吞吐统计窗口
+constexpr auto kReprobe = std::chrono::seconds(15);      // 稳定后隔多久再试探更高的级别
+constexpr auto kThrottleHold = std::chrono::seconds(30); // 被限流后至少保持这么久
+constexpr double kMinGain = 1.10;                        // 吞吐至少提高 10% 才算有效
+} // namespace
+
+struct ConcurrencyTuner::Host {
+    std::atomic<int> target;
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<int> connections{0};
+
+    // 以下由 mutex 保护
+    std::mutex mutex;
+    bool probing{true};
+    bool slow_start{true};         // 第一次到达平台之前每次翻倍, 之后每次加一半
+    Clock::time_point window_start{Clock::now()};
+    std::uint64_t window_bytes{0};
+    bool settling{false};          // 刚调整过级别, 下一个窗口新连接还在爬升, 不参与比较
+    Clock::time_point hold_until{};
+    Clock::time_point last_throttle{};
+    double best_rate{0.0};
+    double best_per_connection{0.0};
+    int best_level{0};
+
+    explicit Host(int level) : target(level) {}
+};
+
+ConcurrencyTuner::ConcurrencyTuner(int initial_level, int max_level)
+    : initial_level_(std::max(1, initial_level)), max_level_(std::max(initial_level_, max_level)) {}
+
+ConcurrencyTuner::~ConcurrencyTuner() = default;
+
+ConcurrencyTuner::Host& ConcurrencyTuner::host(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = hosts_[key];
+    if (!entry) {
+        entry = std::make_unique<Host>(initial_level_);
+    }
+    return *entry;
+}
+
+int ConcurrencyTuner::target(const Host& host) const {
+    return host.target.load(std::memory_order_relaxed);
+}
+
+void ConcurrencyTuner::addBytes(Host& host, std::uint64_t bytes) {
+    host.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ConcurrencyTuner::connectionOpened(Host& host) {
+    host.connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConcurrencyTuner::connectionClosed(Host& host) {
+    host.connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ConcurrencyTuner::maybeAdjust(Host& host) {
+    std::unique_lock<std::mutex> lock(host.mutex, std::try_to_lock);
+    if (!lock) {
+        return;
+    }
+
+    const auto now = Clock::now();
+    const auto elapsed = now - host.window_start;
+    if (elapsed < kWindow) {
+        return;
+    }
+
+    const std::uint64_t bytes = host.bytes.load(std::memory_order_relaxed);
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    const double rate = static_cast<double>(bytes - host.window_bytes) / seconds;
+    const int connections = std::max(1, host.connections.load(std::memory_order_relaxed));
+    const double per_connection = rate / connections;
+    host.window_start = now;
+    host.window_bytes = bytes;
+
+    // 没有数据(连接还在建立, 或该主机暂时没有任务)的窗口不参与比较
+    if (rate <= 0.0) {
+        return;
+    }
+    if (host.settling) {
+        host.settling = false;
+        return;
+    }
+
+    const int level = host.target.load(std::memory_order_relaxed);
+    const auto raise = [&] {
+        host.best_rate = rate;
+        host.best_per_connection = per_connection;
+        host.best_level = level;
+        const int step = host.slow_start ? level : std::max(1, level / 2);
+        host.target.store(std::min(max_level_, level + step), std::memory_order_relaxed);
+        host.settling = true;
+    };
+
+    if (!host.probing) {
+        // 稳定一段时间后从当前吞吐重新开始试探, 链路或服务器的状况可能已经变化
+        if (now >= host.hold_until && level < max_level_) {
+            host.probing = true;
+            raise();
+        }
+        return;
+    }
+
+    // 总吞吐明显提高, 且新增的连接不是只在瓜分原有带宽, 继续加
+    const bool gained = rate > host.best_rate * kMinGain &&
+                        per_connection > host.best_per_connection * 0.25;
+    if (gained && level < max_level_) {
+        raise();
+        return;
+    }
+
+    // 到达平台: 退回效果最好的级别并保持
+    if (!gained && host.best_level > 0) {
+        host.target.store(host.best_level, std::memory_order_relaxed);
+    }
+    host.probing = false;
+    host.slow_start = false;
+    host.hold_until = now + kReprobe;
+}
+
+void ConcurrencyTuner::onThrottled(Host& host) {
+    std::lock_guard<std::mutex> lock(host.mutex);
+    const auto now = Clock::now();
+    // 同一阵限流会让多个连接同时失败, 一个窗口内只减一次
+    if (host.last_throttle != Clock::time_point{} && now - host.last_throttle < kWindow) {
+        return;
+    }
+    host.last_throttle = now;
+
+    const int level = host.target.load(std::memory_order_relaxed);
+    host.target.store(std::max(1, level / 2), std::memory_order_relaxed);
+    host.probing = false;
+    host.slow_start = false;
+    host.hold_until = now + kThrottleHold;
+    host.best_rate = 0.0;
+    host.best_per_connection = 0.0;
+    host.best_level = 0;
+    host.settling = true;
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,121 @@
+#include "downloader/detail/connection_budget.hpp"
+
+#include <algorithm>
+
+namespace downloader::detail {
+
+ConnectionBudget::ConnectionBudget(int max_total, int max_per_host)
+    : max_total_(std::max(0, max_total)), max_per_host_(std::max(0, max_per_host)) {}
+
+void ConnectionBudget::enqueue(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++hosts_[host].queued;
+}
+
+bool ConnectionBudget::tryReserve(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostState& state = hosts_[host];
+    if (max_total_ > 0 && used_ >= max_total_) {
+        return false;
+    }
+    if (max_per_host_ > 0 && state.used >= max_per_host_) {
+        return false;
+    }
+
+    if (state.queued > 0) {
+        --state.queued;
+    }
+    ++state.reserved;
+    ++state.used;
+    ++used_;
+    return true;
+}
+
+void ConnectionBudget::setStartableTasks(int count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    startable_tasks_ = count;
+}
+
+void ConnectionBudget::acquireInitial(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostState& state = hosts_[host];
+    if (state.reserved > 0) {
+        --state.reserved;
+        return;
+    }
+    ++state.used;
+    ++used_;
+}
+
+bool ConnectionBudget::tryAcquire(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostState& state = hosts_[host];
+    if (max_per_host_ > 0 && state.used + startableQueuedLocked(state) >= max_per_host_) {
+        return false;
+    }
+    if (max_total_ > 0 && used_ + startableQueuedLocked() >= max_total_) {
+        return false;
+    }
+
+    ++state.used;
+    ++used_;
+    return true;
+}
+
+void ConnectionBudget::release(const std::string& host, int count) {
+    if (count <= 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = hosts_.find(host);
+        if (it != hosts_.end()) {
+            HostState& state = it->second;
+            const int released = std::min(count, state.used);
+            state.used -= released;
+            used_ -= released;
+            if (state.used == 0 && state.reserved == 0 && state.queued == 0) {
+                hosts_.erase(it);
+            }
+        }
+        ++release_generation_;
+    }
+    released_.notify_all();
+}
+
+void ConnectionBudget::waitForRelease(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const auto generation = release_generation_;
+    released_.wait_for(lock, timeout, [&] { return release_generation_ != generation; });
+}
+
+void ConnectionBudget::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++release_generation_;
+    }
+    released_.notify_all();
+}
+
+int ConnectionBudget::inUse() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+// 排队中、所在主机还有余量且有空闲任务位的任务数, 这些名额不分给扩充连接
+int ConnectionBudget::startableQueuedLocked() const {
+    int count = 0;
+    for (const auto& [host, state] : hosts_) {
+        count += startableQueuedLocked(state);
+    }
+    return startable_tasks_ >= 0 ? std::min(count, startable_tasks_) : count;
+}
+
+// 同上, 只算一个主机; 预读进来但没有任务位启动的任务不占这个主机的名额
+int ConnectionBudget::startableQueuedLocked(const HostState& state) const {
+    const int count = max_per_host_ > 0 ? std::min(state.queued, std::max(0, max_per_host_ - state.used))
+                                        : state.queued;
+    return startable_tasks_ >= 0 ? std::min(count, startable_tasks_) : count;
+}
+
+} // namespace downloader::detail
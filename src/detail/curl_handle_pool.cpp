@@ -0,0 +1,141 @@
+#include "downloader/detail/curl_handle_pool.hpp"
+#include "downloader/detail/curl_utils.hpp"
+
+#include <stdexcept>
+
+namespace downloader::detail {
+
+void EasyHandleDeleter::operator()(CURL* easy) const {
+    if (!easy) {
+        return;
+    }
+    if (pool) {
+        pool->release(easy, host);
+    } else {
+        curl_easy_cleanup(easy);
+    }
+}
+
+EasyHandle acquireEasy(const std::shared_ptr<CurlHandlePool>& pool, const std::string& host) {
+    if (!pool) {
+        return EasyHandle{curl_easy_init(), EasyHandleDeleter{}};
+    }
+    return EasyHandle{pool->acquire(host), EasyHandleDeleter{pool, host}};
+}
+
+CurlHandlePool::CurlHandlePool(std::size_t max_idle) : max_idle_(max_idle), share_(nullptr) {
+    ensureCurlInitialized();
+
+    share_ = curl_share_init();
+    if (!share_) {
+        throw std::runtime_error("Failed to create curl share handle");
+    }
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &CurlHandlePool::lockShare);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &CurlHandlePool::unlockShare);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    // 连接缓存不放进共享对象: libcurl 不支持多个线程同时使用共享的连接缓存,
+    // 连接复用交给每个句柄自己的缓存(事件驱动模式下是 multi 的缓存)
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+CurlHandlePool::~CurlHandlePool() {
+    for (auto& [host, handles] : idle_) {
+        for (CURL* easy : handles) {
+            curl_easy_cleanup(easy);
+        }
+    }
+    idle_.clear();
+    curl_share_cleanup(share_);
+}
+
+CURL* CurlHandlePool::acquire(const std::string& host) {
+    CURL* easy = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 优先借上次访问同一主机的句柄, 它很可能还保持着到该主机的连接
+        auto it = idle_.find(host);
+        if (it == idle_.end() || it->second.empty()) {
+            it = idle_.begin();
+            while (it != idle_.end() && it->second.empty()) {
+                ++it;
+            }
+        }
+        if (it != idle_.end()) {
+            easy = it->second.back();
+            it->second.pop_back();
+            --idle_count_;
+            if (it->second.empty()) {
+                idle_.erase(it);
+            }
+        }
+    }
+
+    if (easy) {
+        handles_reused_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        easy = curl_easy_init();
+        if (!easy) {
+            return nullptr;
+        }
+        handles_created_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    curl_easy_setopt(easy, CURLOPT_SHARE, share_);
+    return easy;
+}
+
+void CurlHandlePool::release(CURL* easy, const std::string& host) {
+    // reset 清掉所有选项(包括共享对象), 但保留句柄自己的连接缓存
+    curl_easy_reset(easy);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_count_ < max_idle_) {
+            idle_[host].push_back(easy);
+            ++idle_count_;
+            return;
+        }
+    }
+    curl_easy_cleanup(easy);
+}
+
+void CurlHandlePool::recordTransfer(CURL* easy) {
+    long connects = 0;
+    if (curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects) != CURLE_OK) {
+        return;
+    }
+    if (connects > 0) {
+        connections_new_.fetch_add(static_cast<std::uint64_t>(connects), std::memory_order_relaxed);
+    } else {
+        connections_reused_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+CurlHandlePool::Stats CurlHandlePool::stats() const {
+    Stats stats;
+    stats.handles_created = handles_created_.load(std::memory_order_relaxed);
+    stats.handles_reused = handles_reused_.load(std::memory_order_relaxed);
+    stats.connections_new = connections_new_.load(std::memory_order_relaxed);
+    stats.connections_reused = connections_reused_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool CurlHandlePool::isHttp2Host(const std::string& host) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return http2_hosts_.count(host) > 0;
+}
+
+void CurlHandlePool::recordHttp2(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    http2_hosts_.insert(host);
+}
+
+void CurlHandlePool::lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+    static_cast<CurlHandlePool*>(userptr)->share_mutexes_[data].lock();
+}
+
+void CurlHandlePool::unlockShare(CURL*, curl_lock_data data, void* userptr) {
+    static_cast<CurlHandlePool*>(userptr)->share_mutexes_[data].unlock();
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,245 @@
+#include "downloader/detail/curl_multi_engine.hpp"
+#include "downloader/detail/curl_utils.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace downloader::detail {
+
+class CurlMultiEngine::Loop {
+public:
+    Loop() : multi_(curl_multi_init()) {
+        if (!multi_) {
+            throw std::runtime_error("Failed to create curl multi handle");
+        }
+        // 同一主机的 HTTP/2 请求作为流复用已有连接(libcurl 7.62 起的默认值, 这里写明依赖它)
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~Loop() {
+        stopping_.store(true);
+        curl_multi_wakeup(multi_);
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        curl_multi_cleanup(multi_);
+    }
+
+    void submit(CURL* easy, Completion on_done, std::chrono::milliseconds delay) {
+        active_.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_.push_back(Request{easy, std::move(on_done), Clock::now() + delay});
+        }
+        curl_multi_wakeup(multi_);
+    }
+
+    void resumeAfter(CURL* easy, std::chrono::nanoseconds delay) {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_resumes_.emplace_back(Clock::now() + delay, easy);
+        }
+        curl_multi_wakeup(multi_);
+    }
+
+    [[nodiscard]] std::size_t activeTransfers() const {
+        return active_.load(std::memory_order_relaxed);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        CURL* easy;
+        Completion on_done;
+        Clock::time_point not_before;
+    };
+    using Pending = std::deque<Request>;
+
+    void run() {
+        while (!stopping_.load()) {
+            adoptPending();
+
+            int still_running = 0;
+            curl_multi_perform(multi_, &still_running);
+            drainCompleted();
+
+            curl_multi_poll(multi_, nullptr, 0, pollTimeoutMs(), nullptr);
+        }
+
+        // 关闭时仍在进行的传输以 CURLE_ABORTED_BY_CALLBACK 结束, 延迟中的和回调中新提交的也一样
+        for (auto& [easy, on_done] : running_) {
+            curl_multi_remove_handle(multi_, easy);
+            complete(easy, on_done, CURLE_ABORTED_BY_CALLBACK);
+        }
+        running_.clear();
+        paused_.clear();
+
+        for (auto& [due, request] : delayed_) {
+            complete(request.easy, request.on_done, CURLE_ABORTED_BY_CALLBACK);
+        }
+        delayed_.clear();
+
+        while (true) {
+            Pending batch;
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                batch.swap(pending_);
+            }
+            if (batch.empty()) {
+                break;
+            }
+            for (auto& request : batch) {
+                complete(request.easy, request.on_done, CURLE_ABORTED_BY_CALLBACK);
+            }
+        }
+    }
+
+    void adoptPending() {
+        Pending batch;
+        std::vector<std::pair<Clock::time_point, CURL*>> resumes;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            batch.swap(pending_);
+            resumes.swap(pending_resumes_);
+        }
+
+        const auto now = Clock::now();
+        paused_.insert(resumes.begin(), resumes.end());
+        while (!paused_.empty() && paused_.begin()->first <= now) {
+            CURL* easy = paused_.begin()->second;
+            paused_.erase(paused_.begin());
+            // 暂停期间传输可能已经结束(例如引擎关闭), 这时不再恢复
+            if (running_.count(easy) != 0) {
+                curl_easy_pause(easy, CURLPAUSE_CONT);
+            }
+        }
+
+        for (auto& request : batch) {
+            if (request.not_before > now) {
+                delayed_.emplace(request.not_before, std::move(request));
+            } else {
+                start(request);
+            }
+        }
+
+        while (!delayed_.empty() && delayed_.begin()->first <= now) {
+            Request request = std::move(delayed_.begin()->second);
+            delayed_.erase(delayed_.begin());
+            start(request);
+        }
+    }
+
+    void start(Request& request) {
+        curl_easy_setopt(request.easy, CURLOPT_PRIVATE, this);
+        if (curl_multi_add_handle(multi_, request.easy) != CURLM_OK) {
+            complete(request.easy, request.on_done, CURLE_FAILED_INIT);
+            return;
+        }
+        running_.emplace(request.easy, std::move(request.on_done));
+    }
+
+    // 有延迟的请求或暂停的传输时, 醒来的时间不晚于最早的那个
+    [[nodiscard]] int pollTimeoutMs() const {
+        constexpr int kIdleMs = 1000;
+        if (delayed_.empty() && paused_.empty()) {
+            return kIdleMs;
+        }
+
+        auto due = Clock::time_point::max();
+        if (!delayed_.empty()) {
+            due = delayed_.begin()->first;
+        }
+        if (!paused_.empty()) {
+            due = std::min(due, paused_.begin()->first);
+        }
+        // 向上取整, 避免在到期前反复空转
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(due - Clock::now()).count();
+        return static_cast<int>(std::clamp<long long>(wait, 0, kIdleMs));
+    }
+
+    void drainCompleted() {
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            CURL* easy = msg->easy_handle;
+            const CURLcode result = msg->data.result;
+            curl_multi_remove_handle(multi_, easy);
+
+            auto it = running_.find(easy);
+            if (it == running_.end()) {
+                continue;
+            }
+            Completion on_done = std::move(it->second);
+            running_.erase(it);
+            complete(easy, on_done, result);
+        }
+    }
+
+    void complete(CURL* easy, Completion& on_done, CURLcode result) {
+        if (on_done) {
+            on_done(easy, result);
+        }
+        active_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    CURLM* multi_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::size_t> active_{0};
+
+    std::mutex pending_mutex_;
+    Pending pending_;
+    std::vector<std::pair<Clock::time_point, CURL*>> pending_resumes_;
+    // 只在事件循环线程上访问
+    std::unordered_map<CURL*, Completion> running_;
+    std::multimap<Clock::time_point, Request> delayed_;
+    std::multimap<Clock::time_point, CURL*> paused_;
+};
+
+CurlMultiEngine::CurlMultiEngine(int loop_count) {
+    ensureCurlInitialized();
+
+    const int count = std::max(1, loop_count);
+    loops_.reserve(static_cast<std::size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        loops_.push_back(std::make_unique<Loop>());
+    }
+}
+
+CurlMultiEngine::~CurlMultiEngine() = default;
+
+void CurlMultiEngine::submit(CURL* easy, Completion on_done, std::chrono::milliseconds delay) {
+    const std::size_t index = next_loop_.fetch_add(1, std::memory_order_relaxed) % loops_.size();
+    loops_[index]->submit(easy, std::move(on_done), delay);
+}
+
+void CurlMultiEngine::resumeAfter(CURL* easy, std::chrono::nanoseconds delay) {
+    // 句柄开始传输时记下了所属的事件循环
+    char* loop = nullptr;
+    if (curl_easy_getinfo(easy, CURLINFO_PRIVATE, &loop) != CURLE_OK || !loop) {
+        return;
+    }
+    reinterpret_cast<Loop*>(loop)->resumeAfter(easy, delay);
+}
+
+std::size_t CurlMultiEngine::activeTransfers() const {
+    std::size_t total = 0;
+    for (const auto& loop : loops_) {
+        total += loop->activeTransfers();
+    }
+    return total;
+}
+
+} // namespace downloader::detail
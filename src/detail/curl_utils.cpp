@@ -1,7 +1,9 @@
 #include "downloader/detail/curl_utils.hpp"
 
 #include <curl/curl.h>
+#include <cctype>
 #include <cstdlib>
+#include <limits>
 #include <stdexcept>
 #include <mutex>
 
@@ -17,4 +19,120 @@ void ensureCurlInitialized() {
     });
 }
 
-} // namespace downloader::detail
\ No newline at end of file
+std::string findHeader(std::string_view raw_headers, std::string_view name) {
+    std::string value;
+    std::size_t line_start = 0;
+    while (line_start < raw_headers.size()) {
+        std::size_t line_end = raw_headers.find('\n', line_start);
+        if (line_end == std::string_view::npos) {
+            line_end = raw_headers.size();
+        }
+        std::string_view line = raw_headers.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+
+        const std::size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon != name.size()) {
+            continue;
+        }
+
+        bool same = true;
+        for (std::size_t i = 0; i < name.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(line[i])) !=
+                std::tolower(static_cast<unsigned char>(name[i]))) {
+                same = false;
+                break;
+            }
+        }
+        if (!same) {
+            continue;
+        }
+
+        std::string_view field = line.substr(colon + 1);
+        while (!field.empty() && std::isspace(static_cast<unsigned char>(field.front()))) {
+            field.remove_prefix(1);
+        }
+        while (!field.empty() && std::isspace(static_cast<unsigned char>(field.back()))) {
+            field.remove_suffix(1);
+        }
+        value.assign(field);
+    }
+    return value;
+}
+
+std::string hostKey(const std::string& url) {
+    CURLU* handle = curl_url();
+    if (!handle) {
+        return url;
+    }
+
+    std::string key = url;
+    char* host = nullptr;
+    char* port = nullptr;
+    if (curl_url_set(handle, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK &&
+        curl_url_get(handle, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+        curl_url_get(handle, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+        key = std::string(host) + ":" + port;
+        for (auto& c : key) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(handle);
+    return key;
+}
+
+namespace {
+// 读取一个非负十进制数并前移 text, 没有数字或溢出时返回 false
+bool readNumber(std::string_view& text, std::int64_t& value) {
+    std::size_t i = 0;
+    value = 0;
+    while (i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]))) {
+        if (value > (std::numeric_limits<std::int64_t>::max() - 9) / 10) {
+            return false;
+        }
+        value = value * 10 + (text[i] - '0');
+        ++i;
+    }
+    text.remove_prefix(i);
+    return i > 0;
+}
+} // namespace
+
+std::optional<ContentRange> parseContentRange(std::string_view value) {
+    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front()))) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+        value.remove_suffix(1);
+    }
+    constexpr std::string_view kUnit = "bytes ";
+    if (value.size() < kUnit.size()) {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < kUnit.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(value[i])) != kUnit[i]) {
+            return std::nullopt;
+        }
+    }
+    value.remove_prefix(kUnit.size());
+
+    ContentRange range;
+    if (!readNumber(value, range.first) || value.empty() || value.front() != '-') {
+        return std::nullopt;
+    }
+    value.remove_prefix(1);
+    if (!readNumber(value, range.last) || value.empty() || value.front() != '/' || range.last < range.first) {
+        return std::nullopt;
+    }
+    value.remove_prefix(1);
+    if (value == "*") {
+        return range;
+    }
+    if (!readNumber(value, range.total) || !value.empty() || range.last >= range.total) {
+        return std::nullopt;
+    }
+    return range;
+}
+
+} // namespace downloader::detail
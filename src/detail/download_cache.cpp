@@ -0,0 +1,238 @@
+#include "downloader/detail/download_cache.hpp"
+#include "downloader/detail/checksum.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace downloader::detail {
+
+namespace {
+constexpr const char* kMagic = "mdown-cache 2";
+
+std::string sha256Hex(const std::string& text) {
+    Checksum checksum(Checksum::Algorithm::Sha256);
+    checksum.update(text.data(), text.size());
+    return checksum.hexDigest();
+}
+
+// 同一目录下不会重名的临时文件名, 其他进程和线程写的临时文件互不影响
+std::string tempPath(const std::string& path) {
+    static std::atomic<std::uint64_t> counter{0};
+    return path + ".tmp." + std::to_string(::getpid()) + "." +
+           std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+}
+
+bool makeDirectory(const std::string& path) {
+    return ::mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = ::write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// 同一文件系统上优先用 copy_file_range(内核可能直接共享数据块), 不支持时退回读写
+bool copyContent(int in, int out) {
+    bool fallback = false;
+    while (!fallback) {
+        const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, 1 << 30, 0);
+        if (n == 0) {
+            return true;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+                return false;
+            }
+            fallback = true;
+        }
+    }
+
+    char buffer[256 * 1024];
+    while (true) {
+        const ssize_t n = ::read(in, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0;
+        }
+        if (!writeAll(out, buffer, static_cast<std::size_t>(n))) {
+            return false;
+        }
+    }
+}
+
+// 在 target 旁边做出 source 的副本(reflink 或复制)再 rename 过去, target 不会处于写了一半的状态.
+// 不用硬链接: 目标文件和缓存对象共用一个 inode 时, 任何一方被原地修改另一方也跟着变
+bool placeFile(const std::string& source, const std::string& target, mode_t mode) {
+    const std::string temp = tempPath(target);
+
+    const int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    const int out = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    bool placed = out >= 0 && (::ioctl(out, FICLONE, in) == 0 || copyContent(in, out));
+    if (out >= 0 && ::close(out) != 0) {
+        placed = false;
+    }
+    ::close(in);
+
+    if (!placed || std::rename(temp.c_str(), target.c_str()) != 0) {
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool writeTextFile(const std::string& path, const std::string& content) {
+    const std::string temp = tempPath(path);
+    const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = writeAll(fd, content.data(), content.size());
+    ::close(fd);
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool regularFileOfSize(const std::string& path, std::uint64_t size, struct stat& st) {
+    return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && static_cast<std::uint64_t>(st.st_size) == size;
+}
+
+std::int64_t mtimeNs(const struct stat& st) {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+} // namespace
+
+DownloadCache::DownloadCache(std::string directory) : directory_(std::move(directory)) {}
+
+bool DownloadCache::open(std::string& error) const {
+    if (!makeDirectory(directory_) || !makeDirectory(directory_ + "/index") ||
+        !makeDirectory(directory_ + "/objects")) {
+        error = "Cannot create cache directory: " + directory_;
+        return false;
+    }
+    return true;
+}
+
+std::optional<DownloadCache::Entry> DownloadCache::lookup(const std::string& url) const {
+    std::ifstream in(indexPath(url));
+    if (!in) {
+        return std::nullopt;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != kMagic) {
+        return std::nullopt;
+    }
+
+    Entry entry;
+    std::string saved_url;
+    bool has_size = false;
+    bool has_object = false;
+    std::uint64_t inode = 0;
+    std::int64_t mtime = 0;
+    while (std::getline(in, line)) {
+        const std::size_t space = line.find(' ');
+        const std::string key = line.substr(0, space);
+        const std::string value = space == std::string::npos ? std::string{} : line.substr(space + 1);
+
+        if (key == "url") {
+            saved_url = value;
+        } else if (key == "size") {
+            std::istringstream fields(value);
+            has_size = static_cast<bool>(fields >> entry.size);
+        } else if (key == "etag") {
+            entry.etag = value;
+        } else if (key == "last-modified") {
+            entry.last_modified = value;
+        } else if (key == "sha256") {
+            entry.sha256 = value;
+        } else if (key == "object") {
+            std::istringstream fields(value);
+            has_object = static_cast<bool>(fields >> inode >> mtime);
+        }
+    }
+
+    // 对象可能已经被清理掉了, 这时当作没有缓存, 重新完整下载
+    struct stat st {};
+    if (saved_url != url || !has_size || !has_object || entry.sha256.size() != 64 || !entry.usable() ||
+        !regularFileOfSize(objectPath(entry.sha256), entry.size, st)) {
+        return std::nullopt;
+    }
+    // 对象在记录之后被换掉或改过, 内容已经不可信: 删掉, 下次完整下载后重新存一份
+    if (static_cast<std::uint64_t>(st.st_ino) != inode || mtimeNs(st) != mtime) {
+        ::unlink(objectPath(entry.sha256).c_str());
+        return std::nullopt;
+    }
+    return entry;
+}
+
+bool DownloadCache::materialize(const Entry& entry, const std::string& destination, std::string& error) const {
+    if (!placeFile(objectPath(entry.sha256), destination, 0644)) {
+        error = "Cannot copy cached file to destination";
+        return false;
+    }
+    return true;
+}
+
+bool DownloadCache::store(const std::string& url, const Entry& entry, const std::string& source) const {
+    if (!entry.usable() || entry.sha256.empty()) {
+        return false;
+    }
+    // 对象只读, 防止被误改; 索引记下它的 inode 和修改时间, lookup 时据此发现改动
+    const std::string object = objectPath(entry.sha256);
+    struct stat st {};
+    if (!regularFileOfSize(object, entry.size, st) &&
+        (!placeFile(source, object, 0444) || !regularFileOfSize(object, entry.size, st))) {
+        return false;
+    }
+
+    std::string content;
+    content += kMagic;
+    content += "\nurl " + url;
+    content += "\nsize " + std::to_string(entry.size);
+    content += "\netag " + entry.etag;
+    content += "\nlast-modified " + entry.last_modified;
+    content += "\nsha256 " + entry.sha256;
+    content += "\nobject " + std::to_string(st.st_ino) + " " + std::to_string(mtimeNs(st));
+    content += '\n';
+    return writeTextFile(indexPath(url), content);
+}
+
+std::string DownloadCache::indexPath(const std::string& url) const {
+    return directory_ + "/index/" + sha256Hex(url);
+}
+
+std::string DownloadCache::objectPath(const std::string& sha256) const {
+    return directory_ + "/objects/" + sha256;
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,203 @@
+#include "downloader/detail/io_uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define DOWNLOADER_HAS_IO_URING 1
+#endif
+
+namespace downloader::detail {
+
+#ifdef DOWNLOADER_HAS_IO_URING
+
+namespace {
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+void* mapRing(int fd, std::size_t size, off_t offset) {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+template <typename T>
+T* at(void* base, std::uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+} // namespace
+
+std::unique_ptr<IoUring> IoUring::create(unsigned entries) {
+    io_uring_params params{};
+    const int fd = ioUringSetup(entries, &params);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<IoUring> ring(new IoUring());
+    ring->fd_ = fd;
+    ring->sq_entries_ = params.sq_entries;
+
+    ring->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // 5.4 以后两个环可以用一次 mmap 映射
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        ring->sq_ring_size_ = std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+        ring->cq_ring_size_ = 0;
+    }
+
+    ring->sq_ring_ = mapRing(fd, ring->sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!ring->sq_ring_) {
+        return nullptr;
+    }
+    if (single_mmap) {
+        ring->cq_ring_ = ring->sq_ring_;
+    } else {
+        ring->cq_ring_ = mapRing(fd, ring->cq_ring_size_, IORING_OFF_CQ_RING);
+        if (!ring->cq_ring_) {
+            return nullptr;
+        }
+    }
+    ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes_ = mapRing(fd, ring->sqes_size_, IORING_OFF_SQES);
+    if (!ring->sqes_) {
+        return nullptr;
+    }
+
+    ring->sq_head_ = at<unsigned>(ring->sq_ring_, params.sq_off.head);
+    ring->sq_tail_ = at<unsigned>(ring->sq_ring_, params.sq_off.tail);
+    ring->sq_mask_ = at<unsigned>(ring->sq_ring_, params.sq_off.ring_mask);
+    ring->sq_array_ = at<unsigned>(ring->sq_ring_, params.sq_off.array);
+    ring->cq_head_ = at<unsigned>(ring->cq_ring_, params.cq_off.head);
+    ring->cq_tail_ = at<unsigned>(ring->cq_ring_, params.cq_off.tail);
+    ring->cq_mask_ = at<unsigned>(ring->cq_ring_, params.cq_off.ring_mask);
+    ring->cqes_ = at<void>(ring->cq_ring_, params.cq_off.cqes);
+    return ring;
+}
+
+IoUring::~IoUring() {
+    if (sqes_) {
+        ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+        ::munmap(sq_ring_, sq_ring_size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool IoUring::registerBuffers(const std::vector<iovec>& buffers) {
+    return ioUringRegister(fd_, IORING_REGISTER_BUFFERS, buffers.data(),
+                           static_cast<unsigned>(buffers.size())) == 0;
+}
+
+bool IoUring::registerFileTable(unsigned slots) {
+    // 5.5 以后允许注册 -1 占位
+    std::vector<int> fds(slots, -1);
+    return ioUringRegister(fd_, IORING_REGISTER_FILES, fds.data(), slots) == 0;
+}
+
+bool IoUring::updateFile(unsigned slot, int fd) {
+    io_uring_files_update update{};
+    update.offset = slot;
+    update.fds = reinterpret_cast<std::uint64_t>(&fd);
+    return ioUringRegister(fd_, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+}
+
+bool IoUring::prepareWrite(int fd, bool fixed_file, const char* data, std::size_t length, std::uint64_t offset,
+                           int buf_index, std::uint64_t user_data) {
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    const unsigned tail = *sq_tail_;
+    if (tail - head >= sq_entries_) {
+        return false;
+    }
+
+    const unsigned index = tail & *sq_mask_;
+    auto* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = buf_index >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->flags = fixed_file ? IOSQE_FIXED_FILE : 0;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<std::uint64_t>(data);
+    sqe->len = static_cast<std::uint32_t>(length);
+    sqe->buf_index = static_cast<std::uint16_t>(buf_index >= 0 ? buf_index : 0);
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++unsubmitted_;
+    return true;
+}
+
+bool IoUring::submit(unsigned wait_for) {
+    if (unsubmitted_ == 0 && wait_for == 0) {
+        return true;
+    }
+
+    const unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret = 0;
+    do {
+        ret = ioUringEnter(fd_, unsubmitted_, wait_for, flags);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return false;
+    }
+    // 内核可能只接收了一部分, 剩下的下一次再提交
+    unsubmitted_ -= static_cast<unsigned>(ret);
+    return true;
+}
+
+bool IoUring::popCompletion(Completion& out) {
+    const unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    const auto* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+    out.user_data = cqe->user_data;
+    out.result = cqe->res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+std::unique_ptr<IoUring> IoUring::create(unsigned) {
+    return nullptr;
+}
+
+IoUring::~IoUring() = default;
+
+bool IoUring::registerBuffers(const std::vector<iovec>&) { return false; }
+bool IoUring::registerFileTable(unsigned) { return false; }
+bool IoUring::updateFile(unsigned, int) { return false; }
+
+bool IoUring::prepareWrite(int, bool, const char*, std::size_t, std::uint64_t, int, std::uint64_t) {
+    return false;
+}
+
+bool IoUring::submit(unsigned) { return false; }
+bool IoUring::popCompletion(Completion&) { return false; }
+
+#endif
+
+} // namespace downloader::detail
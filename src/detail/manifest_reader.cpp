@@ -0,0 +1,42 @@
+#include "downloader/detail/manifest_reader.hpp"
+
+#include <sstream>
+
+namespace downloader::detail {
+
+std::optional<ManifestReader::Entry> ManifestReader::next(std::string& error) {
+    std::string text;
+    while (std::getline(input_, text)) {
+        ++line_;
+        if (!text.empty() && text.back() == '\r') {
+            text.pop_back();
+        }
+
+        std::istringstream fields(text);
+        Entry entry;
+        entry.line = line_;
+        if (!(fields >> entry.url) || entry.url.front() == '#') {
+            continue;
+        }
+
+        error.clear();
+        if (!(fields >> entry.destination)) {
+            error = "missing destination";
+            return entry;
+        }
+
+        std::string field;
+        while (fields >> field) {
+            const auto eq = field.find('=');
+            if (eq == std::string::npos || eq == 0) {
+                error = "expected key=value, got \"" + field + "\"";
+                return entry;
+            }
+            entry.attributes.emplace_back(field.substr(0, eq), field.substr(eq + 1));
+        }
+        return entry;
+    }
+    return std::nullopt;
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,109 @@
+#include "downloader/detail/ordered_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+#include <unistd.h>
+
+namespace downloader::detail {
+
+OrderedStream::OrderedStream(int fd, std::size_t window, Observer on_emit)
+    : fd_(fd), window_(window), on_emit_(std::move(on_emit)) {}
+
+bool OrderedStream::hasRoom(curl_off_t offset, std::size_t length) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hasRoomLocked(offset, length);
+}
+
+// 接在已输出位置上(或已经输出过)的数据总能接收, 不然读不到它的连接就永远等不来窗口
+bool OrderedStream::hasRoomLocked(curl_off_t offset, std::size_t length) const {
+    return offset <= emitted_ || offset + static_cast<curl_off_t>(length) <= emitted_ + static_cast<curl_off_t>(window_);
+}
+
+bool OrderedStream::waitForRoom(curl_off_t offset, std::size_t length, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return room_cv_.wait_for(lock, timeout, [&] { return failed_ || hasRoomLocked(offset, length); }) &&
+           !failed_;
+}
+
+bool OrderedStream::push(const char* data, std::size_t length, curl_off_t offset) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_ || !hasRoomLocked(offset, length)) {
+        return false;
+    }
+
+    // 已经输出过的部分(重复请求)直接丢掉
+    if (offset < emitted_) {
+        const auto skip = static_cast<std::size_t>(std::min<curl_off_t>(emitted_ - offset, length));
+        data += skip;
+        length -= skip;
+        offset += static_cast<curl_off_t>(skip);
+    }
+    if (length == 0) {
+        return true;
+    }
+    if (offset > emitted_) {
+        pending_.emplace(offset, std::string(data, length));
+        buffered_ += length;
+        return true;
+    }
+
+    // 写出这一段, 再依次写出缓冲区里接上的段; 写管道阻塞时其他连接在锁上等, 反压一直传到服务器
+    const curl_off_t before = emitted_;
+    bool ok = emitLocked(data, length);
+    for (auto it = pending_.begin(); ok && it != pending_.end() && it->first <= emitted_;) {
+        const std::string& chunk = it->second;
+        const auto end = it->first + static_cast<curl_off_t>(chunk.size());
+        if (end > emitted_) {
+            const auto skip = static_cast<std::size_t>(emitted_ - it->first);
+            ok = emitLocked(chunk.data() + skip, chunk.size() - skip);
+        }
+        buffered_ -= chunk.size();
+        it = pending_.erase(it);
+    }
+    if (!ok) {
+        failed_ = true;
+    }
+    if (emitted_ != before || failed_) {
+        room_cv_.notify_all();
+    }
+    return ok;
+}
+
+bool OrderedStream::emitLocked(const char* data, std::size_t length) {
+    const curl_off_t offset = emitted_;
+    std::size_t written = 0;
+    while (written < length) {
+        const ssize_t n = ::write(fd_, data + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    emitted_ += static_cast<curl_off_t>(length);
+    if (on_emit_) {
+        on_emit_(data, length, offset);
+    }
+    return true;
+}
+
+curl_off_t OrderedStream::emitted() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return emitted_;
+}
+
+std::size_t OrderedStream::buffered() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffered_;
+}
+
+bool OrderedStream::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+} // namespace downloader::detail
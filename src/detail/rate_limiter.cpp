@@ -0,0 +1,32 @@
+#include "downloader/detail/rate_limiter.hpp"
+
+#include <algorithm>
+
+namespace downloader::detail {
+
+namespace {
+std::int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+RateLimiter::RateLimiter(std::uint64_t bytes_per_second, std::chrono::nanoseconds burst)
+    : bytes_per_second_(std::max<std::uint64_t>(1, bytes_per_second)),
+      burst_ns_(std::max<std::int64_t>(0, burst.count())) {}
+
+std::chrono::nanoseconds RateLimiter::acquire(std::uint64_t bytes) {
+    const auto cost = static_cast<std::int64_t>(
+        static_cast<double>(bytes) * 1e9 / static_cast<double>(bytes_per_second_));
+    const std::int64_t now = steadyNowNs();
+
+    std::int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+    std::int64_t next = 0;
+    do {
+        next = std::max(tat, now - burst_ns_) + cost;
+    } while (!tat_ns_.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+
+    return std::chrono::nanoseconds{std::max<std::int64_t>(0, next - now)};
+}
+
+} // namespace downloader::detail
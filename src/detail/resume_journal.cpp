@@ -0,0 +1,108 @@
+#include "downloader/detail/resume_journal.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace downloader::detail {
+
+namespace {
+constexpr const char* kMagic = "mdown-journal 1";
+} // namespace
+
+ResumeJournal::ResumeJournal(const std::string& destination)
+    : path_(destination + ".mdown") {}
+
+std::vector<ResumeJournal::Range> ResumeJournal::load(const std::string& url,
+                                                      const Validators& current) const {
+    std::ifstream in(path_);
+    if (!in) {
+        return {};
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != kMagic) {
+        return {};
+    }
+
+    Validators saved;
+    std::string saved_url;
+    std::vector<Range> ranges;
+    while (std::getline(in, line)) {
+        const std::size_t space = line.find(' ');
+        const std::string key = line.substr(0, space);
+        const std::string value = space == std::string::npos ? std::string{} : line.substr(space + 1);
+
+        if (key == "url") {
+            saved_url = value;
+        } else if (key == "size") {
+            std::istringstream fields(value);
+            if (!(fields >> saved.size)) {
+                return {};
+            }
+        } else if (key == "etag") {
+            saved.etag = value;
+        } else if (key == "last-modified") {
+            saved.last_modified = value;
+        } else if (key == "range") {
+            std::istringstream fields(value);
+            curl_off_t first = 0;
+            curl_off_t second = 0;
+            if (!(fields >> first >> second) || first < 0 || second <= first || second > current.size) {
+                return {};
+            }
+            ranges.emplace_back(first, second);
+        }
+    }
+
+    if (saved_url != url || !current.usable() || !(saved == current)) {
+        return {};
+    }
+    return ranges;
+}
+
+bool ResumeJournal::save(const std::string& url, const Validators& validators,
+                         const std::vector<Range>& ranges) const {
+    std::string content;
+    content += kMagic;
+    content += "\nurl " + url;
+    content += "\nsize " + std::to_string(validators.size);
+    content += "\netag " + validators.etag;
+    content += "\nlast-modified " + validators.last_modified;
+    for (const auto& [first, second] : ranges) {
+        content += "\nrange " + std::to_string(first) + " " + std::to_string(second);
+    }
+    content += '\n';
+
+    const std::string temp = path_ + ".tmp";
+    const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::size_t written = 0;
+    while (written < content.size()) {
+        const ssize_t n = ::write(fd, content.data() + written, content.size() - written);
+        if (n <= 0) {
+            break;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    const bool ok = written == content.size() && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || std::rename(temp.c_str(), path_.c_str()) != 0) {
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ResumeJournal::remove() const {
+    ::unlink(path_.c_str());
+}
+
+} // namespace downloader::detail
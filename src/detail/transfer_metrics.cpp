@@ -0,0 +1,387 @@
+#include "downloader/detail/transfer_metrics.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fmt/format.h>
+
+namespace downloader::detail {
+
+namespace {
+// 耗时(秒), 覆盖局域网到跨洲的源站
+const std::vector<double> kSecondsBounds{0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+                                         0.5,   1.0,    2.5,   5.0,  10.0,  30.0, 60.0};
+// 单次传输的字节数, 从小文件到大分片
+const std::vector<double> kBytesBounds{4096.0,       65536.0,       262144.0,       1048576.0,     4194304.0,
+                                       16777216.0,   67108864.0,    268435456.0,    1073741824.0};
+// 单次传输的平均速率(字节/秒)
+const std::vector<double> kSpeedBounds{65536.0,     262144.0,    1048576.0,    4194304.0,
+                                       16777216.0,  67108864.0,  268435456.0,  1073741824.0};
+
+constexpr const char* kPhaseNames[TransferMetrics::PhaseCount] = {"dns", "connect", "tls",
+                                                                 "ttfb", "transfer", "total"};
+
+double seconds(curl_off_t microseconds) {
+    return static_cast<double>(microseconds) / 1e6;
+}
+
+curl_off_t timeInfo(CURL* easy, CURLINFO info) {
+    curl_off_t value = 0;
+    curl_easy_getinfo(easy, info, &value);
+    return std::max<curl_off_t>(0, value);
+}
+
+// JSON 字符串和 Prometheus 标签值的转义规则在这里用到的字符上一致
+std::string escape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out.append("\\n");
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+std::string histogramJson(const Histogram& histogram) {
+    std::string out = fmt::format("{{\"count\":{},\"sum\":{:.6g},\"p50\":{:.6g},\"p90\":{:.6g},\"p99\":{:.6g},"
+                                  "\"buckets\":[",
+                                  histogram.count(), histogram.sum(), histogram.quantile(0.5),
+                                  histogram.quantile(0.9), histogram.quantile(0.99));
+    const auto& bounds = histogram.bounds();
+    const auto& counts = histogram.counts();
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        if (i > 0) {
+            out.push_back(',');
+        }
+        if (i < bounds.size()) {
+            out += fmt::format("[{:g},{}]", bounds[i], counts[i]);
+        } else {
+            out += fmt::format("[\"+Inf\",{}]", counts[i]);
+        }
+    }
+    out.append("]}");
+    return out;
+}
+
+void histogramPrometheus(std::string& out, const std::string& name, const std::string& labels,
+                         const Histogram& histogram) {
+    const auto& bounds = histogram.bounds();
+    const auto& counts = histogram.counts();
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        cumulative += counts[i];
+        const std::string le = i < bounds.size() ? fmt::format("{:g}", bounds[i]) : std::string{"+Inf"};
+        out += fmt::format("{}_bucket{{{},le=\"{}\"}} {}\n", name, labels, le, cumulative);
+    }
+    out += fmt::format("{}_sum{{{}}} {:.6g}\n", name, labels, histogram.sum());
+    out += fmt::format("{}_count{{{}}} {}\n", name, labels, histogram.count());
+}
+} // namespace
+
+void Histogram::observe(double value) {
+    const auto& bounds = *bounds_;
+    const auto index = static_cast<std::size_t>(std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin());
+    ++counts_[index];
+    ++count_;
+    sum_ += value;
+}
+
+double Histogram::quantile(double q) const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+    const auto& bounds = *bounds_;
+    const double rank = q * static_cast<double>(count_);
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+        if (counts_[i] == 0 || static_cast<double>(cumulative + counts_[i]) < rank) {
+            cumulative += counts_[i];
+            continue;
+        }
+        // 最后一个桶没有上界, 只能报告前一个桶的上界
+        if (i == bounds.size()) {
+            return bounds.empty() ? 0.0 : bounds.back();
+        }
+        const double lower = i == 0 ? 0.0 : bounds[i - 1];
+        const double fraction = (rank - static_cast<double>(cumulative)) / static_cast<double>(counts_[i]);
+        return lower + (bounds[i] - lower) * std::clamp(fraction, 0.0, 1.0);
+    }
+    return bounds.empty() ? 0.0 : bounds.back();
+}
+
+TransferMetrics::HostMetrics::HostMetrics()
+    : phases(PhaseCount, Histogram(kSecondsBounds)), transfer_bytes(kBytesBounds), speed(kSpeedBounds) {}
+
+void TransferMetrics::record(const std::string& host, CURL* easy, bool ok) {
+    // libcurl 的各时间点都从请求开始累计, 这里换算成各阶段自己的耗时
+    const curl_off_t namelookup = timeInfo(easy, CURLINFO_NAMELOOKUP_TIME_T);
+    const curl_off_t connect = timeInfo(easy, CURLINFO_CONNECT_TIME_T);
+    const curl_off_t appconnect = timeInfo(easy, CURLINFO_APPCONNECT_TIME_T);
+    const curl_off_t pretransfer = timeInfo(easy, CURLINFO_PRETRANSFER_TIME_T);
+    const curl_off_t starttransfer = timeInfo(easy, CURLINFO_STARTTRANSFER_TIME_T);
+    const curl_off_t total = timeInfo(easy, CURLINFO_TOTAL_TIME_T);
+    long connects = 0;
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    curl_off_t speed = 0;
+    curl_easy_getinfo(easy, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& metrics = hosts_[host];
+    ++metrics.transfers;
+    if (!ok) {
+        ++metrics.errors;
+    }
+    metrics.bytes += static_cast<std::uint64_t>(std::max<curl_off_t>(0, bytes));
+
+    // 复用的连接没有 DNS、建连和握手阶段, 只在新建连接时记录, 免得一堆 0 拉低分布
+    if (connects > 0) {
+        ++metrics.new_connections;
+        metrics.phases[Dns].observe(seconds(namelookup));
+        metrics.phases[Connect].observe(seconds(connect - std::min(connect, namelookup)));
+        if (appconnect > 0) {
+            metrics.phases[Tls].observe(seconds(appconnect - std::min(appconnect, connect)));
+        }
+    }
+    if (starttransfer > 0) {
+        metrics.phases[Ttfb].observe(seconds(starttransfer - std::min(starttransfer, pretransfer)));
+        metrics.phases[Transfer].observe(seconds(total - std::min(total, starttransfer)));
+    }
+    metrics.phases[Total].observe(seconds(total));
+    if (bytes > 0) {
+        metrics.transfer_bytes.observe(static_cast<double>(bytes));
+        metrics.speed.observe(static_cast<double>(speed));
+    }
+}
+
+void TransferMetrics::recordRetry(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++hosts_[host].retries;
+}
+
+std::string TransferMetrics::toJson() const {
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+    std::string out = fmt::format("{{\"timestamp_ms\":{},\"hosts\":{{", now);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool first_host = true;
+    for (const auto& [host, metrics] : hosts_) {
+        if (!first_host) {
+            out.push_back(',');
+        }
+        first_host = false;
+        out += fmt::format("\"{}\":{{\"transfers\":{},\"errors\":{},\"retries\":{},\"new_connections\":{},"
+                           "\"bytes\":{},\"phase_seconds\":{{",
+                           escape(host), metrics.transfers, metrics.errors, metrics.retries,
+                           metrics.new_connections, metrics.bytes);
+        for (int phase = 0; phase < PhaseCount; ++phase) {
+            if (phase > 0) {
+                out.push_back(',');
+            }
+            out += fmt::format("\"{}\":{}", kPhaseNames[phase], histogramJson(metrics.phases[phase]));
+        }
+        out += fmt::format("}},\"transfer_bytes\":{},\"speed_bytes_per_second\":{}}}",
+                           histogramJson(metrics.transfer_bytes), histogramJson(metrics.speed));
+    }
+    out.append("}}\n");
+    return out;
+}
+
+std::string TransferMetrics::toPrometheus() const {
+    std::string out;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto counter = [&](const char* name, const char* help, auto value_of) {
+        out += fmt::format("# HELP {} {}\n# TYPE {} counter\n", name, help, name);
+        for (const auto& [host, metrics] : hosts_) {
+            out += fmt::format("{}{{host=\"{}\"}} {}\n", name, escape(host), value_of(metrics));
+        }
+    };
+    counter("mdown_transfers_total", "HTTP requests finished, successful or not.",
+            [](const HostMetrics& m) { return m.transfers; });
+    counter("mdown_transfer_errors_total", "HTTP requests that failed.",
+            [](const HostMetrics& m) { return m.errors; });
+    counter("mdown_transfer_retries_total", "Requests retried after a failure.",
+            [](const HostMetrics& m) { return m.retries; });
+    counter("mdown_connections_total", "New connections opened.",
+            [](const HostMetrics& m) { return m.new_connections; });
+    counter("mdown_downloaded_bytes_total", "Body bytes received.",
+            [](const HostMetrics& m) { return m.bytes; });
+
+    out.append("# HELP mdown_transfer_phase_seconds Time spent in each phase of a request.\n"
+               "# TYPE mdown_transfer_phase_seconds histogram\n");
+    for (const auto& [host, metrics] : hosts_) {
+        for (int phase = 0; phase < PhaseCount; ++phase) {
+            histogramPrometheus(out, "mdown_transfer_phase_seconds",
+                                fmt::format("host=\"{}\",phase=\"{}\"", escape(host), kPhaseNames[phase]),
+                                metrics.phases[phase]);
+        }
+    }
+    out.append("# HELP mdown_transfer_bytes Body bytes per request.\n"
+               "# TYPE mdown_transfer_bytes histogram\n");
+    for (const auto& [host, metrics] : hosts_) {
+        histogramPrometheus(out, "mdown_transfer_bytes", fmt::format("host=\"{}\"", escape(host)),
+                            metrics.transfer_bytes);
+    }
+    out.append("# HELP mdown_transfer_speed_bytes_per_second Average speed per request.\n"
+               "# TYPE mdown_transfer_speed_bytes_per_second histogram\n");
+    for (const auto& [host, metrics] : hosts_) {
+        histogramPrometheus(out, "mdown_transfer_speed_bytes_per_second", fmt::format("host=\"{}\"", escape(host)),
+                            metrics.speed);
+    }
+    return out;
+}
+
+MetricsExporter::MetricsExporter(std::shared_ptr<TransferMetrics> metrics) : metrics_(std::move(metrics)) {}
+
+MetricsExporter::~MetricsExporter() {
+    stop_.store(true);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+    }
+    writeJson();
+}
+
+bool MetricsExporter::listen(std::uint16_t port, std::string& error) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+    const int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+        error = fmt::format("Cannot listen on 127.0.0.1:{}: {}", port, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    listen_fd_ = fd;
+    return true;
+}
+
+void MetricsExporter::writeFile(std::string path, std::chrono::milliseconds interval) {
+    json_path_ = std::move(path);
+    interval_ = std::max(interval, std::chrono::milliseconds{100});
+}
+
+void MetricsExporter::start() {
+    if (listen_fd_ >= 0 || !json_path_.empty()) {
+        thread_ = std::thread([this] { run(); });
+    }
+}
+
+void MetricsExporter::run() {
+    constexpr int kPollMs = 200;
+    auto next_write = std::chrono::steady_clock::now() + interval_;
+    while (!stop_.load()) {
+        if (listen_fd_ >= 0) {
+            pollfd entry{listen_fd_, POLLIN, 0};
+            if (::poll(&entry, 1, kPollMs) > 0) {
+                const int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0) {
+                    serveClient(client);
+                    ::close(client);
+                }
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds{kPollMs});
+        }
+
+        if (!json_path_.empty() && std::chrono::steady_clock::now() >= next_write) {
+            writeJson();
+            next_write = std::chrono::steady_clock::now() + interval_;
+        }
+    }
+}
+
+// 只支持最简单的一问一答: 读到请求头结束(或超时)就按路径回复, 然后关闭连接
+void MetricsExporter::serveClient(int fd) const {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        pollfd entry{fd, POLLIN, 0};
+        if (::poll(&entry, 1, 1000) <= 0) {
+            return;
+        }
+        const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return;
+        }
+        request.append(buffer, static_cast<std::size_t>(n));
+    }
+
+    std::string status = "200 OK";
+    std::string type = "text/plain; version=0.0.4";
+    std::string body;
+    if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET /metrics?", 0) == 0) {
+        body = metrics_->toPrometheus();
+    } else if (request.rfind("GET /stats.json ", 0) == 0) {
+        type = "application/json";
+        body = metrics_->toJson();
+    } else {
+        status = "404 Not Found";
+        body = "try /metrics or /stats.json\n";
+    }
+
+    const std::string response = fmt::format("HTTP/1.0 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+                                             "Connection: close\r\n\r\n",
+                                             status, type, body.size()) +
+                                 body;
+    std::size_t sent = 0;
+    while (sent < response.size()) {
+        const ssize_t n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+}
+
+void MetricsExporter::writeJson() const {
+    if (json_path_.empty()) {
+        return;
+    }
+    // 先写临时文件再改名, 读取方不会看到写了一半的文件
+    const std::string temp = json_path_ + ".tmp";
+    std::FILE* file = std::fopen(temp.c_str(), "w");
+    if (!file) {
+        return;
+    }
+    const std::string json = metrics_->toJson();
+    const bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+    if (std::fclose(file) == 0 && written) {
+        std::rename(temp.c_str(), json_path_.c_str());
+    } else {
+        std::remove(temp.c_str());
+    }
+}
+
+} // namespace downloader::detail
@@ -0,0 +1,353 @@
+#include "downloader/detail/write_behind.hpp"
+
+#include "downloader/detail/io_uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <unistd.h>
+
+namespace downloader::detail {
+
+namespace {
+// pwrite 全部数据, 中途失败返回 false
+bool writeAll(int fd, const char* data, std::size_t length, curl_off_t offset) {
+    std::size_t written = 0;
+    while (written < length) {
+        const ssize_t n = ::pwrite(fd, data + written, length - written,
+                                   static_cast<off_t>(offset) + static_cast<off_t>(written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            return false;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+curl_off_t alignUp(curl_off_t value) {
+    const auto align = static_cast<curl_off_t>(WriteBehind::kAlignment);
+    return (value + align - 1) / align * align;
+}
+
+curl_off_t alignDown(curl_off_t value) {
+    const auto align = static_cast<curl_off_t>(WriteBehind::kAlignment);
+    return value / align * align;
+}
+
+constexpr unsigned kRingEntries = 128;
+constexpr unsigned kFileSlots = 64;
+
+// 缓冲区里 [first, last) 这一段, direct 表示用 O_DIRECT 的 fd 写
+struct Piece {
+    curl_off_t first;
+    curl_off_t last;
+    bool direct;
+};
+
+// 有 O_DIRECT fd 时切成最多三段: 不对齐的头, 对齐的中间, 不对齐的尾. 返回段数
+int splitBuffer(const WriteBehind::Buffer& buffer, bool direct, Piece* pieces) {
+    const curl_off_t first = buffer.offset;
+    const curl_off_t last = buffer.endOffset();
+    if (!direct) {
+        pieces[0] = Piece{first, last, false};
+        return first < last ? 1 : 0;
+    }
+
+    const curl_off_t direct_first = std::min(alignUp(first), last);
+    const curl_off_t direct_last = std::max(alignDown(last), direct_first);
+    int count = 0;
+    for (const Piece piece : {Piece{first, direct_first, false}, Piece{direct_first, direct_last, true},
+                              Piece{direct_last, last, false}}) {
+        if (piece.first < piece.last) {
+            pieces[count++] = piece;
+        }
+    }
+    return count;
+}
+
+const char* pieceData(const WriteBehind::Buffer& buffer, const Piece& piece) {
+    return buffer.data + buffer.begin + (piece.first - buffer.offset);
+}
+} // namespace
+
+// 交给 io_uring 的一个缓冲区, 每段一个写请求, 全部完成后归还缓冲区
+struct WriteBehind::InFlight {
+    Job job;
+    Piece pieces[3];
+    int pending{0};
+    bool ok{true};
+    int fd_slot{-1};
+    int direct_slot{-1};
+};
+
+WriteBehind::WriteBehind(std::size_t buffer_size, std::size_t memory_budget, int writer_threads, Backend backend)
+    : buffer_size_(static_cast<std::size_t>(std::max(alignUp(static_cast<curl_off_t>(buffer_size)),
+                                                     static_cast<curl_off_t>(2 * kAlignment)))) {
+    // 每个缓冲区多留一个对齐单位, 给按文件偏移错开的起点
+    const std::size_t capacity = buffer_size_ + kAlignment;
+    const std::size_t count = std::max<std::size_t>(1, memory_budget / buffer_size_);
+
+    buffers_.resize(count);
+    free_.reserve(count);
+    for (auto& buffer : buffers_) {
+        buffer.data = static_cast<char*>(::operator new(capacity, std::align_val_t{kAlignment}));
+        buffer.capacity = capacity;
+        free_.push_back(&buffer);
+    }
+
+    if (backend == Backend::IoUring) {
+        ring_ = IoUring::create(kRingEntries);
+    }
+    if (ring_) {
+        // 注册缓冲区和文件表都是可选的, 失败(如超出 RLIMIT_MEMLOCK)时照常用普通的写请求
+        std::vector<iovec> iovecs;
+        iovecs.reserve(buffers_.size());
+        for (const auto& buffer : buffers_) {
+            iovecs.push_back(iovec{buffer.data, buffer.capacity});
+        }
+        fixed_buffers_ = ring_->registerBuffers(iovecs);
+        if (ring_->registerFileTable(kFileSlots)) {
+            for (int slot = static_cast<int>(kFileSlots) - 1; slot >= 0; --slot) {
+                free_slots_.push_back(slot);
+            }
+        }
+        writers_.emplace_back([this] { runRing(); });
+        return;
+    }
+
+    const int threads = std::max(1, writer_threads);
+    for (int i = 0; i < threads; ++i) {
+        writers_.emplace_back([this] { run(); });
+    }
+}
+
+WriteBehind::~WriteBehind() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& writer : writers_) {
+        if (writer.joinable()) {
+            writer.join();
+        }
+    }
+    for (auto& buffer : buffers_) {
+        ::operator delete(buffer.data, std::align_val_t{kAlignment});
+    }
+}
+
+WriteBehind::Buffer* WriteBehind::tryAcquire(curl_off_t offset) {
+    Buffer* buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            return nullptr;
+        }
+        buffer = free_.back();
+        free_.pop_back();
+    }
+
+    buffer->offset = offset;
+    buffer->begin = static_cast<std::size_t>(offset % static_cast<curl_off_t>(kAlignment));
+    buffer->end = buffer->begin;
+    return buffer;
+}
+
+void WriteBehind::release(Buffer* buffer) {
+    if (!buffer) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buffer);
+}
+
+void WriteBehind::attachFile(int fd) {
+    if (!ring_ || fd < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_slots_.empty() || file_slots_.count(fd) > 0) {
+        return;
+    }
+    const int slot = free_slots_.back();
+    if (ring_->updateFile(static_cast<unsigned>(slot), fd)) {
+        free_slots_.pop_back();
+        file_slots_.emplace(fd, slot);
+    }
+}
+
+void WriteBehind::detachFile(int fd) {
+    if (!ring_ || fd < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = file_slots_.find(fd);
+    if (it == file_slots_.end()) {
+        return;
+    }
+    ring_->updateFile(static_cast<unsigned>(it->second), -1);
+    free_slots_.push_back(it->second);
+    file_slots_.erase(it);
+}
+
+void WriteBehind::submit(int fd, int direct_fd, Buffer* buffer, Completion on_done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(Job{fd, direct_fd, buffer, std::move(on_done)});
+    }
+    cv_.notify_one();
+}
+
+// 析构时先写完队列里剩下的任务再退出
+void WriteBehind::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        const bool ok = writeBuffer(job.fd, job.direct_fd, *job.buffer);
+        release(job.buffer);
+        if (job.on_done) {
+            job.on_done(ok);
+        }
+    }
+}
+
+// 单个写线程: 把排队的缓冲区一次性提交给内核, 然后等任意一个完成再继续收新任务.
+// 析构时同样先写完队列里剩下的任务再退出
+void WriteBehind::runRing() {
+    std::size_t inflight = 0;   // 已交给环、还没收到完成的写请求数
+    std::vector<InFlight*> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (inflight == 0) {
+                cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+            }
+            // 每个缓冲区最多三段, 在途请求不超过环的容量, 完成队列就不会溢出
+            while (!jobs_.empty() && inflight + 3 * (batch.size() + 1) <= ring_->capacity()) {
+                auto* op = new InFlight{};
+                op->job = std::move(jobs_.front());
+                jobs_.pop_front();
+                if (auto it = file_slots_.find(op->job.fd); it != file_slots_.end()) {
+                    op->fd_slot = it->second;
+                }
+                if (auto it = file_slots_.find(op->job.direct_fd); it != file_slots_.end()) {
+                    op->direct_slot = it->second;
+                }
+                batch.push_back(op);
+            }
+        }
+
+        for (InFlight* op : batch) {
+            inflight += startRingJob(op);
+        }
+        batch.clear();
+
+        // 出错(极少见)时下一轮重新提交
+        if (!ring_->submit(inflight > 0 ? 1 : 0)) {
+            std::this_thread::yield();
+        }
+        IoUring::Completion completion{};
+        while (ring_->popCompletion(completion)) {
+            --inflight;
+            auto* op = reinterpret_cast<InFlight*>(completion.user_data & ~std::uint64_t{3});
+            finishRingWrite(op, completion.result, static_cast<int>(completion.user_data & 3));
+        }
+    }
+}
+
+// 返回放进环里的请求数. 放不进去的段直接同步写
+std::size_t WriteBehind::startRingJob(InFlight* op) {
+    const Buffer& buffer = *op->job.buffer;
+    const int count = splitBuffer(buffer, op->job.direct_fd >= 0, op->pieces);
+    const int buf_index = fixed_buffers_ ? static_cast<int>(op->job.buffer - buffers_.data()) : -1;
+    const auto tag = reinterpret_cast<std::uint64_t>(op);
+
+    if (count == 0) {
+        op->pending = 1;
+        finishRingWrite(op, 0, -1);
+        return 0;
+    }
+
+    // pending 先设满, 同步写完最后一段时才可能释放 op
+    op->pending = count;
+    std::size_t queued = 0;
+    for (int i = 0; i < count; ++i) {
+        const Piece& piece = op->pieces[i];
+        const int fd = piece.direct ? op->job.direct_fd : op->job.fd;
+        const int slot = piece.direct ? op->direct_slot : op->fd_slot;
+        if (ring_->prepareWrite(slot >= 0 ? slot : fd, slot >= 0, pieceData(buffer, piece),
+                                static_cast<std::size_t>(piece.last - piece.first),
+                                static_cast<std::uint64_t>(piece.first), buf_index,
+                                tag | static_cast<std::uint64_t>(i))) {
+            ++queued;
+        } else {
+            finishRingWrite(op, -EAGAIN, i);
+        }
+    }
+    return queued;
+}
+
+void WriteBehind::finishRingWrite(InFlight* op, int result, int piece_index) {
+    if (piece_index >= 0) {
+        const Piece& piece = op->pieces[piece_index];
+        const auto length = static_cast<std::size_t>(piece.last - piece.first);
+        // 失败(包括文件系统不支持 O_DIRECT)时整段用普通 fd 重写, 短写时补上剩下的部分
+        const auto done = static_cast<std::size_t>(std::max(result, 0));
+        if (done < length &&
+            !writeAll(op->job.fd, pieceData(*op->job.buffer, piece) + done, length - done,
+                      piece.first + static_cast<curl_off_t>(done))) {
+            op->ok = false;
+        }
+    }
+    if (--op->pending > 0) {
+        return;
+    }
+
+    release(op->job.buffer);
+    if (op->job.on_done) {
+        op->job.on_done(op->ok);
+    }
+    delete op;
+}
+
+// 完整落在对齐边界内的部分用 O_DIRECT 写, 首尾不对齐的零头走页缓存.
+// 相邻缓冲区共享的页只会被两边都以普通方式写, 同一页不会混用两种写法
+bool WriteBehind::writeBuffer(int fd, int direct_fd, const Buffer& buffer) {
+    Piece pieces[3];
+    const int count = splitBuffer(buffer, direct_fd >= 0, pieces);
+    for (int i = 0; i < count; ++i) {
+        const Piece& piece = pieces[i];
+        const auto length = static_cast<std::size_t>(piece.last - piece.first);
+        // 文件系统不支持 O_DIRECT 的写法时(EINVAL 等)退回普通写
+        const bool ok = (piece.direct && writeAll(direct_fd, pieceData(buffer, piece), length, piece.first)) ||
+                        writeAll(fd, pieceData(buffer, piece), length, piece.first);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace downloader::detail
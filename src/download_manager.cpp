@@ -1,4 +1,8 @@
 #include "downloader/download_manager.hpp"
+#include "downloader/detail/connection_budget.hpp"
+#include "downloader/detail/curl_handle_pool.hpp"
+#include "downloader/detail/rate_limiter.hpp"
+#include "downloader/detail/curl_utils.hpp"
 
 #include <algorithm>
 #include <chrono>
@@ -7,106 +11,507 @@
 #include <thread>
 #include <filesystem>
 
+#include <sys/ioctl.h>
+#include <unistd.h>
+
 #include <fmt/format.h>
 
 namespace downloader {
 
+namespace {
+std::size_t terminalRows() {
+    winsize size{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0) {
+        return size.ws_row;
+    }
+    return 24;
+}
+
+// Plain 模式下的字符串值: 加引号, 转义引号、反斜杠和换行
+std::string quoteValue(const std::string& text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    out.push_back('"');
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out.append("\\n");
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+    return out;
+}
+} // namespace
+
+DownloadManager::DownloadManager(detail::TransferContext context) : context_(std::move(context)) {}
+
 void DownloadManager::addTask(DownloadTaskPtr task) {
     if (task) {
-        tasks_.push_back(std::move(task));
+        TaskEntry entry;
+        entry.url = task->url();
+        entry.filename = task->filename();
+        entry.host = detail::hostKey(entry.url);
+        entry.task = std::move(task);
+        tasks_.push_back(std::move(entry));
     }
 }
 
+void DownloadManager::setTaskSource(TaskSource source) {
+    source_ = std::move(source);
+    source_done_ = !source_;
+}
+
+void DownloadManager::setResultCallback(ResultCallback callback) {
+    on_result_ = std::move(callback);
+}
+
+void DownloadManager::setMaxActiveTasks(int count) {
+    max_active_ = std::max(0, count);
+}
+
+void DownloadManager::setProgressMode(ProgressMode mode, std::size_t top_k) {
+    progress_mode_ = mode;
+    top_k_ = top_k;
+}
+
 void DownloadManager::start() {
-    threads_.reserve(tasks_.size());
-    for (auto& task : tasks_) {
-        threads_.emplace_back([task]() {
-            if (task) {
-                task->start();
-            }
-        });
+    queued_ = 0;
+    running_ = 0;
+    unreported_ = tasks_.size();
+    finished_total_ = 0;
+    finished_downloaded_ = 0;
+    run_started_at_ = std::chrono::steady_clock::now();
+    for (auto& entry : tasks_) {
+        entry.started = false;
+        entry.reported = false;
+        entry.finished->store(false);
+        if (context_.budget) {
+            context_.budget->enqueue(entry.host);
+        }
+        ++queued_;
     }
 
     renderProgressLoop();
 
-    for (auto& thread : threads_) {
-        if (thread.joinable()) {
-            thread.join();
+    for (auto& entry : tasks_) {
+        if (entry.thread.joinable()) {
+            entry.thread.join();
+        }
+    }
+}
+
+// 排队任务不超过预读窗口, 清单再长内存也只和窗口及正在进行的任务有关
+void DownloadManager::refillFromSource() {
+    while (!source_done_ && queued_ < kLookahead) {
+        auto next = source_();
+        if (!next) {
+            source_done_ = true;
+            break;
+        }
+
+        TaskEntry entry;
+        entry.host = detail::hostKey(next->url);
+        entry.url = std::move(next->url);
+        entry.filename = std::move(next->filename);
+        entry.priority = next->priority;
+        entry.make = std::move(next->make);
+        enqueue(std::move(entry));
+    }
+}
+
+// 排在优先级更低的排队任务之前, 同优先级保持读入顺序
+void DownloadManager::enqueue(TaskEntry entry) {
+    if (context_.budget) {
+        context_.budget->enqueue(entry.host);
+    }
+    ++queued_;
+    ++unreported_;
+
+    auto pos = tasks_.end();
+    while (pos != tasks_.begin()) {
+        const auto prev = std::prev(pos);
+        if (!prev->started && prev->priority >= entry.priority) {
+            break;
+        }
+        pos = prev;
+    }
+    tasks_.insert(pos, std::move(entry));
+}
+
+// 按顺序启动拿得到连接名额的任务; 某个主机满了不影响后面其他主机的任务
+void DownloadManager::launchPending() {
+    for (auto& entry : tasks_) {
+        if (queued_ == 0 || (max_active_ > 0 && running_ >= static_cast<std::size_t>(max_active_))) {
+            break;
+        }
+        if (entry.started) {
+            continue;
+        }
+        if (context_.budget && !context_.budget->tryReserve(entry.host)) {
+            continue;
+        }
+        launch(entry);
+    }
+    if (context_.budget) {
+        context_.budget->setStartableTasks(
+            max_active_ > 0 ? std::max(0, max_active_ - static_cast<int>(running_)) : -1);
+    }
+}
+
+// 返回 false 表示任务创建失败, 这时已标记为结束, 由 collectFinished 报告
+bool DownloadManager::launch(TaskEntry& entry) {
+    entry.started = true;
+    entry.started_at = std::chrono::steady_clock::now();
+    --queued_;
+    if (!entry.task && entry.make) {
+        entry.task = entry.make();
+    }
+    entry.make = nullptr;
+
+    if (!entry.task) {
+        // 归还刚预留的名额
+        if (context_.budget) {
+            context_.budget->acquireInitial(entry.host);
+            context_.budget->release(entry.host);
         }
+        entry.finished->store(true);
+        return false;
+    }
+
+    ++running_;
+    auto on_finished = [this, finished = entry.finished]() {
+        finished->store(true);
+        notifyChange();
+    };
+    // 事件驱动的任务立即返回, 不再占用线程; 其余任务仍各自使用一个线程
+    if (entry.task->startAsync(on_finished)) {
+        return true;
     }
-    threads_.clear();
+    entry.thread = std::thread([task = entry.task, on_finished]() {
+        task->start();
+        on_finished();
+    });
+    return true;
+}
+
+// 报告已结束的任务并回收线程; 清单模式下同时释放任务对象
+void DownloadManager::collectFinished() {
+    for (auto it = tasks_.begin(); it != tasks_.end();) {
+        auto& entry = *it;
+        if (!entry.started || entry.reported || !entry.finished->load()) {
+            ++it;
+            continue;
+        }
+
+        if (entry.thread.joinable()) {
+            entry.thread.join();
+        }
+        entry.reported = true;
+        if (entry.task) {
+            --running_;
+            report(entry, !entry.task->hasError(), entry.task->errorMessage());
+        } else {
+            report(entry, false, "Failed to create download task");
+        }
+
+        if (source_) {
+            it = tasks_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DownloadManager::report(TaskEntry& entry, bool ok, std::string error) {
+    ok ? ++succeeded_ : ++failed_;
+    --unreported_;
+    if (entry.task) {
+        entry.progress = entry.task->snapshot();
+    }
+    finished_total_ += entry.progress.total_bytes;
+    finished_downloaded_ += entry.progress.downloaded_bytes;
+
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - entry.started_at).count();
+    if (active_mode_ == ProgressMode::Plain) {
+        std::cout << fmt::format("task status={} bytes={} seconds={:.3f} file={}", ok ? "ok" : "failed",
+                                 entry.progress.downloaded_bytes, seconds, quoteValue(entry.filename));
+        if (!ok) {
+            std::cout << " error=" << quoteValue(error);
+        }
+        std::cout << '\n';
+    }
+    if (!on_result_) {
+        return;
+    }
+
+    TaskResult result;
+    result.url = entry.url;
+    result.filename = entry.filename;
+    result.ok = ok;
+    result.error = std::move(error);
+    result.bytes = entry.progress.downloaded_bytes;
+    result.seconds = seconds;
+    on_result_(result);
+}
+
+// 有连接释放或任务结束时提前醒来; 本轮检查之后才结束的任务不会被漏掉
+void DownloadManager::waitForChange(std::uint64_t seen_generation, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    if (context_.budget && queued_ > 0) {
+        if (wake_generation_ != seen_generation) {
+            return;
+        }
+        lock.unlock();
+        context_.budget->waitForRelease(timeout);
+        return;
+    }
+    wake_cv_.wait_for(lock, timeout, [&] { return wake_generation_ != seen_generation; });
+}
+
+void DownloadManager::notifyChange() {
+    if (context_.budget) {
+        context_.budget->wake();
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        ++wake_generation_;
+    }
+    wake_cv_.notify_all();
 }
 
 void DownloadManager::renderProgressLoop() {
-    std::size_t previous_lines = 0;
+    constexpr std::chrono::milliseconds kRefresh{200};
+    constexpr std::chrono::milliseconds kPlainInterval{1000};
+    active_mode_ = progress_mode_;
+    if (active_mode_ == ProgressMode::Auto && !isatty(STDOUT_FILENO)) {
+        active_mode_ = ProgressMode::Plain;
+    }
+    const auto interval = active_mode_ == ProgressMode::Plain ? kPlainInterval : kRefresh;
+    drawn_lines_.clear();
+
+    auto next_render = std::chrono::steady_clock::now();
     while (true) {
-        const auto panel = buildProgressPanel();
-        redrawPanel(panel, previous_lines);
+        std::uint64_t seen_generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            seen_generation = wake_generation_;
+        }
+        collectFinished();
+        refillFromSource();
+        launchPending();
 
-        if (!hasActiveTasks()) {
-            break;
+        const bool active = hasActiveTasks();
+        // 任务结束得很快时管理器醒得频繁, 面板仍按固定间隔刷新
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= next_render || !active) {
+            renderFrame();
+            next_render = now + interval;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (!active) {
+            break;
+        }
+        waitForChange(seen_generation, kRefresh);
     }
 
     std::cout << std::flush;
 }
 
-std::string DownloadManager::buildProgressPanel() const {
-    std::string panel;
-    panel.reserve(tasks_.size() * 128 + 256);
-    panel.append("==================================================\n");
-    panel += fmt::format("Download Manager ({} tasks)\n", tasks_.size());
-    panel.append("--------------------------------------------------\n");
+// 取一次所有进行中任务的快照, 更新各任务和总体的速率; 已结束的任务只用累加值
+void DownloadManager::sampleProgress() {
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds = progress_sampled_at_ == std::chrono::steady_clock::time_point{}
+                               ? 0.0
+                               : std::chrono::duration<double>(now - progress_sampled_at_).count();
+    progress_sampled_at_ = now;
 
-    std::uint64_t total_all = 0;
-    std::uint64_t downloaded_all = 0;
-
-    for (const auto& task : tasks_) {
-        if (!task) {
+    total_all_ = finished_total_;
+    downloaded_all_ = finished_downloaded_;
+    for (auto& entry : tasks_) {
+        if (!entry.started || entry.reported || !entry.task) {
             continue;
         }
+        const auto progress = entry.task->snapshot();
+        if (seconds > 0.0 && progress.downloaded_bytes >= entry.progress.downloaded_bytes) {
+            const double instant =
+                static_cast<double>(progress.downloaded_bytes - entry.progress.downloaded_bytes) / seconds;
+            entry.rate = entry.rate > 0.0 ? entry.rate * 0.7 + instant * 0.3 : instant;
+        }
+        entry.progress = progress;
+        total_all_ += progress.total_bytes;
+        downloaded_all_ += progress.downloaded_bytes;
+    }
+    updateRate(downloaded_all_);
+}
 
-        const auto progress = task->getProgress();
-        panel += formatTaskLine(progress);
-        panel.push_back('\n');
+void DownloadManager::renderFrame() {
+    // 面板除任务行外的固定行数
+    constexpr std::size_t kPanelChrome = 8;
 
-        total_all += progress.total_bytes;
-        downloaded_all += progress.downloaded_bytes;
+    sampleProgress();
+    switch (active_mode_) {
+    case ProgressMode::None:
+        return;
+    case ProgressMode::Plain:
+        std::cout << buildPlainLine() << std::endl;
+        return;
+    case ProgressMode::Full:
+        redrawPanel(buildProgressPanel(false));
+        return;
+    case ProgressMode::Compact:
+        redrawPanel(buildProgressPanel(true));
+        return;
+    case ProgressMode::Auto: {
+        // 任务行超出终端高度时光标回不到面板顶部, 只能改用汇总视图
+        const std::size_t task_lines = source_ ? running_ : tasks_.size();
+        redrawPanel(buildProgressPanel(task_lines + kPanelChrome > terminalRows()));
+        return;
+    }
     }
+}
 
-    panel.append("--------------------------------------------------\n");
-    if (total_all > 0) {
-        const double ratio = static_cast<double>(downloaded_all) / static_cast<double>(total_all);
-        panel += fmt::format("Overall: {:>3}%", static_cast<int>(ratio * 100.0));
-    } else {
-        panel.append("Overall: N/A");
+void DownloadManager::updateRate(std::uint64_t downloaded) {
+    const auto now = std::chrono::steady_clock::now();
+    if (rate_sampled_at_ == std::chrono::steady_clock::time_point{} || downloaded < rate_sampled_bytes_) {
+        rate_sampled_at_ = now;
+        rate_sampled_bytes_ = downloaded;
+        return;
     }
-    panel.push_back('\n');
-    panel.append("==================================================\n");
 
-    return panel;
+    const double seconds = std::chrono::duration<double>(now - rate_sampled_at_).count();
+    if (seconds < 0.1) {
+        return;
+    }
+    const double instant = static_cast<double>(downloaded - rate_sampled_bytes_) / seconds;
+    rate_ = rate_ > 0.0 ? rate_ * 0.7 + instant * 0.3 : instant;
+    rate_sampled_at_ = now;
+    rate_sampled_bytes_ = downloaded;
 }
 
-std::string DownloadManager::formatTaskLine(const Progress& progress) {
-    std::string line;
-    line.reserve(256);
+std::vector<std::string> DownloadManager::buildProgressPanel(bool compact) {
+    static const std::string kDoubleRule(50, '=');
+    static const std::string kRule(50, '-');
 
-        std::string display_name;
-        if (!progress.filename.empty()) {
-            std::filesystem::path path{progress.filename};
-            display_name = path.filename().string();
+    std::vector<std::string> lines;
+    lines.reserve(compact ? top_k_ + 10 : tasks_.size() + 10);
+    lines.push_back(kDoubleRule);
+    std::string header;
+    if (source_ || compact) {
+        // 清单模式和汇总视图只显示正在进行的任务
+        header = fmt::format("Download Manager ({} done, {} failed, {} running, {}{} queued",
+                             succeeded_, failed_, running_, queued_, source_done_ ? "" : "+");
+    } else {
+        header = fmt::format("Download Manager ({} tasks, {} queued", tasks_.size(), queued_);
+    }
+    if (context_.budget) {
+        const int limit = context_.budget->maxTotal();
+        header += fmt::format(", connections {}/{}", context_.budget->inUse(),
+                              limit > 0 ? std::to_string(limit) : std::string{"unlimited"});
+    }
+    header.push_back(')');
+    lines.push_back(std::move(header));
+    lines.push_back(kRule);
+
+    const auto task_line = [](const TaskEntry& entry) {
+        return formatTaskLine(entry.filename, entry.progress,
+                              entry.progress.has_error ? entry.task->errorMessage() : std::string{});
+    };
+
+    if (compact) {
+        std::vector<const TaskEntry*> running;
+        running.reserve(running_);
+        for (const auto& entry : tasks_) {
+            if (entry.started && !entry.reported && entry.task) {
+                running.push_back(&entry);
+            }
         }
-        if (display_name.empty()) {
-            display_name = progress.filename;
+
+        // 预计最晚完成的排在前面, 大小未知的排在最后; 相同时按启动顺序, 避免相邻两帧来回交换
+        const auto remaining_seconds = [](const TaskEntry* entry) {
+            const auto& progress = entry->progress;
+            if (progress.total_bytes == 0) {
+                return -1.0;
+            }
+            const auto left = progress.total_bytes - std::min(progress.total_bytes, progress.downloaded_bytes);
+            return static_cast<double>(left) / std::max(entry->rate, 1.0);
+        };
+        const std::size_t shown = std::min(top_k_, running.size());
+        std::partial_sort(running.begin(), running.begin() + static_cast<std::ptrdiff_t>(shown), running.end(),
+                          [&](const TaskEntry* a, const TaskEntry* b) {
+                              const double ra = remaining_seconds(a);
+                              const double rb = remaining_seconds(b);
+                              return ra != rb ? ra > rb : a->started_at < b->started_at;
+                          });
+        if (shown < running.size()) {
+            lines.push_back(fmt::format("Slowest {} of {} running tasks:", shown, running.size()));
         }
-        if (display_name.size() > 20) {
-            display_name = display_name.substr(0, 20);
+        for (std::size_t i = 0; i < shown; ++i) {
+            lines.push_back(task_line(*running[i]) + fmt::format("  {}/s", formatSize(static_cast<std::uint64_t>(running[i]->rate))));
         }
-        if (display_name.empty()) {
-            display_name = "(unnamed)";
+    } else {
+        for (const auto& entry : tasks_) {
+            if (!entry.started) {
+                if (!source_) {
+                    lines.push_back(fmt::format("{:<20} [Queued]", displayName(entry.filename)));
+                }
+                continue;
+            }
+            if (entry.task) {
+                lines.push_back(task_line(entry));
+            }
         }
+    }
+
+    lines.push_back(kRule);
+    std::string overall;
+    if (total_all_ > 0) {
+        const double ratio = static_cast<double>(downloaded_all_) / static_cast<double>(total_all_);
+        overall = fmt::format("Overall: {:>3}%", static_cast<int>(ratio * 100.0));
+    } else {
+        overall = "Overall: N/A";
+    }
+    overall += fmt::format("  {}/s", formatSize(static_cast<std::uint64_t>(rate_)));
+    if (context_.rate_limiter) {
+        overall += fmt::format(" (limit {}/s)", formatSize(context_.rate_limiter->rate()));
+    }
+    if (total_all_ > downloaded_all_ && rate_ >= 1.0) {
+        overall += "  ETA " + formatDuration(static_cast<double>(total_all_ - downloaded_all_) / rate_);
+    }
+    if (compact) {
+        overall += fmt::format("  ({} / {})", formatSize(downloaded_all_), formatSize(total_all_));
+    }
+    lines.push_back(std::move(overall));
+    if (context_.handles) {
+        lines.push_back(formatPoolStats(context_.handles->stats()));
+    }
+    lines.push_back(kDoubleRule);
+    return lines;
+}
+
+// 一行 key=value, 便于日志采集; 大小未知时 eta 为 -1
+std::string DownloadManager::buildPlainLine() const {
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_started_at_).count();
+    const double eta = total_all_ > downloaded_all_ && rate_ >= 1.0
+                           ? static_cast<double>(total_all_ - downloaded_all_) / rate_
+                           : (total_all_ > 0 && total_all_ == downloaded_all_ ? 0.0 : -1.0);
+    return fmt::format("progress elapsed={:.1f} done={} failed={} running={} queued={} bytes={} total={} "
+                       "rate={} eta={:.0f}",
+                       elapsed, succeeded_, failed_, running_, queued_, downloaded_all_, total_all_,
+                       static_cast<std::uint64_t>(rate_), eta);
+}
+
+std::string DownloadManager::formatTaskLine(const std::string& filename,
+                                            const ProgressSnapshot& progress,
+                                            const std::string& error_message) {
+    std::string line;
+    line.reserve(256);
+
+    const std::string display_name = displayName(filename);
 
     if (progress.total_bytes > 0) {
         const double ratio = static_cast<double>(progress.downloaded_bytes) /
@@ -115,11 +520,27 @@ std::string DownloadManager::formatTaskLine(const Progress& progress) {
         constexpr int bar_width = 30;
         const int bar_pos = static_cast<int>(ratio * bar_width);
 
+        // 两种字符各预先拼好一整条, 按比例各取一段
+        static const std::string kFilled = [] {
+            std::string bar;
+            for (int i = 0; i < bar_width; ++i) {
+                bar += u8"█";
+            }
+            return bar;
+        }();
+        static const std::string kEmpty = [] {
+            std::string bar;
+            for (int i = 0; i < bar_width; ++i) {
+                bar += u8"░";
+            }
+            return bar;
+        }();
+        const std::size_t filled = static_cast<std::size_t>(std::clamp(bar_pos, 0, bar_width));
+        const std::size_t empty = static_cast<std::size_t>(bar_width) - filled;
         std::string bar;
-        bar.reserve(static_cast<std::size_t>(bar_width) * 3);
-        for (int i = 0; i < bar_width; ++i) {
-            bar += (i < bar_pos) ? u8"█" : u8"░";
-        }
+        bar.reserve(kFilled.size());
+        bar.append(kFilled, 0, filled * (kFilled.size() / bar_width));
+        bar.append(kEmpty, 0, empty * (kEmpty.size() / bar_width));
 
             line += fmt::format("{:<20} [{}] {:>3}% ({}/{})",
                                 display_name,
@@ -129,7 +550,7 @@ std::string DownloadManager::formatTaskLine(const Progress& progress) {
                             formatSize(progress.total_bytes));
 
         if (progress.has_error) {
-            line += fmt::format("  ❌ {}", progress.error_message);
+            line += fmt::format("  ❌ {}", error_message);
         } else if (!progress.is_running) {
             line.append("  ✅ Done");
         }
@@ -140,6 +561,47 @@ std::string DownloadManager::formatTaskLine(const Progress& progress) {
     return line;
 }
 
+std::string DownloadManager::formatPoolStats(const detail::CurlHandlePool::Stats& stats) {
+    const auto percent = [](std::uint64_t hits, std::uint64_t misses) {
+        const auto total = hits + misses;
+        return total > 0 ? static_cast<int>(hits * 100 / total) : 0;
+    };
+    return fmt::format("Reuse: connections {}/{} ({}%), handles {}/{} ({}%)",
+                       stats.connections_reused, stats.connections_reused + stats.connections_new,
+                       percent(stats.connections_reused, stats.connections_new),
+                       stats.handles_reused, stats.handles_reused + stats.handles_created,
+                       percent(stats.handles_reused, stats.handles_created));
+}
+
+std::string DownloadManager::formatDuration(double seconds) {
+    const auto total = static_cast<std::uint64_t>(seconds + 0.5);
+    if (total < 60) {
+        return fmt::format("{}s", total);
+    }
+    if (total < 3600) {
+        return fmt::format("{}m{:02}s", total / 60, total % 60);
+    }
+    return fmt::format("{}h{:02}m", total / 3600, total % 3600 / 60);
+}
+
+std::string DownloadManager::displayName(const std::string& filename) {
+    std::string display_name;
+    if (!filename.empty()) {
+        std::filesystem::path path{filename};
+        display_name = path.filename().string();
+    }
+    if (display_name.empty()) {
+        display_name = filename;
+    }
+    if (display_name.size() > 20) {
+        display_name = display_name.substr(0, 20);
+    }
+    if (display_name.empty()) {
+        display_name = "(unnamed)";
+    }
+    return display_name;
+}
+
 std::string DownloadManager::formatSize(std::uint64_t bytes) {
     constexpr double KB = 1024.0;
     constexpr double MB = KB * 1024.0;
@@ -157,41 +619,51 @@ std::string DownloadManager::formatSize(std::uint64_t bytes) {
     }
 }
 
+// 清单还没读完、排队中和还没报告结果的任务都算活跃; 以任务自己的结束通知为准, 不依赖进度快照
 bool DownloadManager::hasActiveTasks() const {
-    for (const auto& task : tasks_) {
-        if (!task) {
-            continue;
-        }
+    return !source_done_ || unreported_ > 0;
+}
 
-        const auto progress = task->getProgress();
-        if (progress.has_error) {
+// 光标移到第一处变化的行, 之后没变的行直接跳过, 整帧拼好后一次写出
+void DownloadManager::redrawPanel(const std::vector<std::string>& lines) {
+    std::size_t first = 0;
+    while (first < lines.size() && first < drawn_lines_.size() && lines[first] == drawn_lines_[first]) {
+        ++first;
+    }
+    if (first == lines.size() && first == drawn_lines_.size()) {
+        return;
+    }
+
+    std::string out;
+    if (drawn_lines_.size() > first) {
+        out += fmt::format("\033[{}F", drawn_lines_.size() - first);
+    }
+    for (std::size_t i = first; i < lines.size(); ++i) {
+        if (i < drawn_lines_.size() && lines[i] == drawn_lines_[i]) {
+            out.append("\033[1E");
             continue;
         }
-        if (progress.is_running) {
-            return true;
-        }
-        if (progress.total_bytes > 0 && progress.downloaded_bytes < progress.total_bytes) {
-            return true;
-        }
+        out.append("\033[2K");
+        out.append(lines[i]);
+        out.push_back('\n');
     }
-    return false;
-}
-
-void DownloadManager::redrawPanel(const std::string& panel, std::size_t& previous_lines) {
-    const std::size_t current_lines = static_cast<std::size_t>(std::count(panel.begin(), panel.end(), '\n'));
-    if (previous_lines > 0) {
-        std::cout << "\033[" << previous_lines << "F\033[J";
+    if (drawn_lines_.size() > lines.size()) {
+        out.append("\033[J");
     }
-    std::cout << panel;
-    previous_lines = current_lines;
+    std::cout << out << std::flush;
+    drawn_lines_ = lines;
 }
 
 void DownloadManager::printError() const{
-    for (const auto& task : tasks_) {
-        const auto progress = task->getProgress();
-        if (progress.has_error) {
-            fmt::print("[ERROR] {}: {}\n", progress.filename, progress.error_message);
+    for (const auto& entry : tasks_) {
+        const auto& task = entry.task;
+        if (task && task->hasError()) {
+            fmt::print("[ERROR] {}: {}\n", task->filename(), task->errorMessage());
         }
     }
+    // 清单模式下结束的任务已经释放, 错误详情在结果文件里
+    if (source_ && failed_ > 0) {
+        fmt::print("[ERROR] {} of {} tasks failed\n", failed_, failed_ + succeeded_);
+    }
 }
 } // namespace downloader
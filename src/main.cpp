@@ -1,33 +1,193 @@
 #include "downloader/download_manager.hpp"
 #include "downloader/multi_downloader.hpp"
+#include "downloader/detail/checksum.hpp"
+#include "downloader/detail/concurrency_tuner.hpp"
+#include "downloader/detail/connection_budget.hpp"
+#include "downloader/detail/curl_handle_pool.hpp"
+#include "downloader/detail/curl_multi_engine.hpp"
+#include "downloader/detail/download_cache.hpp"
+#include "downloader/detail/manifest_reader.hpp"
+#include "downloader/detail/rate_limiter.hpp"
+#include "downloader/detail/transfer_metrics.hpp"
+#include "downloader/detail/write_behind.hpp"
 #include "downloader/detail/curl_utils.hpp"
 
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <utility>
 
+#include <unistd.h>
+
 
 namespace {
 void printUsage(const char* programName) {
     std::cerr << "Usage: " << programName
-              << " [-d <directory>] [-t <threads>] <url1> <file1> [<url2> <file2> ...]"
+              << " [-d <directory>] [-t <threads>] [-e <loops>] <url1> <file1> [<url2> <file2> ...]\n"
+              << "       " << programName << " [options] -i <manifest|->\n"
+              << "       " << programName << " [options] -o - <url>"
               << std::endl;
     std::cerr << "Options:\n"
               << "  -d <directory>   Set download directory (default: current directory)\n"
-              << "  -t <threads>     Number of threads per download task (default: 8)\n"
+              << "  -t <threads>     Number of threads per download task (default: 8), or \"auto\" to\n"
+              << "                   tune it per host from measured throughput\n"
+              << "  -e <loops>       Drive all transfers from <loops> curl_multi event-loop threads\n"
+              << "                   instead of one thread per range (default: off)\n"
+              << "  --min-chunk <size>  Smallest range handed out or split off (default: 512K)\n"
+              << "  --max-chunk <size>  Largest range handed out at once (default: 32M)\n"
+              << "  --split-threshold <size>  Fewest bytes per range connection; when the rest of a file\n"
+              << "                   after the first request is no larger, it is fetched with one more\n"
+              << "                   request, 0 = split down to --min-chunk (default: 1M)\n"
+              << "  --max-ranges <n> Parallel range requests per file, 0 = only limited by -t (default: 0)\n"
+              << "  --no-endgame     Do not re-request the last straggling range in parallel\n"
+              << "  --retries <n>    Retries per range before the task fails (default: 5)\n"
+              << "  --retry-delay <ms>  Initial retry backoff, doubled per attempt with jitter (default: 500)\n"
+              << "  --stall-time <s>    Retry a connection that stays below 1 KB/s this long, 0 = off (default: 30)\n"
+              << "  --no-resume      Ignore and do not write the <file>.mdown resume journal\n"
+              << "  --max-connections <n>  Connections shared by all tasks, extra tasks wait in a queue,\n"
+              << "                   0 = unlimited (default: 64)\n"
+              << "  --max-per-host <n>     Connections per host across all tasks, 0 = unlimited (default: 0)\n"
+              << "  --limit-rate <size>  Bandwidth cap per second shared by all tasks, e.g. 200M (default: off)\n"
+              << "  --limit-rate-per-task <size>  Bandwidth cap per second for each task (default: off)\n"
+              << "  --write-buffer <size>  Memory for write-behind buffers flushed by writer threads,\n"
+              << "                   0 = write directly from the network threads (default: 64M)\n"
+              << "  --writer-threads <n>   Threads flushing write-behind buffers (default: 1)\n"
+              << "  --direct-io      Flush aligned parts of write-behind buffers with O_DIRECT\n"
+              << "  --checksum <algo:hex>  Verify the download while it arrives; algo is sha256, crc32c\n"
+              << "                   or xxh3 (single URL only)\n"
+              << "  --mirror <url>   Another URL serving the same file; ranges are spread over all\n"
+              << "                   sources by measured speed, failing ones are dropped (repeatable,\n"
+              << "                   single URL only)\n"
+              << "  --mmap           Copy range data straight into a shared mapping of the output file\n"
+              << "                   (falls back to writes when the size is unknown)\n"
+              << "  --io-backend <pwrite|io_uring>\n"
+              << "                   How write-behind buffers reach the disk (default: pwrite);\n"
+              << "                   io_uring falls back to pwrite when the kernel lacks it\n"
+              << "  --http2          Ask for HTTP/2 (ALPN for https, Upgrade: h2c for http) and run the\n"
+              << "                   ranges of each host as streams over shared connections; falls back\n"
+              << "                   to one HTTP/1.1 connection per range (implies -e 1 unless -e is given)\n"
+              << "  --http2-prior-knowledge  Like --http2, but speak HTTP/2 to http URLs right away\n"
+              << "  -o -             Stream the single URL to standard output in file order (e.g. into tar);\n"
+              << "                   ranges are still fetched in parallel, progress goes to stderr\n"
+              << "  --reorder-buffer <size>  Memory for out-of-order ranges with -o -; ranges further\n"
+              << "                   ahead wait until the output catches up (default: 64M)\n"
+              << "  --cache-dir <dir>  Keep downloaded files in <dir> by URL and revalidate them with\n"
+              << "                   If-None-Match/If-Modified-Since; unchanged files are reflinked or copied\n"
+              << "                   from the cache instead of downloaded (not with -o -)\n"
+              << "  --no-pool        Do not reuse curl handles, connections, DNS and TLS sessions across\n"
+              << "                   requests and tasks\n"
+              << "  -i <manifest|->  Read \"<url> <file> [key=value ...]\" lines from a file or stdin instead of\n"
+              << "                   the command line; keys: size, checksum, priority, limit-rate,\n"
+              << "                   mirror (repeatable)\n"
+              << "  --results <file> Append one tab-separated line per finished task (default with -i:\n"
+              << "                   <manifest>.results, or mdown-results.tsv for stdin)\n"
+              << "  --max-tasks <n>  Tasks downloading at the same time, 0 = unlimited\n"
+              << "                   (default: 64 with -i, otherwise 0)\n"
+              << "  --progress <auto|full|compact|plain|none>\n"
+              << "                   full: one line per task; compact: totals, ETA and the slowest tasks;\n"
+              << "                   plain: periodic key=value lines without cursor movement; auto picks\n"
+              << "                   full or compact on a terminal and plain otherwise (default: auto)\n"
+              << "  --top <n>        Tasks listed by the compact view (default: 10)\n"
+              << "  --stats-file <file>    Periodically write per-host request metrics (DNS, connect, TLS,\n"
+              << "                   time to first byte, transfer time, bytes, speed, retries) as JSON\n"
+              << "  --stats-interval <s>   How often --stats-file is rewritten (default: 5)\n"
+              << "  --metrics-port <port>  Serve the same metrics on 127.0.0.1:<port>/metrics in the\n"
+              << "                   Prometheus text format (and /stats.json)\n"
               << "  -h, --help       Show this message" << std::endl;
 }
+
+// 解析 "4096", "512K", "32M", "1G" 这样的大小(按 1024 进位)
+std::uint64_t parseSize(const std::string& text) {
+    std::size_t consumed = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(text, &consumed);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid size: " + text);
+    }
+
+    const std::string suffix = text.substr(consumed);
+    std::uint64_t unit = 1;
+    if (suffix.empty() || suffix == "B" || suffix == "b") {
+        unit = 1;
+    } else if (suffix == "K" || suffix == "k") {
+        unit = 1024ULL;
+    } else if (suffix == "M" || suffix == "m") {
+        unit = 1024ULL * 1024;
+    } else if (suffix == "G" || suffix == "g") {
+        unit = 1024ULL * 1024 * 1024;
+    } else {
+        throw std::runtime_error("Invalid size: " + text);
+    }
+    return static_cast<std::uint64_t>(value) * unit;
+}
+
+// 把清单行上的 key=value 应用到该任务的选项上, 出错时返回原因
+std::string applyManifestAttributes(const downloader::detail::ManifestReader::Entry& entry,
+                                    downloader::DownloadOptions& options, int& priority) {
+    for (const auto& [key, value] : entry.attributes) {
+        try {
+            if (key == "size") {
+                options.expected_size = parseSize(value);
+            } else if (key == "checksum") {
+                std::string error;
+                if (!downloader::detail::Checksum::parse(value, &error)) {
+                    return error;
+                }
+                options.checksum = value;
+            } else if (key == "priority") {
+                priority = std::stoi(value);
+            } else if (key == "limit-rate") {
+                options.limit_rate = parseSize(value);
+            } else if (key == "mirror") {
+                if (value.empty()) {
+                    return "empty mirror URL";
+                }
+                options.mirrors.push_back(value);
+            } else {
+                return "unknown key: " + key;
+            }
+        } catch (const std::exception&) {
+            return "invalid value for " + key + ": " + value;
+        }
+    }
+    return {};
+}
 } // namespace
 
 int main(int argc, char** argv) {
     try {
         downloader::detail::ensureCurlInitialized();
-        int threads = 8;      //默认线程数
+        downloader::DownloadOptions options;   //默认 8 线程
+        int engine_loops = 0; //为0时使用每个分片一个线程的模式
+        int max_connections = 64;  // 所有任务共享的连接上限, 0 表示不限制
+        int max_per_host = 0;
+        bool use_pool = true;   // 默认在所有任务间复用句柄、连接、DNS 与 TLS 会话
+        std::uint64_t limit_rate = 0;   // 所有任务共享的带宽上限, 0 表示不限
+        std::uint64_t write_buffer = 64ULL * 1024 * 1024;   // 写入流水线的缓冲区总量, 0 表示不用
+        int writer_threads = 1;
+        auto io_backend = downloader::detail::WriteBehind::Backend::Pwrite;
         std::filesystem::path download_dir = std::filesystem::current_path();   // 默认下载路径为当前路径下
+        std::string manifest_path;   // -i 指定的清单, "-" 表示标准输入
+        bool stream_output = false;  // -o -: 唯一的 URL 按顺序写到标准输出
+        std::string results_path;
+        std::string cache_dir;
+        int max_tasks = -1;   // -1 表示按模式取默认值
+        auto progress_mode = downloader::DownloadManager::ProgressMode::Auto;
+        std::size_t top_k = 10;
+        std::string stats_file;
+        long stats_interval = 5;
+        int metrics_port = 0;   // 0 表示不开放端口
         int arg_index = 1;
 
         while (arg_index < argc && argv[arg_index][0] == '-') {
@@ -53,17 +213,312 @@ int main(int argc, char** argv) {
                     return 1;
                 }
 
+                if (std::string(argv[arg_index + 1]) == "auto") {
+                    options.thread_count = 0;
+                    arg_index += 2;
+                    continue;
+                }
+
                 try {
-                    threads = std::stoi(argv[arg_index + 1]);
+                    options.thread_count = std::stoi(argv[arg_index + 1]);
                 } catch (const std::exception&) {
                     throw std::runtime_error("Invalid thread count: " + std::string(argv[arg_index + 1]));
                 }
 
-                if (threads <= 0 || threads > 65) {
+                if (options.thread_count <= 0 || options.thread_count > 65) {
                     throw std::runtime_error("Thread count is invalid.");
                 }
 
                 arg_index += 2;
+            } else if (option == "-e") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                try {
+                    engine_loops = std::stoi(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid event loop count: " + std::string(argv[arg_index + 1]));
+                }
+
+                if (engine_loops <= 0 || engine_loops > 64) {
+                    throw std::runtime_error("Event loop count is invalid.");
+                }
+
+                arg_index += 2;
+            } else if (option == "--min-chunk" || option == "--max-chunk") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                const std::uint64_t size = parseSize(argv[arg_index + 1]);
+                if (size == 0) {
+                    throw std::runtime_error("Chunk size must be positive.");
+                }
+                (option == "--min-chunk" ? options.min_chunk_size : options.max_chunk_size) = size;
+                arg_index += 2;
+            } else if (option == "--split-threshold") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                options.split_threshold = parseSize(argv[arg_index + 1]);
+                arg_index += 2;
+            } else if (option == "--limit-rate" || option == "--limit-rate-per-task") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                const std::uint64_t rate = parseSize(argv[arg_index + 1]);
+                if (rate == 0) {
+                    throw std::runtime_error("Rate limit must be positive.");
+                }
+                (option == "--limit-rate" ? limit_rate : options.limit_rate) = rate;
+                arg_index += 2;
+            } else if (option == "-o") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                if (std::string(argv[arg_index + 1]) != "-") {
+                    throw std::runtime_error("-o only supports \"-\" (standard output), give files as <url> <file> pairs.");
+                }
+                stream_output = true;
+                arg_index += 2;
+            } else if (option == "--reorder-buffer") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                options.reorder_window = parseSize(argv[arg_index + 1]);
+                if (options.reorder_window == 0) {
+                    throw std::runtime_error("Reorder buffer must be positive.");
+                }
+                arg_index += 2;
+            } else if (option == "--write-buffer") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                write_buffer = parseSize(argv[arg_index + 1]);
+                arg_index += 2;
+            } else if (option == "--writer-threads") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                try {
+                    writer_threads = std::stoi(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid writer thread count: " + std::string(argv[arg_index + 1]));
+                }
+                if (writer_threads <= 0 || writer_threads > 64) {
+                    throw std::runtime_error("Writer thread count is invalid.");
+                }
+                arg_index += 2;
+            } else if (option == "--io-backend") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                const std::string value = argv[arg_index + 1];
+                if (value == "pwrite") {
+                    io_backend = downloader::detail::WriteBehind::Backend::Pwrite;
+                } else if (value == "io_uring") {
+                    io_backend = downloader::detail::WriteBehind::Backend::IoUring;
+                } else {
+                    throw std::runtime_error("Unknown I/O backend: " + value);
+                }
+                arg_index += 2;
+            } else if (option == "--checksum") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                std::string error;
+                if (!downloader::detail::Checksum::parse(argv[arg_index + 1], &error)) {
+                    throw std::runtime_error(error);
+                }
+                options.checksum = argv[arg_index + 1];
+                arg_index += 2;
+            } else if (option == "--mirror") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                options.mirrors.emplace_back(argv[arg_index + 1]);
+                arg_index += 2;
+            } else if (option == "-i" || option == "--results" || option == "--cache-dir") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                (option == "-i" ? manifest_path : option == "--results" ? results_path : cache_dir) =
+                    argv[arg_index + 1];
+                arg_index += 2;
+            } else if (option == "--max-tasks") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                try {
+                    max_tasks = std::stoi(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid task count: " + std::string(argv[arg_index + 1]));
+                }
+                if (max_tasks < 0) {
+                    throw std::runtime_error("Value for --max-tasks must not be negative.");
+                }
+                arg_index += 2;
+            } else if (option == "--progress") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                using Mode = downloader::DownloadManager::ProgressMode;
+                const std::string value = argv[arg_index + 1];
+                if (value == "auto") {
+                    progress_mode = Mode::Auto;
+                } else if (value == "full") {
+                    progress_mode = Mode::Full;
+                } else if (value == "compact") {
+                    progress_mode = Mode::Compact;
+                } else if (value == "plain") {
+                    progress_mode = Mode::Plain;
+                } else if (value == "none") {
+                    progress_mode = Mode::None;
+                } else {
+                    throw std::runtime_error("Unknown progress mode: " + value);
+                }
+                arg_index += 2;
+            } else if (option == "--top") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                int value = 0;
+                try {
+                    value = std::stoi(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid value for --top: " + std::string(argv[arg_index + 1]));
+                }
+                if (value < 0) {
+                    throw std::runtime_error("Value for --top must not be negative.");
+                }
+                top_k = static_cast<std::size_t>(value);
+                arg_index += 2;
+            } else if (option == "--stats-file") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                stats_file = argv[arg_index + 1];
+                arg_index += 2;
+            } else if (option == "--stats-interval" || option == "--metrics-port") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                long value = 0;
+                try {
+                    value = std::stol(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid value for " + option + ": " + argv[arg_index + 1]);
+                }
+                if (option == "--stats-interval") {
+                    if (value <= 0) {
+                        throw std::runtime_error("Value for --stats-interval must be positive.");
+                    }
+                    stats_interval = value;
+                } else {
+                    if (value <= 0 || value > 65535) {
+                        throw std::runtime_error("Value for --metrics-port must be a TCP port.");
+                    }
+                    metrics_port = static_cast<int>(value);
+                }
+                arg_index += 2;
+            } else if (option == "--mmap") {
+                options.mmap_output = true;
+                arg_index += 1;
+            } else if (option == "--direct-io") {
+                options.direct_io = true;
+                arg_index += 1;
+            } else if (option == "--no-endgame") {
+                options.endgame = false;
+                arg_index += 1;
+            } else if (option == "--retries" || option == "--retry-delay" || option == "--stall-time") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                long value = 0;
+                try {
+                    value = std::stol(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid value for " + option + ": " + argv[arg_index + 1]);
+                }
+                if (value < 0) {
+                    throw std::runtime_error("Value for " + option + " must not be negative.");
+                }
+
+                if (option == "--retries") {
+                    options.max_retries = static_cast<int>(value);
+                } else if (option == "--retry-delay") {
+                    options.retry_base_delay_ms = static_cast<std::uint64_t>(value);
+                } else {
+                    options.low_speed_time = value;
+                }
+                arg_index += 2;
+            } else if (option == "--max-connections" || option == "--max-per-host" || option == "--max-ranges") {
+                if (arg_index + 1 >= argc) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+
+                int value = 0;
+                try {
+                    value = std::stoi(argv[arg_index + 1]);
+                } catch (const std::exception&) {
+                    throw std::runtime_error("Invalid value for " + option + ": " + argv[arg_index + 1]);
+                }
+                if (value < 0) {
+                    throw std::runtime_error("Value for " + option + " must not be negative.");
+                }
+
+                if (option == "--max-ranges") {
+                    options.max_ranges = value;
+                } else {
+                    (option == "--max-connections" ? max_connections : max_per_host) = value;
+                }
+                arg_index += 2;
+            } else if (option == "--http2" || option == "--http2-prior-knowledge") {
+                options.http_version = option == "--http2" ? downloader::HttpVersion::Http2
+                                                           : downloader::HttpVersion::Http2PriorKnowledge;
+                arg_index += 1;
+            } else if (option == "--no-pool") {
+                use_pool = false;
+                arg_index += 1;
+            } else if (option == "--no-resume") {
+                options.resume = false;
+                arg_index += 1;
             } else if (option == "-h" || option == "--help") {
                 printUsage(argv[0]);
                 return 0;
@@ -73,25 +528,185 @@ int main(int argc, char** argv) {
             }
         }
 
-        if (argc - arg_index < 2 || (argc - arg_index) % 2 != 0) {
+        if (options.min_chunk_size > options.max_chunk_size) {
+            throw std::runtime_error("--min-chunk must not exceed --max-chunk.");
+        }
+
+        const bool use_manifest = !manifest_path.empty();
+        const int positional = argc - arg_index;
+        if (use_manifest && stream_output) {
+            throw std::runtime_error("-o - streams a single URL and cannot be combined with -i.");
+        }
+        if (use_manifest ? positional != 0
+                         : stream_output ? positional != 1 : (positional < 2 || positional % 2 != 0)) {
             printUsage(argv[0]);
             return 1;
         }
+        const bool single_url = stream_output ? positional == 1 : positional == 2;
+        if (!options.checksum.empty() && (use_manifest || !single_url)) {
+            throw std::runtime_error("--checksum applies to a single URL, use checksum= in the manifest instead.");
+        }
+        if (!options.mirrors.empty() && (use_manifest || !single_url)) {
+            throw std::runtime_error("--mirror applies to a single URL, use mirror= in the manifest instead.");
+        }
+
+        std::ifstream manifest_file;
+        if (use_manifest && manifest_path != "-") {
+            manifest_file.open(manifest_path);
+            if (!manifest_file) {
+                throw std::runtime_error("Failed to open manifest: " + manifest_path);
+            }
+        }
+        if (use_manifest && results_path.empty()) {
+            results_path = manifest_path == "-" ? "mdown-results.tsv" : manifest_path + ".results";
+        }
+        std::ofstream results;
+        if (!results_path.empty()) {
+            results.open(results_path, std::ios::app);
+            if (!results) {
+                throw std::runtime_error("Failed to open results file: " + results_path);
+            }
+        }
+
+        // 流只能在同一个 curl_multi 里复用连接, HTTP/2 模式没给 -e 时用一个事件循环
+        if (options.http_version != downloader::HttpVersion::Default && engine_loops == 0) {
+            engine_loops = 1;
+        }
+
+        downloader::detail::TransferContext context;
+        if (engine_loops > 0) {
+            context.engine = std::make_shared<downloader::detail::CurlMultiEngine>(engine_loops);
+        }
+        if (max_connections > 0 || max_per_host > 0) {
+            context.budget = std::make_shared<downloader::detail::ConnectionBudget>(max_connections, max_per_host);
+        }
+        if (use_pool) {
+            context.handles = std::make_shared<downloader::detail::CurlHandlePool>();
+        }
+        if (options.thread_count == 0) {
+            context.tuner = std::make_shared<downloader::detail::ConcurrencyTuner>();
+        }
+        if (!cache_dir.empty()) {
+            context.cache = std::make_shared<downloader::detail::DownloadCache>(cache_dir);
+            std::string error;
+            if (!context.cache->open(error)) {
+                throw std::runtime_error(error);
+            }
+        }
+        if (limit_rate > 0) {
+            context.rate_limiter = std::make_shared<downloader::detail::RateLimiter>(limit_rate);
+        }
+        if (write_buffer > 0 && !stream_output) {
+            // 单个缓冲区 1M, 预算很小时缩小缓冲区, 保证至少有几个可以轮换
+            constexpr std::uint64_t kBufferSize = 1024 * 1024;
+            const std::uint64_t buffer_size = std::min(kBufferSize, std::max<std::uint64_t>(write_buffer / 4, 1));
+            context.writer = std::make_shared<downloader::detail::WriteBehind>(
+                static_cast<std::size_t>(buffer_size), static_cast<std::size_t>(write_buffer), writer_threads,
+                io_backend);
+            if (context.writer->backend() != io_backend) {
+                std::cerr << "io_uring is not available, falling back to pwrite" << std::endl;
+            }
+        } else if (io_backend != downloader::detail::WriteBehind::Backend::Pwrite) {
+            throw std::runtime_error("--io-backend io_uring requires --write-buffer");
+        }
+
+        std::unique_ptr<downloader::detail::MetricsExporter> exporter;
+        if (!stats_file.empty() || metrics_port > 0) {
+            context.metrics = std::make_shared<downloader::detail::TransferMetrics>();
+            exporter = std::make_unique<downloader::detail::MetricsExporter>(context.metrics);
+            std::string error;
+            if (metrics_port > 0 && !exporter->listen(static_cast<std::uint16_t>(metrics_port), error)) {
+                throw std::runtime_error(error);
+            }
+            if (!stats_file.empty()) {
+                exporter->writeFile(stats_file, std::chrono::seconds{stats_interval});
+            }
+            exporter->start();
+        }
+
+        // 数据写到原来的标准输出, 进度面板和错误信息改写到标准错误, 不会混进数据里
+        if (stream_output) {
+            std::cout.flush();
+            options.stream_fd = ::dup(STDOUT_FILENO);
+            if (options.stream_fd < 0 || ::dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+                throw std::runtime_error("Cannot redirect standard output");
+            }
+        }
 
         //初始化下载管理器，添加任务
-        downloader::DownloadManager manager;
-        for (int i = arg_index; i < argc; i += 2) {
+        downloader::DownloadManager manager(context);
+        manager.setMaxActiveTasks(max_tasks >= 0 ? max_tasks : (use_manifest ? 64 : 0));
+        manager.setProgressMode(progress_mode, top_k);
+
+        // 结果文件每行: ok|failed <TAB> url <TAB> 文件 <TAB> 字节数 <TAB> 秒数 <TAB> 错误
+        std::size_t invalid_entries = 0;
+        const auto write_result = [&results](const downloader::TaskResult& result) {
+            if (!results.is_open()) {
+                return;
+            }
+            results << (result.ok ? "ok" : "failed") << '\t' << result.url << '\t' << result.filename << '\t'
+                    << result.bytes << '\t' << fmt::format("{:.3f}", result.seconds) << '\t' << result.error
+                    << std::endl;
+        };
+        manager.setResultCallback(write_result);
+
+        downloader::detail::ManifestReader reader(manifest_path == "-" ? std::cin : manifest_file);
+        if (use_manifest) {
+            manager.setTaskSource([&]() -> std::optional<downloader::PendingTask> {
+                std::string error;
+                while (auto entry = reader.next(error)) {
+                    downloader::DownloadOptions entry_options = options;
+                    int priority = 0;
+                    if (error.empty()) {
+                        error = applyManifestAttributes(*entry, entry_options, priority);
+                    }
+                    const std::filesystem::path destination = download_dir / entry->destination;
+                    if (!error.empty()) {
+                        ++invalid_entries;
+                        write_result({entry->url, entry->destination.empty() ? std::string{} : destination.string(), false,
+                                      "manifest line " + std::to_string(entry->line) + ": " + error});
+                        continue;
+                    }
+
+                    downloader::PendingTask task;
+                    task.url = entry->url;
+                    task.filename = destination.string();
+                    task.priority = priority;
+                    task.make = [url = entry->url, destination, entry_options, &context]() {
+                        std::error_code ec;
+                        std::filesystem::create_directories(destination.parent_path(), ec);
+                        return std::make_shared<downloader::MultiDownloader>(url, destination.string(),
+                                                                             entry_options, context);
+                    };
+                    return task;
+                }
+                return std::nullopt;
+            });
+        }
+
+        if (stream_output) {
+            manager.addTask(std::make_shared<downloader::MultiDownloader>(argv[arg_index], "-", options, context));
+        }
+        for (int i = arg_index; i + 1 < argc && !stream_output; i += 2) {
             std::filesystem::path destination = download_dir / argv[i + 1];
             auto downloader_task = std::make_shared<downloader::MultiDownloader>(
-                argv[i], destination.string(), threads
+                argv[i], destination.string(), options, context
             );
             manager.addTask(std::move(downloader_task));
         }
 
         //开始下载
         manager.start();
+        // 下游(如 tar)读到结尾才会退出, 不等进程结束
+        if (stream_output) {
+            ::close(options.stream_fd);
+        }
         //打印错误信息
         manager.printError();
+        if (invalid_entries > 0) {
+            std::cerr << "[ERROR] " << invalid_entries << " manifest lines were invalid, see " << results_path
+                      << std::endl;
+        }
         
     } catch (const std::exception& ex) {
         std::cerr << "Fatal error: " << ex.what() << std::endl;
@@ -1,244 +1,1902 @@
 #include "downloader/multi_downloader.hpp"
+#include "downloader/sink.hpp"
+#include "downloader/detail/checksum.hpp"
+#include "downloader/detail/chunk_scheduler.hpp"
+#include "downloader/detail/concurrency_tuner.hpp"
+#include "downloader/detail/connection_budget.hpp"
+#include "downloader/detail/curl_handle_pool.hpp"
+#include "downloader/detail/curl_multi_engine.hpp"
+#include "downloader/detail/curl_utils.hpp"
+#include "downloader/detail/download_cache.hpp"
+#include "downloader/detail/ordered_stream.hpp"
+#include "downloader/detail/rate_limiter.hpp"
+#include "downloader/detail/resume_journal.hpp"
+#include "downloader/detail/transfer_metrics.hpp"
+#include "downloader/detail/write_behind.hpp"
 
 #include <algorithm>
-#include <cstdio>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <random>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
 #include <vector>
 
 #include <curl/curl.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <strings.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace downloader {
 
+namespace {
+// ranges 减去 holes 覆盖的部分, 两者都是 [first, second) 区间
+std::vector<detail::ResumeJournal::Range> subtractRanges(std::vector<detail::ResumeJournal::Range> ranges,
+                                                         std::vector<detail::ResumeJournal::Range> holes) {
+    if (holes.empty()) {
+        return ranges;
+    }
+    std::sort(holes.begin(), holes.end());
+
+    std::vector<detail::ResumeJournal::Range> result;
+    for (const auto& range : ranges) {
+        curl_off_t cursor = range.first;
+        for (const auto& hole : holes) {
+            if (hole.second <= cursor || hole.first >= range.second) {
+                continue;
+            }
+            if (hole.first > cursor) {
+                result.emplace_back(cursor, hole.first);
+            }
+            cursor = std::max(cursor, hole.second);
+        }
+        if (cursor < range.second) {
+            result.emplace_back(cursor, range.second);
+        }
+    }
+    return result;
+}
+} // namespace
+
 class MultiDownloader::Impl {
 public:
-    Impl(std::string url, std::string destination, int thread_count)
-        : url_(std::move(url)), 
+    Impl(std::string url, std::string destination, const DownloadOptions& options,
+         detail::TransferContext context)
+        : url_(std::move(url)),
         destination_(std::move(destination)),
-        thread_count_(std::max(1, thread_count)){}
+        options_(options),
+        thread_count_(std::max(1, options.thread_count)),
+        engine_(std::move(context.engine)),
+        budget_(std::move(context.budget)),
+        handles_(std::move(context.handles)),
+        global_limiter_(std::move(context.rate_limiter)),
+        writer_(std::move(context.writer)),
+        metrics_(std::move(context.metrics)),
+        cache_(std::move(context.cache)),
+        host_(detail::hostKey(url_)),
+        journal_(destination_) {
+        // 数据交给 sink 时用不到写入流水线
+        if (options.sink) {
+            writer_.reset();
+        }
+        if (options.limit_rate > 0) {
+            task_limiter_ = std::make_unique<detail::RateLimiter>(options.limit_rate);
+        }
+        // thread_count 为 0 表示自动: 连接数由按主机共享的 tuner 决定, 没有共享的就自己建一个
+        if (options.thread_count <= 0) {
+            tuner_ = context.tuner ? std::move(context.tuner) : std::make_shared<detail::ConcurrencyTuner>();
+            tuner_host_ = &tuner_->host(host_);
+            thread_count_ = tuner_->maxLevel();
+        }
+
+        mirrors_.emplace_back(url_, host_);
+        for (const auto& mirror : options.mirrors) {
+            const bool known = std::any_of(mirrors_.begin(), mirrors_.end(),
+                                           [&](const Mirror& m) { return m.url == mirror; });
+            if (!mirror.empty() && !known) {
+                mirrors_.emplace_back(mirror, detail::hostKey(mirror));
+            }
+        }
+    }
 
     ~Impl() { resetState(); }
 
-    void start() {
-        resetState();
+    void start() {
+        if (engine_) {
+            startAsync(nullptr);
+            waitUntilFinished();
+            return;
+        }
+
+        resetState();
+        if (!beginRun()) {
+            return;
+        }
+
+        FileMetadata metadata;
+        {
+            CurlHandle curl = newHandle();
+            if (curl) {
+                configureMetadataRequest(curl.get());
+                metadata = readMetadata(curl.get(), curl_easy_perform(curl.get()));
+            }
+        }
+
+        // 探测期间被取消
+        if (hasError()) {
+            finishRun();
+            return;
+        }
+
+        if (metadata.not_modified) {
+            finishFromCache();
+            finishRun();
+            return;
+        }
+
+        if (metadata.whole_file) {
+            finishWholeFile();
+            finishRun();
+            return;
+        }
+
+        if (!metadata.supports_range || metadata.content_length == 0) {
+            if (truncateFile()) {
+                simplDownload();
+            }
+            finishRun();
+            return;
+        }
+
+        if (!prepareRanges(metadata)) {
+            finishRun();
+            return;
+        }
+
+        // 连接可能在下载过程中陆续加入, 等最后一个连接退出后再回收线程; 探测请求已经下完整个文件时不需要连接
+        if (!scheduler_->complete() && growWorkers(true)) {
+            std::unique_lock<std::mutex> lock(workers_mutex_);
+            workers_cv_.wait(lock, [this] { return live_workers_ == 0; });
+        }
+        joinWorkers();
+
+        finishRanges();
+        finishRun();
+    }
+
+    bool startAsync(std::function<void()> on_finished) {
+        if (!engine_) {
+            return false;
+        }
+
+        resetState();
+        {
+            std::lock_guard<std::mutex> lock(async_mutex_);
+            async_active_ = true;
+            on_finished_ = std::move(on_finished);
+        }
+
+        if (!beginRun()) {
+            completeAsync();
+            return true;
+        }
+
+        metadata_curl_ = newHandle();
+        if (!metadata_curl_) {
+            onMetadata(FileMetadata{});
+            return true;
+        }
+
+        configureMetadataRequest(metadata_curl_.get());
+        engine_->submit(metadata_curl_.get(), [this](CURL* easy, CURLcode res) {
+            const auto metadata = readMetadata(easy, res);
+            // 句柄已从 multi 中移除, 立即归还给池, 分片连接可以接着用
+            metadata_curl_.reset();
+            onMetadata(metadata);
+        });
+        return true;
+    }
+
+    [[nodiscard]] Progress getProgress() const {
+        const auto snap = snapshot();
+        return {
+            url_,
+            destination_,
+            snap.total_bytes,
+            snap.downloaded_bytes,
+            snap.is_running,
+            snap.has_error,
+            errorMessage()
+        };
+    }
+
+    // 只读原子计数, 不加锁也不拷贝字符串
+    [[nodiscard]] ProgressSnapshot snapshot() const {
+        ProgressSnapshot snap;
+        snap.is_running = is_running_.load(std::memory_order_acquire);
+        snap.has_error = has_error_.load(std::memory_order_acquire);
+        snap.total_bytes = total_bytes_.load(std::memory_order_relaxed);
+        snap.downloaded_bytes = downloaded_bytes_.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    [[nodiscard]] const std::string& url() const { return url_; }
+    [[nodiscard]] const std::string& filename() const { return destination_; }
+
+    [[nodiscard]] std::string errorMessage() const {
+        if (!has_error_.load(std::memory_order_acquire)) {
+            return {};
+        }
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        return error_message_;
+    }
+
+    [[nodiscard]] bool isRunning() const {
+        return is_running_.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool hasError() const {
+        return has_error_.load(std::memory_order_acquire);
+    }
+
+    // 取消标记不会被清除, 之后再启动的运行立即失败. 还没开始运行时由 beginRun 登记错误;
+    // 已经结束的运行不受影响
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> lock(cancel_mutex_);
+            cancelled_.store(true, std::memory_order_relaxed);
+        }
+        cancel_cv_.notify_all();
+        if (isRunning()) {
+            registerError(kCancelled, false);
+        }
+    }
+
+private:
+    using CurlHandle = detail::EasyHandle;
+    using Lease = detail::ChunkScheduler::Lease;
+
+    // 目标文件的原始描述符. 各分片用 pwrite 写入各自的偏移, 不需要共享锁, 也没有 stdio 缓冲
+    class FileDescriptor {
+    public:
+        FileDescriptor() = default;
+        ~FileDescriptor() { reset(); }
+
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        void reset(int fd = -1) noexcept {
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+            fd_ = fd;
+        }
+
+        [[nodiscard]] int get() const noexcept { return fd_; }
+        explicit operator bool() const noexcept { return fd_ >= 0; }
+
+    private:
+        int fd_{-1};
+    };
+
+    struct FileMetadata {
+        bool supports_range{false};
+        curl_off_t content_length{0};
+        std::string etag;
+        std::string last_modified;
+        bool whole_file{false};   // 整个文件就是探测响应的响应体(服务器忽略了 Range 或文件不大于探测大小)
+        bool not_modified{false};   // 条件请求得到 304, 内容与缓存中的相同
+    };
+
+    // 任务的一个下载源, 0 号是主 URL, 其余来自 options.mirrors. 元数据只向主 URL 请求, 其他源的
+    // 文件大小由每个分片响应的 Content-Range 核对. 可变的部分由 mirrors_mutex_ 保护
+    struct Mirror {
+        Mirror(std::string mirror_url, std::string mirror_host)
+            : url(std::move(mirror_url)), host(std::move(mirror_host)) {}
+
+        const std::string url;
+        const std::string host;
+        bool dropped{false};
+        int failures{0};        // 连续失败的次数, 成功一次就清零
+        std::uint64_t leases{0};   // 分给这个源的工作段数
+        double rate{0.0};       // 单连接吞吐的平滑值(字节/秒), 0 表示还没测过
+    };
+
+    // 一个连接的上下文. 分片模式下依次从调度器领取工作并复用同一个 curl 句柄(连接保持);
+    // 不支持分片时 has_lease 为 false, 数据按顺序写在 hasWritten 处
+    struct RangeContext {
+        Impl* owner{nullptr};
+        Lease lease{};
+        bool has_lease{false};
+        int attempts{0};           // 当前这段工作已经重试的次数
+        std::uint64_t prepaid{0};  // 暂停前已经预约过额度、恢复后会重新交付的字节数
+        detail::WriteBehind::Buffer* buffer{nullptr};   // 正在填充、尚未交给写线程的缓冲区
+        curl_off_t map_window{0};  // 映射输出时, 从这里开始的数据还没有催促回写
+        curl_off_t hasWritten{0};
+        curl_off_t skip{0};        // 按顺序输出时整个重新请求, 开头这么多字节已经输出过
+        CurlHandle curl;
+        std::string range;
+        std::size_t mirror{0};          // 当前请求使用的源
+        curl_off_t requested_from{0};
+        bool response_checked{false};   // 这次响应的状态和 Content-Range 已经核对过
+        bool rejected{false};           // 响应与请求不符, 数据被拒收
+        std::string content_range;
+    };
+
+    // 领取任务的首个连接名额, 打开(但不截断)目标文件并重置计数, 失败时已登记错误.
+    // 是否保留已有内容要等拿到元数据后决定
+    bool beginRun() {
+        clearError();
+        downloaded_bytes_.store(0, std::memory_order_relaxed);
+        total_bytes_.store(0, std::memory_order_relaxed);
+        setRunning(true);
+        acquireInitialSlot();
+        if (cancelled_.load(std::memory_order_relaxed)) {
+            registerError(kCancelled);
+            releaseAllSlots();
+            return false;
+        }
+
+        stream_.reset();
+        sink_open_ = false;
+        if (streaming()) {
+            // 按顺序输出时摘要就在写出的地方算
+            stream_ = std::make_unique<detail::OrderedStream>(
+                options_.stream_fd, static_cast<std::size_t>(std::max<std::uint64_t>(1, options_.reorder_window)),
+                [this](const char* data, std::size_t length, curl_off_t offset) {
+                    hashInOrder(data, length, offset);
+                });
+        }
+
+        checksum_.reset();
+        hash_frontier_.store(0, std::memory_order_relaxed);
+        if (!options_.checksum.empty()) {
+            std::string error;
+            checksum_spec_ = detail::Checksum::parse(options_.checksum, &error);
+            if (!checksum_spec_) {
+                registerError(std::move(error));
+                releaseAllSlots();
+                return false;
+            }
+            checksum_ = std::make_unique<detail::Checksum>(checksum_spec_->algorithm);
+        }
+
+        // 缓存按 sha256 存放内容: 没有指定校验和时也边下边算一份, 指定了其他算法时不使用缓存
+        cached_.reset();
+        cache_entry_ = {};
+        if (cacheable()) {
+            if (!checksum_) {
+                checksum_ = std::make_unique<detail::Checksum>(detail::Checksum::Algorithm::Sha256);
+            }
+            cached_ = cache_->lookup(url_);
+        }
+
+        if (!stream_ && !sink()) {
+            file_.reset(::open(destination_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+            if (!file_) {
+                registerError("Cannot create destination file");
+                releaseAllSlots();
+                return false;
+            }
+            // 文件系统不支持 O_DIRECT 时打开失败, 全部走页缓存
+            if (writer_ && options_.direct_io) {
+                direct_file_.reset(::open(destination_.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC));
+            }
+            if (writer_) {
+                writer_->attachFile(file_.get());
+                writer_->attachFile(direct_file_.get());
+            }
+        }
+        return true;
+    }
+
+    // 关闭前先等写线程写完并注销, 否则文件表里会留着已经关闭的 fd
+    void closeFiles() {
+        if (writer_) {
+            drainWrites();
+            writer_->detachFile(direct_file_.get());
+            writer_->detachFile(file_.get());
+        }
+        direct_file_.reset();
+        file_.reset();
+    }
+
+    void finishRun() {
+        unmapFile();
+        closeFiles();
+        releaseAllSlots();
+        storeInCache();
+
+        if (total_bytes_.load(std::memory_order_relaxed) == 0) {
+            total_bytes_.store(downloaded_bytes_.load(std::memory_order_relaxed),
+                               std::memory_order_relaxed);
+        }
+        if (std::exchange(sink_open_, false)) {
+            sink()->close(!hasError(), downloaded_bytes_.load(std::memory_order_relaxed));
+        }
+
+        setRunning(false);
+    }
+
+    // 元数据不再单独发 HEAD: 第一个请求就是文件开头一段的 Range GET, 大小和是否支持分片从 206 响应的
+    // Content-Range 得到, 响应体边收边写到输出开头, 建好分片调度器后作为已完成的区间.
+    // 小于探测大小的文件一个请求就下载完
+    void configureMetadataRequest(CURL* curl) {
+        metadata_headers_.clear();
+        probe_body_.clear();
+        probe_curl_ = curl;
+        probe_checked_ = false;
+        probe_streaming_ = false;
+        probe_written_ = 0;
+        probe_meta_ = {};
+        resumed_ranges_.clear();
+        // 探测范围固定不大: 响应体在内存里, 也是在拆分之前由一个连接下载的. 剩余部分是否拆分由
+        // Content-Range 中的文件大小决定(见 prepareRanges)
+        probe_limit_ = std::clamp<std::uint64_t>(options_.min_chunk_size, 1, kProbeMaxBytes);
+        probe_range_ = "0-" + std::to_string(probe_limit_ - 1);
+
+        curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+        curl_easy_setopt(curl, CURLOPT_RANGE, probe_range_.c_str());
+        configureConditional(curl);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        configureTimeouts(curl);
+        configureHttpVersion(curl);
+        configureCancel(curl);
+
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION,
+            +[](char* buffer, size_t size, size_t nitems, std::string* out) -> size_t {
+                out->append(buffer, size * nitems);
+                return size * nitems;
+            });
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &metadata_headers_);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &Impl::probeWriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+    }
+
+    // 有效的 206 响应边收边写, 和分片连接一样计入进度和摘要; 服务器忽略了 Range 时响应体先留在内存里,
+    // 超出探测大小说明文件更大, 中止后改用普通下载
+    static size_t probeWriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+        auto& self = *static_cast<Impl*>(userdata);
+        const size_t total = size * nmemb;
+        if (!std::exchange(self.probe_checked_, true) && !self.beginProbeBody()) {
+            return 0;
+        }
+        const std::uint64_t received = self.probe_streaming_ ? static_cast<std::uint64_t>(self.probe_written_)
+                                                             : self.probe_body_.size();
+        if (received + total > self.probe_limit_) {
+            return 0;
+        }
+        if (!self.probe_streaming_) {
+            self.probe_body_.append(ptr, total);
+            return total;
+        }
+        return self.writeProbe(ptr, total) ? total : 0;
+    }
+
+    // 第一段响应体到达时响应头已经齐了: 有效的 206 就按其中的文件大小准备好输出, 之后的数据直接写进去.
+    // 返回 false 表示准备输出失败, 已登记错误
+    bool beginProbeBody() {
+        long code = 0;
+        curl_easy_getinfo(probe_curl_, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 206) {
+            return true;
+        }
+        const auto range = detail::parseContentRange(detail::findHeader(metadata_headers_, "Content-Range"));
+        if (!range || range->first != 0 || range->total <= 0) {
+            return true;
+        }
+
+        probe_meta_.supports_range = true;
+        probe_meta_.content_length = range->total;
+        probe_meta_.etag = detail::findHeader(metadata_headers_, "ETag");
+        probe_meta_.last_modified = detail::findHeader(metadata_headers_, "Last-Modified");
+        cache_entry_.etag = probe_meta_.etag;
+        cache_entry_.last_modified = probe_meta_.last_modified;
+        if (!prepareOutput(probe_meta_)) {
+            return false;
+        }
+        probe_streaming_ = true;
+        return true;
+    }
+
+    // 把探测请求的数据接着写到输出开头并计入进度和摘要, 失败时已登记错误
+    bool writeProbe(const char* data, size_t length) {
+        const curl_off_t offset = probe_written_;
+        if (stream_) {
+            if (!stream_->push(data, length, offset)) {
+                registerError("Failed to write output stream", false);
+                return false;
+            }
+        } else {
+            if (writeOutput(data, length, offset) != length) {
+                registerError("Failed to write output file", false);
+                return false;
+            }
+            hashInOrder(data, length, offset);
+        }
+        probe_written_ += static_cast<curl_off_t>(length);
+        downloaded_bytes_.fetch_add(length, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 有共享句柄池时从池中借用(连接, DNS 和 TLS 会话得以复用), 否则新建
+    [[nodiscard]] CurlHandle newHandle() const {
+        return detail::acquireEasy(handles_, host_);
+    }
+
+    // 每次请求结束时调用一次; ok 为 false 表示这次请求失败, host 是实际请求的源
+    void noteTransfer(CURL* curl, bool ok, const std::string& host) const {
+        if (handles_) {
+            handles_->recordTransfer(curl);
+        }
+        if (metrics_) {
+            metrics_->record(host, curl, ok);
+        }
+    }
+
+    void noteRetry(const std::string& host) const {
+        if (metrics_) {
+            metrics_->recordRetry(host);
+        }
+    }
+
+    // 探测请求失败(包括空文件的 416)或响应不可用时返回默认值, 由普通下载接手并按它的规则重试
+    [[nodiscard]] FileMetadata readMetadata(CURL* curl, CURLcode res) {
+        noteTransfer(curl, res == CURLE_OK, host_);
+        FileMetadata meta;
+        if (res != CURLE_OK) {
+            probe_body_.clear();
+            // 206 的响应体中途断开: 已经写下的开头照样算完成, 其余交给分片连接
+            return probe_streaming_ ? probe_meta_ : meta;
+        }
+
+        long code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        // 只有事件循环能让多个请求共用一个连接; 每个分片一个线程时各自 easy_perform, 仍是各自的连接
+        long version = 0;
+        curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+        http2_.store(version >= CURL_HTTP_VERSION_2_0, std::memory_order_relaxed);
+        if (handles_ && version >= CURL_HTTP_VERSION_2_0) {
+            handles_->recordHttp2(host_);
+        }
+        multiplexed_.store(engine_ && version >= CURL_HTTP_VERSION_2_0, std::memory_order_relaxed);
+        if (code == 304 && cached_) {
+            meta.not_modified = true;
+            return meta;
+        }
+        if (probe_streaming_) {
+            // 响应体已经写到输出开头. 小文件一个请求就下完了, 不需要调度器、断点日志和分片连接
+            meta = probe_meta_;
+            meta.whole_file = probe_written_ == meta.content_length;
+            return meta;
+        }
+        meta.etag = detail::findHeader(metadata_headers_, "ETag");
+        meta.last_modified = detail::findHeader(metadata_headers_, "Last-Modified");
+        cache_entry_.etag = meta.etag;
+        cache_entry_.last_modified = meta.last_modified;
+        if (code != 206) {
+            // 服务器忽略了 Range, 但整个文件已经在探测响应里了
+            meta.whole_file = true;
+            meta.content_length = static_cast<curl_off_t>(probe_body_.size());
+            return meta;
+        }
+        // Content-Range 不可用的 206
+        probe_body_.clear();
+        return meta;
+    }
+
+    // ---- 本地缓存: 只用于写目标文件的下载 ----
+
+    [[nodiscard]] bool cacheable() const {
+        return cache_ && !stream_ && !sink() &&
+               (!checksum_spec_ || checksum_spec_->algorithm == detail::Checksum::Algorithm::Sha256);
+    }
+
+    // 有缓存记录时探测请求带上 If-None-Match / If-Modified-Since, 内容没变时服务器只回 304
+    void configureConditional(CURL* curl) {
+        conditional_headers_.reset();
+        if (!cached_) {
+            return;
+        }
+        std::vector<std::string> lines;
+        if (!cached_->etag.empty()) {
+            lines.push_back("If-None-Match: " + cached_->etag);
+        }
+        if (!cached_->last_modified.empty()) {
+            lines.push_back("If-Modified-Since: " + cached_->last_modified);
+        }
+        curl_slist* headers = nullptr;
+        for (const auto& line : lines) {
+            if (curl_slist* appended = curl_slist_append(headers, line.c_str())) {
+                headers = appended;
+            }
+        }
+        conditional_headers_.reset(headers);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    // 服务器确认内容没变: 把缓存的对象放到目标位置, 不下载响应体
+    void finishFromCache() {
+        const auto& entry = *cached_;
+        if (!checkExpectedSize(entry.size)) {
+            return;
+        }
+        if (checksum_spec_ && checksum_spec_->expected != entry.sha256) {
+            registerError("Checksum mismatch: expected sha256:" + checksum_spec_->expected + ", got " +
+                          entry.sha256 + " (cached)", false);
+            return;
+        }
+        std::string error;
+        if (!cache_->materialize(entry, destination_, error)) {
+            registerError(std::move(error), false);
+            return;
+        }
+        total_bytes_.store(entry.size, std::memory_order_relaxed);
+        downloaded_bytes_.store(entry.size, std::memory_order_relaxed);
+        if (options_.resume) {
+            journal_.remove();
+        }
+    }
+
+    // 完整下载到目标文件后记进缓存. 摘要没算出来(如大小未知又中途重试)或服务器没给校验信息时不记
+    void storeInCache() {
+        if (hasError() || !cacheable() || cache_entry_.sha256.empty() || !cache_entry_.usable()) {
+            return;
+        }
+        cache_->store(url_, cache_entry_, destination_);
+    }
+
+    // 探测请求已经拿到整个文件(文件不大于探测大小, 或服务器不支持分片而文件又不大于探测大小).
+    // 206 响应已经写到输出里了, 服务器忽略 Range 时响应体在 probe_body_ 里, 这时才写出
+    void finishWholeFile() {
+        const auto size = probe_streaming_ ? probe_written_ : static_cast<curl_off_t>(probe_body_.size());
+        const bool stored = probe_streaming_ ||
+                            (checkExpectedSize(static_cast<std::uint64_t>(size)) && truncateFile(size) &&
+                             (probe_body_.empty() || writeProbe(probe_body_.data(), probe_body_.size())));
+        if (stored) {
+            downloaded_bytes_.store(static_cast<std::uint64_t>(size), std::memory_order_relaxed);
+            verifyChecksum(size);
+        }
+        // 整个文件已经重新下载, 之前中断时留下的断点日志作废
+        if (!hasError() && options_.resume && !stream_ && !sink()) {
+            journal_.remove();
+        }
+        probe_body_.clear();
+        probe_body_.shrink_to_fit();
+    }
+
+    // 大小未知时 size 为 0
+    bool truncateFile(curl_off_t size = 0) {
+        if (stream_) {
+            return true;
+        }
+        if (sink()) {
+            std::string error;
+            if (!sink()->open(size > 0 ? static_cast<std::uint64_t>(size) : Sink::kUnknownSize, error)) {
+                registerError(error.empty() ? "Cannot open output sink" : std::move(error));
+                return false;
+            }
+            sink_open_ = true;
+            return true;
+        }
+        if (ftruncate(file_.get(), 0) == -1 || (size > 0 && ftruncate(file_.get(), size) == -1)) {
+            closeFiles();
+            registerError("Cannot resize destination file");
+            return false;
+        }
+        return true;
+    }
+
+    // 校验信息一致且目标文件大小正确时, 返回断点日志中已经落盘的区间
+    std::vector<detail::ResumeJournal::Range> loadResumeRanges() {
+        if (!use_journal_) {
+            return {};
+        }
+
+        struct stat st {};
+        if (::fstat(file_.get(), &st) != 0 || st.st_size != validators_.size) {
+            return {};
+        }
+        return journal_.load(url_, validators_);
+    }
+
+    static constexpr std::int64_t kJournalIntervalNs = 1'000'000'000;
+    static constexpr std::int64_t kGrowIntervalNs = 250'000'000;
+    static constexpr curl_off_t kMapWindow = 8 * 1024 * 1024;
+    static constexpr curl_off_t kHashCatchUp = 16 * 1024 * 1024;
+    static constexpr std::uint64_t kProbeMaxBytes = 1024 * 1024;
+    static constexpr std::chrono::milliseconds kStreamRetry{10};
+    static constexpr const char* kCancelled = "Cancelled";
+
+    static std::int64_t steadyNowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 周期性的日志由单独的线程写: fdatasync 整个文件可能要很久, 不能卡住网络线程(-e 模式下是所有任务共用的
+    // 事件循环). 结束或出错时由 finishRanges 停掉它, 再强制写最后一次
+    void startJournalThread() {
+        if (!use_journal_ || journal_thread_.joinable()) {
+            return;
+        }
+        journal_stop_ = false;
+        journal_thread_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(journal_thread_mutex_);
+            while (!journal_cv_.wait_for(lock, std::chrono::nanoseconds{kJournalIntervalNs},
+                                         [this] { return journal_stop_; })) {
+                lock.unlock();
+                saveJournal(false);
+                lock.lock();
+            }
+        });
+    }
+
+    void stopJournalThread() {
+        if (!journal_thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(journal_thread_mutex_);
+            journal_stop_ = true;
+        }
+        journal_cv_.notify_all();
+        journal_thread_.join();
+    }
+
+    // 先 fdatasync 数据再写日志, 保证日志里的区间一定已经落盘. 非强制时正在写就直接返回
+    void saveJournal(bool force) {
+        if (!use_journal_ || !scheduler_) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(journal_mutex_, std::defer_lock);
+        if (force) {
+            lock.lock();
+        } else if (!lock.try_lock()) {
+            return;
+        }
+
+        // 还在缓冲区里或正在写的区间不能记为已落盘; 先取已写区间再取未落盘区间, 两者之间刚写完的部分只会被少记
+        auto ranges = scheduler_->writtenRanges();
+        ranges = subtractRanges(std::move(ranges), unflushedSpans());
+        if (::fdatasync(file_.get()) != 0) {
+            return;
+        }
+        journal_.save(url_, validators_, ranges);
+    }
+
+    // ---- 写入流水线: 有共享的 WriteBehind 时分片数据先进缓冲区, 由写线程落盘 ----
+
+    // 把 [offset, offset+length) 的数据写到 ctx 的缓冲区, 写满或不连续时交给写线程.
+    // 缓冲区预算用完时直接写. 返回成功接收的字节数
+    size_t bufferWrite(RangeContext& ctx, const char* data, size_t length, curl_off_t offset) {
+        size_t done = 0;
+        while (done < length) {
+            const curl_off_t at = offset + static_cast<curl_off_t>(done);
+            if (ctx.buffer && ctx.buffer->endOffset() != at) {
+                flushBuffer(ctx);
+            }
+            if (!ctx.buffer) {
+                ctx.buffer = writer_->tryAcquire(at);
+                if (!ctx.buffer) {
+                    return done + writeAt(file_.get(), data + done, length - done, at);
+                }
+                trackSpan(at, at + static_cast<curl_off_t>(ctx.buffer->room()));
+            }
+
+            const size_t n = std::min(length - done, ctx.buffer->room());
+            std::memcpy(ctx.buffer->data + ctx.buffer->end, data + done, n);
+            ctx.buffer->end += n;
+            done += n;
+            if (ctx.buffer->room() == 0) {
+                flushBuffer(ctx);
+            }
+        }
+        return done;
+    }
+
+    void flushBuffer(RangeContext& ctx) {
+        detail::WriteBehind::Buffer* buffer = std::exchange(ctx.buffer, nullptr);
+        if (!buffer) {
+            return;
+        }
+
+        const curl_off_t span_start = buffer->offset;
+        if (buffer->size() == 0) {
+            writer_->release(buffer);
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            eraseSpanLocked(span_start);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            ++inflight_writes_;
+        }
+        writer_->submit(file_.get(), direct_file_.get(), buffer, [this, span_start](bool ok) {
+            if (!ok) {
+                registerError("Failed to write output file", false);
+                if (scheduler_) {
+                    scheduler_->cancel();
+                }
+            }
+            // 写失败的区间继续留在未落盘列表里, 不会被写进断点日志
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            if (ok) {
+                eraseSpanLocked(span_start);
+            }
+            if (--inflight_writes_ == 0) {
+                write_cv_.notify_all();
+            }
+        });
+    }
+
+    void trackSpan(curl_off_t first, curl_off_t last) {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        unflushed_.emplace_back(first, last);
+    }
+
+    void eraseSpanLocked(curl_off_t first) {
+        auto it = std::find_if(unflushed_.begin(), unflushed_.end(),
+                               [first](const auto& span) { return span.first == first; });
+        if (it != unflushed_.end()) {
+            unflushed_.erase(it);
+        }
+    }
+
+    [[nodiscard]] std::vector<detail::ResumeJournal::Range> unflushedSpans() {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        return unflushed_;
+    }
+
+    // 等待本任务交给写线程的数据全部写完, 之后才能 fdatasync/关闭文件
+    void drainWrites() {
+        std::unique_lock<std::mutex> lock(write_mutex_);
+        write_cv_.wait(lock, [this] { return inflight_writes_ == 0; });
+    }
+
+    // ---- 映射输出: 文件大小已知时整个映射进来, 各连接直接拷贝到自己的区间, 不加锁也没有系统调用 ----
+
+    // 先真正分配磁盘空间, 否则写映射时磁盘满会收到 SIGBUS; 任何一步不行就继续用 pwrite
+    void mapFile(curl_off_t size) {
+        if (!options_.mmap_output || stream_ || sink() || size <= 0 ||
+            static_cast<std::uint64_t>(size) > std::numeric_limits<size_t>::max()) {
+            return;
+        }
+
+        struct stat st {};
+        if (::fstat(file_.get(), &st) != 0 || st.st_size < size || ::fallocate(file_.get(), 0, 0, size) != 0) {
+            return;
+        }
+        void* map = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, file_.get(), 0);
+        if (map == MAP_FAILED) {
+            return;
+        }
+        ::madvise(map, static_cast<size_t>(size), MADV_SEQUENTIAL);
+        map_ = static_cast<char*>(map);
+        map_size_ = static_cast<size_t>(size);
+    }
+
+    void unmapFile() {
+        if (map_) {
+            ::munmap(map_, map_size_);
+            map_ = nullptr;
+            map_size_ = 0;
+        }
+    }
+
+    size_t mapWrite(RangeContext& ctx, const char* data, size_t length, curl_off_t offset) {
+        std::memcpy(map_ + offset, data, length);
+
+        // 每个连接每写满一个窗口就让内核开始回写这一段, 并解除其中整页的映射, 脏页不会在最后集中落盘
+        const curl_off_t end = offset + static_cast<curl_off_t>(length);
+        if (offset < ctx.map_window || offset - ctx.map_window > kMapWindow) {
+            ctx.map_window = offset;
+        }
+        if (end - ctx.map_window >= kMapWindow) {
+            ::sync_file_range(file_.get(), ctx.map_window, end - ctx.map_window, SYNC_FILE_RANGE_WRITE);
+            const curl_off_t page = ::sysconf(_SC_PAGESIZE);
+            const curl_off_t first = (ctx.map_window + page - 1) / page * page;
+            const curl_off_t last = end / page * page;
+            if (last > first) {
+                ::madvise(map_ + first, static_cast<size_t>(last - first), MADV_DONTNEED);
+            }
+            ctx.map_window = end;
+        }
+        return length;
+    }
+
+    bool checkExpectedSize(std::uint64_t size) {
+        if (options_.expected_size == 0 || options_.expected_size == size) {
+            return true;
+        }
+        registerError("Size mismatch: expected " + std::to_string(options_.expected_size) + " bytes, got " +
+                      std::to_string(size), false);
+        return false;
+    }
+
+    // ---- 边下边算的校验和: 摘要必须按文件顺序计算 ----
+    // 正好落在已算位置上的数据直接从 curl 的缓冲区算进去(通常是最前面那个连接); 其余的等前面接上后
+    // 再从文件读回来算, 这时数据一般还在页缓存里, 不用像事后 sha256sum 那样重读磁盘
+
+    void hashInOrder(const char* data, size_t length, curl_off_t offset) {
+        if (!checksum_ || length == 0 || offset != hash_frontier_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(hash_mutex_);
+        if (offset == hash_frontier_.load(std::memory_order_relaxed)) {
+            checksum_->update(data, length);
+            hash_frontier_.store(offset + static_cast<curl_off_t>(length), std::memory_order_relaxed);
+        }
+    }
+
+    // 把已算位置之后连续落盘的数据读回来算进摘要. wait 为 false 时其他线程正在算就直接返回, 且一次最多读 limit 字节
+    void catchUpHash(bool wait, curl_off_t limit = std::numeric_limits<curl_off_t>::max()) {
+        if (!checksum_ || !scheduler_ || stream_) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(hash_mutex_, std::defer_lock);
+        if (wait) {
+            lock.lock();
+        } else if (!lock.try_lock()) {
+            return;
+        }
+
+        curl_off_t frontier = hash_frontier_.load(std::memory_order_relaxed);
+        curl_off_t end = frontier;
+        for (const auto& range : subtractRanges(scheduler_->writtenRanges(), unflushedSpans())) {
+            if (range.first <= frontier && frontier < range.second) {
+                end = range.second - frontier > limit ? frontier + limit : range.second;
+                break;
+            }
+        }
+
+        constexpr curl_off_t kReadSize = 256 * 1024;
+        hash_buffer_.resize(static_cast<size_t>(kReadSize));
+        while (frontier < end) {
+            const auto length = static_cast<size_t>(std::min(end - frontier, kReadSize));
+            const char* data = map_ ? map_ + frontier : hash_buffer_.data();
+            if (sink()) {
+                if (!sink()->read(hash_buffer_.data(), length, static_cast<std::uint64_t>(frontier))) {
+                    break;
+                }
+            } else if (!map_) {
+                const ssize_t n = ::pread(file_.get(), hash_buffer_.data(), length, frontier);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n != static_cast<ssize_t>(length)) {
+                    break;
+                }
+            }
+            checksum_->update(data, length);
+            frontier += static_cast<curl_off_t>(length);
+            hash_frontier_.store(frontier, std::memory_order_relaxed);
+        }
+    }
+
+    // 全部数据写完后比较摘要, 不一致时按普通错误处理. 返回 false 表示校验失败
+    bool verifyChecksum(curl_off_t size) {
+        if (!checksum_) {
+            return true;
+        }
+        catchUpHash(true);
+
+        std::lock_guard<std::mutex> lock(hash_mutex_);
+        if (hash_frontier_.load(std::memory_order_relaxed) != size) {
+            // 只为缓存算的摘要算不出来时不进缓存, 下载本身不算失败
+            if (!checksum_spec_) {
+                return true;
+            }
+            registerError("Cannot compute " + std::string(detail::Checksum::name(checksum_spec_->algorithm)) +
+                          " checksum", false);
+            return false;
+        }
+        const std::string actual = checksum_->hexDigest();
+        if (checksum_->algorithm() == detail::Checksum::Algorithm::Sha256) {
+            cache_entry_.sha256 = actual;
+            cache_entry_.size = static_cast<std::uint64_t>(size);
+        }
+        if (!checksum_spec_) {
+            return true;
+        }
+        const std::string algorithm = detail::Checksum::name(checksum_spec_->algorithm);
+        if (actual != checksum_spec_->expected) {
+            registerError("Checksum mismatch: expected " + algorithm + ":" + checksum_spec_->expected +
+                          ", got " + actual, false);
+            return false;
+        }
+        return true;
+    }
+
+    void resetChecksum() {
+        if (checksum_) {
+            std::lock_guard<std::mutex> lock(hash_mutex_);
+            checksum_->reset();
+            hash_frontier_.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // 文件大小和校验信息已知时准备输出: 断点日志可用就载入其中的区间(留在 resumed_ranges_), 否则
+    // 预分配文件. 探测请求的响应体到达时就调用, 失败时已登记错误
+    bool prepareOutput(const FileMetadata& metadata) {
+        if (!checkExpectedSize(static_cast<std::uint64_t>(metadata.content_length))) {
+            return false;
+        }
+        validators_.size = metadata.content_length;
+        validators_.etag = metadata.etag;
+        validators_.last_modified = metadata.last_modified;
+        use_journal_ = options_.resume && validators_.usable() && !stream_ && !sink();
+
+        resumed_ranges_ = loadResumeRanges();
+        if (resumed_ranges_.empty() && !truncateFile(metadata.content_length)) {
+            return false;
+        }
+        mapFile(metadata.content_length);
+        total_bytes_.store(static_cast<std::uint64_t>(metadata.content_length), std::memory_order_relaxed);
+        return true;
+    }
+
+    // 建立分片调度器和连接上下文, 失败时已登记错误
+    bool prepareRanges(const FileMetadata& metadata) {
+        if (!probe_streaming_ && !prepareOutput(metadata)) {
+            return false;
+        }
+
+        // 探测请求已经写下的开头部分直接算作已完成, 与日志中的区间重叠也没关系, 调度器会合并
+        auto resumed = std::move(resumed_ranges_);
+        resumed_ranges_.clear();
+        const curl_off_t probed = probe_written_;
+        if (probed > 0) {
+            resumed.emplace_back(0, probed);
+        }
+
+        detail::ChunkScheduler::Options sched_options;
+        // 分片大小按预计的连接数切; 日志中已完成的区间这时还没合并, 不计在内.
+        // 剩余部分不值得拆分时只用一个连接, 整段作为一个分片, 一个请求下完
+        const curl_off_t rest = metadata.content_length - probed;
+        sched_options.worker_count = rangeLimit(rest);
+        sched_options.min_chunk_size = static_cast<curl_off_t>(std::max<std::uint64_t>(1, options_.min_chunk_size));
+        sched_options.max_chunk_size = static_cast<curl_off_t>(options_.max_chunk_size);
+        if (sched_options.worker_count == 1) {
+            sched_options.max_chunk_size = std::max(sched_options.max_chunk_size, rest);
+        }
+        sched_options.endgame = options_.endgame;
+        if (stream_) {
+            // 按顺序输出时, 各连接同时下载的分片要能一起放进重排窗口, 否则除了最前面的都在等.
+            // 重复请求写的是重叠的数据, 不用
+            const auto window = static_cast<curl_off_t>(options_.reorder_window);
+            sched_options.max_chunk_size = std::clamp<curl_off_t>(
+                window / sched_options.worker_count, sched_options.min_chunk_size,
+                std::max(sched_options.min_chunk_size, sched_options.max_chunk_size));
+            sched_options.endgame = false;
+        }
+        scheduler_ = std::make_unique<detail::ChunkScheduler>(metadata.content_length, sched_options, resumed);
+
+        total_bytes_.store(static_cast<std::uint64_t>(metadata.content_length), std::memory_order_relaxed);
+        downloaded_bytes_.store(static_cast<std::uint64_t>(scheduler_->resumedBytes()), std::memory_order_relaxed);
+
+        max_workers_ = rangeLimit(metadata.content_length - scheduler_->resumedBytes());
+        startJournalThread();
+        return true;
+    }
+
+    // 拆分策略: 剩余 remaining 字节最多同时用几个分片连接. 每个连接至少分到 split_threshold 字节,
+    // 也不超过按最小分片能切出的份数, 再受 -t 和 max_ranges 限制; 至少一个
+    [[nodiscard]] int rangeLimit(curl_off_t remaining) const {
+        const auto min_chunk = static_cast<curl_off_t>(std::max<std::uint64_t>(1, options_.min_chunk_size));
+        curl_off_t limit = std::min<curl_off_t>(thread_count_, (remaining + min_chunk - 1) / min_chunk);
+        if (options_.split_threshold > 0) {
+            limit = std::min(limit, remaining / static_cast<curl_off_t>(options_.split_threshold));
+        }
+        if (options_.max_ranges > 0) {
+            limit = std::min<curl_off_t>(limit, options_.max_ranges);
+        }
+        return static_cast<int>(std::max<curl_off_t>(1, limit));
+    }
+
+    // ---- 连接名额: 没有共享预算时不计数, 每个分片连接占用一个名额, 退出时归还.
+    // 复用 HTTP/2 连接时, 首个名额之外的分片只是同一连接上的流, 不占名额, 只受 workerLimit() 限制 ----
+
+    void acquireInitialSlot() {
+        if (budget_) {
+            budget_->acquireInitial(host_);
+            held_slots_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryAcquireSlot() {
+        if (!budget_) {
+            return true;
+        }
+        if (multiplexed_.load(std::memory_order_relaxed)) {
+            free_streams_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (!budget_->tryAcquire(host_)) {
+            return false;
+        }
+        held_slots_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void releaseSlot() {
+        // 连接之间可以互换, 先抵扣不占名额的流
+        int streams = free_streams_.load(std::memory_order_relaxed);
+        while (streams > 0 && !free_streams_.compare_exchange_weak(streams, streams - 1, std::memory_order_relaxed)) {
+        }
+        if (streams > 0) {
+            return;
+        }
+        if (budget_ && held_slots_.fetch_sub(1, std::memory_order_relaxed) > 0) {
+            budget_->release(host_);
+        }
+    }
+
+    void releaseAllSlots() {
+        free_streams_.store(0, std::memory_order_relaxed);
+        const int held = held_slots_.exchange(0, std::memory_order_relaxed);
+        if (budget_ && held > 0) {
+            budget_->release(host_, held);
+        }
+    }
 
-        {
-            std::lock_guard<std::mutex> lock(state_mutex_);
-            is_running_ = true;
-            has_error_ = false;
-            error_message_.clear();
-            downloaded_bytes_ = 0;
-            total_bytes_ = 0;
+    // 当前允许的连接数, 调用方需持有 workers_mutex_
+    [[nodiscard]] int workerLimit() const {
+        if (!tuner_host_) {
+            return max_workers_;
         }
+        return std::clamp(tuner_->target(*tuner_host_), 1, max_workers_);
+    }
 
-        file_.reset(std::fopen(destination_.c_str(), "wb+"));
-        if (!file_) {
-            registerError("Cannot create destination file");
-            return;
+    // 建立一个分片连接并计入 live_workers_, 调用方需持有 workers_mutex_
+    RangeContext* addWorker() {
+        auto ctx = std::make_unique<RangeContext>();
+        ctx->owner = this;
+        ctx->curl = newHandle();
+        if (!ctx->curl) {
+            registerError("Failed to allocate curl handle", false);
+            return nullptr;
         }
 
-        const auto metadata = fetchMetadata();
-        if (!metadata.supports_range || metadata.content_length == 0) {
-            simplDownload();
+        configureRangeRequest(ctx->curl.get(), *ctx);
+        ranges_.push_back(std::move(ctx));
+        ++live_workers_;
+        if (tuner_host_) {
+            tuner_->connectionOpened(*tuner_host_);
+        }
+        return ranges_.back().get();
+    }
 
-            if (file_) {
-                std::fflush(file_.get());
-                file_.reset();
+    // 在预算允许的范围内补充连接, 直到 workerLimit(). initial 为 true 时第一个连接使用任务已持有的
+    // 首个名额; 返回 false 表示首个连接没能建立. 分片连接在每段工作结束后和写回调中定期调用,
+    // 以接手其他任务释放的名额
+    bool growWorkers(bool initial = false) {
+        std::vector<RangeContext*> added;
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex_);
+            if (initial) {
+                RangeContext* ctx = addWorker();
+                if (!ctx) {
+                    return false;
+                }
+                added.push_back(ctx);
             }
-
-            {
-                std::lock_guard<std::mutex> lock(state_mutex_);
-                if (total_bytes_ == 0) {
-                    total_bytes_ = downloaded_bytes_;
+            while (live_workers_ < workerLimit() && !hasError() && tryAcquireSlot()) {
+                RangeContext* ctx = addWorker();
+                if (!ctx) {
+                    releaseSlot();
+                    break;
                 }
+                added.push_back(ctx);
             }
-
-            setRunning(false);
-            return;
         }
 
-        {
-            std::lock_guard<std::mutex> lock(state_mutex_);
-            total_bytes_ = metadata.content_length;
-            downloaded_bytes_ = 0;
+        for (RangeContext* ctx : added) {
+            if (engine_) {
+                submitNextLease(*ctx);
+            } else {
+                std::lock_guard<std::mutex> lock(workers_mutex_);
+                workers_.emplace_back([this, ctx]() { runRangeWorker(*ctx); });
+            }
         }
+        return true;
+    }
 
-        if (ftruncate(fileno(file_.get()), total_bytes_) == -1) {
-            file_.reset();
-            registerError("Cannot resize destination file");
-            return;
+    void leaveWorker() {
+        releaseSlot();
+        if (tuner_host_) {
+            tuner_->connectionClosed(*tuner_host_);
         }
+    }
 
-        workers_.reserve(thread_count_);
-        const curl_off_t part_size = std::max<curl_off_t>(1, (total_bytes_ + thread_count_ - 1) / thread_count_);
-        for (int i = 0; i < thread_count_; ++i) {
-            const curl_off_t start = static_cast<curl_off_t>(i) * part_size;
-            const curl_off_t end = std::min(start + part_size, total_bytes_);
-            if (start >= total_bytes_) {
-                break;
+    // 自动模式下级别降低时, 多出的连接在两段工作之间退出. 返回 true 时该连接已不计入
+    // live_workers_(不会是最后一个), 调用方只需释放句柄
+    bool shrinkWorker() {
+        if (!tuner_host_) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex_);
+            if (live_workers_ <= workerLimit()) {
+                return false;
             }
+            --live_workers_;
+        }
+        leaveWorker();
+        return true;
+    }
 
-            workers_.emplace_back([this, start, end]() { downloadRange(start, end); });
+    // 连接退出并归还名额, 返回是否是最后一个连接
+    bool retireWorker() {
+        leaveWorker();
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        if (--live_workers_ > 0) {
+            return false;
         }
+        workers_cv_.notify_all();
+        return true;
+    }
 
+    void joinWorkers() {
         for (auto& worker : workers_) {
             if (worker.joinable()) {
                 worker.join();
             }
         }
         workers_.clear();
+    }
+
+    // 连接超时和卡顿检测: 速度低于 low_speed_limit 持续 low_speed_time 秒即视为失败, 交给重试逻辑.
+    // 限速时单个连接的速度本来就可能很低, 按顺序输出时连接会等下游或重排窗口, 都不做卡顿检测
+    void configureTimeouts(CURL* curl) const {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, options_.connect_timeout);
+        if (options_.low_speed_limit > 0 && options_.low_speed_time > 0 && !rateLimited() && !streaming()) {
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, options_.low_speed_limit);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, options_.low_speed_time);
+        }
+    }
 
-        if (file_) {
-            std::fflush(file_.get());
-            file_.reset();
+    // 显式要求 HTTP/2 时, 新请求先等正在建立的连接协商出结果(PIPEWAIT), 能复用就作为流加入, 而不是
+    // 各自再开连接. 句柄归还池时会被 reset, 所以每次配置请求都要重新设置
+    void configureHttpVersion(CURL* curl) const {
+        switch (options_.http_version) {
+        case HttpVersion::Default:
+            return;
+        case HttpVersion::Http2:
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2_0));
+            break;
+        case HttpVersion::Http2PriorKnowledge:
+            // libcurl 8.0 之前, 带 PRIOR_KNOWLEDGE 的请求复用已有的 h2c 连接时会报 HTTP2 framing 错误.
+            // 已知主机是 HTTP/2(本任务的探测请求, 或共用句柄池的其他任务协商到了)后改用普通的 HTTP/2
+            // 请求, 一样会复用已有连接. 还不知道时仍用 PRIOR_KNOWLEDGE, 但要新开连接, 不能等着复用
+            // 其他任务正在建立的 h2c 连接
+            if (priorKnowledgeReuseBroken() && knownHttp2()) {
+                curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2_0));
+            } else {
+                curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE));
+                if (priorKnowledgeReuseBroken()) {
+                    curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+                }
+            }
+            break;
         }
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
 
-        setRunning(false);
+    [[nodiscard]] bool knownHttp2() const {
+        return http2_.load(std::memory_order_relaxed) || (handles_ && handles_->isHttp2Host(host_));
     }
 
-    [[nodiscard]] Progress getProgress() const {
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        return {
-            url_, 
-            destination_, 
-            static_cast<std::uint64_t>(total_bytes_), 
-            static_cast<std::uint64_t>(downloaded_bytes_), 
-            is_running_, 
-            has_error_,
-            error_message_
-        };
+    static bool priorKnowledgeReuseBroken() {
+        static const bool broken = curl_version_info(CURLVERSION_NOW)->version_num < 0x080000;
+        return broken;
     }
 
-    [[nodiscard]] bool isRunning() const {
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        return is_running_;
+    // 进度回调只用来检查取消, 返回非 0 时 curl 以 CURLE_ABORTED_BY_CALLBACK 中止传输.
+    // 连接建立和传输暂停期间也会调用, 不必等到有数据
+    void configureCancel(CURL* curl) {
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &Impl::progressCallback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
     }
 
-    [[nodiscard]] bool hasError() const {
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        return has_error_;
+    static int progressCallback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+        return static_cast<Impl*>(userdata)->cancelled_.load(std::memory_order_relaxed) ? 1 : 0;
     }
 
-private:
-    struct FileDeleter {
-        void operator()(FILE* fp) const noexcept {
-            if (fp) {
-                std::fclose(fp);
+    void configureRangeRequest(CURL* curl, RangeContext& ctx) {
+        curl_easy_setopt(curl, CURLOPT_URL, mirrors_[ctx.mirror].url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &Impl::writeCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &Impl::headerCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &ctx);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        configureTimeouts(curl);
+        configureHttpVersion(curl);
+        configureCancel(curl);
+    }
+
+    void applyLeaseRange(RangeContext& ctx) {
+        ctx.range = std::to_string(ctx.lease.from) + "-" + std::to_string(ctx.lease.to - 1);
+        curl_easy_setopt(ctx.curl.get(), CURLOPT_RANGE, ctx.range.c_str());
+        ctx.requested_from = ctx.lease.from;
+        ctx.response_checked = false;
+    }
+
+    // 领取下一段工作并设置请求区间, 没有工作时返回 false
+    bool nextLease(RangeContext& ctx) {
+        if (!scheduler_->acquire(ctx.lease)) {
+            ctx.has_lease = false;
+            return false;
+        }
+
+        ctx.has_lease = true;
+        ctx.attempts = 0;
+        if (mirrors_.size() > 1) {
+            std::lock_guard<std::mutex> lock(mirrors_mutex_);
+            useMirrorLocked(ctx, pickMirrorLocked(ctx.mirror, false));
+        }
+        applyLeaseRange(ctx);
+        return true;
+    }
+
+    // ---- 多个源: 每段工作开始时按各源实测的单连接吞吐选源. 分片本来就是连接做完一段再领下一段,
+    // 快的源上的连接领得多, 各源分到的数据量自然与其速度成比例 ----
+
+    static constexpr std::size_t kNoMirror = std::numeric_limits<std::size_t>::max();
+    static constexpr int kMirrorFailures = 3;
+    static constexpr double kMirrorSwitchRatio = 1.5;
+    static constexpr curl_off_t kMirrorSampleBytes = 64 * 1024;
+
+    // 先让每个源都试一次, 再选单连接吞吐最高的; 还没测出速度的源之间选分到工作最少的.
+    // 当前的源已测过速度时, 别的源要快出 kMirrorSwitchRatio 倍才换, 免得连接在速度相近的源之间来回切换.
+    // exclude_current 为 true 时不选当前的源, 没有别的可用源时返回 kNoMirror
+    [[nodiscard]] std::size_t pickMirrorLocked(std::size_t current, bool exclude_current) const {
+        const auto rank = [](const Mirror& m) { return m.leases == 0 ? 0 : m.rate > 0.0 ? 1 : 2; };
+        std::size_t best = kNoMirror;
+        for (std::size_t i = 0; i < mirrors_.size(); ++i) {
+            const Mirror& m = mirrors_[i];
+            if (m.dropped || (exclude_current && i == current)) {
+                continue;
+            }
+            if (best == kNoMirror) {
+                best = i;
+                continue;
+            }
+            const Mirror& b = mirrors_[best];
+            const bool better = rank(m) != rank(b) ? rank(m) < rank(b)
+                                : rank(m) == 1    ? m.rate > b.rate
+                                                  : m.leases < b.leases;
+            if (better) {
+                best = i;
             }
         }
-    };
 
-    struct FileMetadata {
-        bool supports_range{false};
-        curl_off_t content_length{0};
-    };
+        // 当前的源可用时 best 不会是 kNoMirror
+        const Mirror& now = mirrors_[current];
+        if (!exclude_current && best != current && !now.dropped && now.rate > 0.0 && rank(mirrors_[best]) != 0 &&
+            mirrors_[best].rate < now.rate * kMirrorSwitchRatio) {
+            return current;
+        }
+        return best;
+    }
 
-    struct RangeContext {
-        Impl* owner{nullptr};
-        curl_off_t start{0};
-        curl_off_t hasWritten{0};
-    };
+    void useMirrorLocked(RangeContext& ctx, std::size_t index) {
+        if (index == kNoMirror) {
+            return;
+        }
+        ++mirrors_[index].leases;
+        if (index != ctx.mirror) {
+            ctx.mirror = index;
+            curl_easy_setopt(ctx.curl.get(), CURLOPT_URL, mirrors_[index].url.c_str());
+        }
+    }
+
+    // 一次传输结束后更新所用源的速度; 太小的传输主要反映延迟, 不计入
+    void noteMirrorTransfer(RangeContext& ctx, bool ok) {
+        curl_off_t bytes = 0;
+        curl_off_t speed = 0;
+        curl_easy_getinfo(ctx.curl.get(), CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+        curl_easy_getinfo(ctx.curl.get(), CURLINFO_SPEED_DOWNLOAD_T, &speed);
+
+        std::lock_guard<std::mutex> lock(mirrors_mutex_);
+        Mirror& mirror = mirrors_[ctx.mirror];
+        if (ok) {
+            mirror.failures = 0;
+        }
+        if (bytes >= kMirrorSampleBytes && speed > 0) {
+            const auto sample = static_cast<double>(speed);
+            mirror.rate = mirror.rate > 0.0 ? 0.5 * mirror.rate + 0.5 * sample : sample;
+        }
+    }
 
-    [[nodiscard]] FileMetadata fetchMetadata() const {
-        using CurlHandle = std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>;
+    // 当前的源出错后给 ctx 换一个可用的源, 没有别的源时返回 false. fatal 表示这个源不会再成功(404、
+    // 内容与主 URL 不符), 直接弃用; 否则连续失败 kMirrorFailures 次才弃用. 最后一个可用的源不会被弃用
+    bool failoverMirror(RangeContext& ctx, bool fatal) {
+        std::lock_guard<std::mutex> lock(mirrors_mutex_);
+        Mirror& failed = mirrors_[ctx.mirror];
+        const auto live = std::count_if(mirrors_.begin(), mirrors_.end(), [](const Mirror& m) { return !m.dropped; });
+        if (!failed.dropped && (fatal || ++failed.failures >= kMirrorFailures) && live > 1) {
+            failed.dropped = true;
+        }
+        const std::size_t next = pickMirrorLocked(ctx.mirror, true);
+        if (next == kNoMirror) {
+            return false;
+        }
+        useMirrorLocked(ctx, next);
+        return true;
+    }
 
-        FileMetadata meta;
-        CurlHandle curl{curl_easy_init(), &curl_easy_cleanup};
-        if (!curl) {
-            return meta;
+    // 分片响应必须是 206, 且 Content-Range 的起点与请求一致、总大小与元数据一致. 服务器忽略 Range
+    // 返回整个文件, 或者某个源上的文件大小不同时, 写进去的都是错的数据. 非 HTTP 协议不检查
+    [[nodiscard]] bool checkRangeResponse(const RangeContext& ctx) const {
+        char* scheme = nullptr;
+        curl_easy_getinfo(ctx.curl.get(), CURLINFO_SCHEME, &scheme);
+        if (scheme && ::strncasecmp(scheme, "http", 4) != 0) {
+            return true;
         }
+        long code = 0;
+        curl_easy_getinfo(ctx.curl.get(), CURLINFO_RESPONSE_CODE, &code);
+        const auto range = detail::parseContentRange(ctx.content_range);
+        return code == 206 && range && range->first == ctx.requested_from && range->total == validators_.size;
+    }
 
-        curl_easy_setopt(curl.get(), CURLOPT_URL, url_.c_str());
-        curl_easy_setopt(curl.get(), CURLOPT_NOBODY, 1L);
-        curl_easy_setopt(curl.get(), CURLOPT_HEADER, 1L);
-        curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
+    // 只记下 Content-Range, 收到第一块数据时再核对. 有重定向时每个响应都从状态行重新开始
+    static size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
+        auto* ctx = static_cast<RangeContext*>(userdata);
+        const size_t total = size * nitems;
+        constexpr std::string_view kField = "content-range:";
+        const std::string_view line(buffer, total);
+        if (line.rfind("HTTP/", 0) == 0) {
+            ctx->content_range.clear();
+        } else if (line.size() > kField.size() && ::strncasecmp(line.data(), kField.data(), kField.size()) == 0) {
+            ctx->content_range.assign(line.substr(kField.size()));
+        }
+        return total;
+    }
 
-        std::string headers;
-        curl_easy_setopt( curl.get(), CURLOPT_WRITEFUNCTION,
-            +[](char* ptr, size_t size, size_t nmemb, std::string* out) -> size_t {
-                if (!out) {
-                    return 0;
-                }
-                out->append(ptr, size * nmemb);
-                return size * nmemb;
-            });
-        curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &headers);
+    // 传输层错误(连接重置, 超时, 卡顿)与 408/429/5xx 可以重试; 本地写文件失败、URL 错误等不重试.
+    // CURLE_OK 表示服务器提前结束了响应, 同样重试
+    static bool isRetryable(CURL* curl, CURLcode res) {
+        switch (res) {
+        case CURLE_HTTP_RETURNED_ERROR: {
+            long code = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+            return code == 408 || code == 429 || code >= 500;
+        }
+        case CURLE_WRITE_ERROR:
+        case CURLE_ABORTED_BY_CALLBACK:
+        case CURLE_OUT_OF_MEMORY:
+        case CURLE_FAILED_INIT:
+        case CURLE_URL_MALFORMAT:
+        case CURLE_UNSUPPORTED_PROTOCOL:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    static std::string describeFailure(CURL* curl, CURLcode res, bool rejected = false) {
+        if (rejected) {
+            long code = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+            return "Unexpected response to range request (HTTP " + std::to_string(code) +
+                   "), the server ignored the range or the file changed";
+        }
+        if (res == CURLE_OK) {
+            return "Range download incomplete";
+        }
+        if (res == CURLE_HTTP_RETURNED_ERROR) {
+            long code = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+            return "HTTP error " + std::to_string(code);
+        }
+        return std::string{"curl error: "} + curl_easy_strerror(res);
+    }
+
+    // 指数退避加抖动: base * 2^(attempt-1), 不超过上限, 再随机缩放到 [50%, 100%]
+    [[nodiscard]] std::chrono::milliseconds backoffDelay(int attempt) const {
+        const auto base = std::max<std::uint64_t>(1, options_.retry_base_delay_ms);
+        const auto cap = std::max(base, options_.retry_max_delay_ms);
+        const int shift = std::min(attempt - 1, 30);
+        const auto delay = std::min<std::uint64_t>(cap, base << shift);
+
+        thread_local std::mt19937_64 rng{std::random_device{}()};
+        std::uniform_real_distribution<double> jitter(0.5, 1.0);
+        return std::chrono::milliseconds{static_cast<std::int64_t>(static_cast<double>(delay) * jitter(rng))};
+    }
 
-        if (curl_easy_perform(curl.get()) == CURLE_OK) {
+    // 返回值有值时表示这段工作需要在该延迟后重试(请求区间已更新为续传位置, 不重复下载已写入的部分)
+    std::optional<std::chrono::milliseconds> finishLease(RangeContext& ctx, CURLcode res) {
+        // 被窃取截断或重复请求先完成而主动中止的传输不算失败
+        const bool transfer_ok = res == CURLE_OK || scheduler_->finished(ctx.lease);
+        const bool rejected = std::exchange(ctx.rejected, false);
+        noteTransfer(ctx.curl.get(), transfer_ok, mirrors_[ctx.mirror].host);
+        if (mirrors_.size() > 1) {
+            noteMirrorTransfer(ctx, transfer_ok);
+        }
+        // 一次传输结束就把缓冲区交出去, 续传或下一段工作的偏移一般不再连续
+        flushBuffer(ctx);
+        if (tuner_host_ && res == CURLE_HTTP_RETURNED_ERROR) {
             long code = 0;
-            curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &code);
-            meta.supports_range = (code == 200 || code == 206);
+            curl_easy_getinfo(ctx.curl.get(), CURLINFO_RESPONSE_CODE, &code);
+            if (code == 429 || code == 503) {
+                tuner_->onThrottled(*tuner_host_);
+            }
+        }
+        // 分片被窃取截断或由重复请求先完成时, 写回调会主动中止传输, 这种情况不算错误
+        if (!scheduler_->finished(ctx.lease)) {
+            if (ctx.lease.duplicate) {
+                // 重复请求失败不影响仍在下载的主连接
+                scheduler_->release(ctx.lease);
+                ctx.has_lease = false;
+                return std::nullopt;
+            }
 
-            if (headers.find("Accept-Ranges: bytes") != std::string::npos) {
-                meta.supports_range = true;
+            // 还有别的源时立即换源续传, 不消耗这段工作的重试次数; 出错的源多次失败后被弃用
+            const std::string& failed_host = mirrors_[ctx.mirror].host;
+            const bool retryable = !rejected && isRetryable(ctx.curl.get(), res);
+            if (mirrors_.size() > 1 && !hasError() && failoverMirror(ctx, !retryable) &&
+                scheduler_->resume(ctx.lease)) {
+                noteRetry(failed_host);
+                applyLeaseRange(ctx);
+                return std::chrono::milliseconds{0};
             }
 
-            curl_off_t length = 0;
-            curl_easy_getinfo(curl.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
-            //保证不为负数, 如果没有返回length字段的值, 将返回-1
-            meta.content_length = std::max<curl_off_t>(0, length); 
+            const bool may_retry = !hasError() && ctx.attempts < options_.max_retries && retryable;
+            if (may_retry && scheduler_->resume(ctx.lease)) {
+                ++ctx.attempts;
+                noteRetry(mirrors_[ctx.mirror].host);
+                applyLeaseRange(ctx);
+                return backoffDelay(ctx.attempts);
+            }
+
+            if (!scheduler_->finished(ctx.lease)) {
+                std::string message = describeFailure(ctx.curl.get(), res, rejected);
+                if (ctx.attempts > 0) {
+                    message += " (after " + std::to_string(ctx.attempts) + " retries)";
+                }
+                scheduler_->release(ctx.lease);
+                ctx.has_lease = false;
+                registerError(std::move(message), false);
+                scheduler_->cancel();
+                return std::nullopt;
+            }
         }
 
-        return meta;
+        scheduler_->release(ctx.lease);
+        ctx.has_lease = false;
+        catchUpHash(false, kHashCatchUp);
+        return std::nullopt;
+    }
+
+    void finishRanges() {
+        stopJournalThread();
+        drainWrites();
+        if (!hasError() && !scheduler_->complete()) {
+            registerError("Range download incomplete", false);
+        }
+
+        // 校验失败说明已写的数据不可信, 删除日志让下次从头下载
+        if (!hasError() && !verifyChecksum(validators_.size)) {
+            if (use_journal_) {
+                journal_.remove();
+            }
+            return;
+        }
+
+        // 完整下载后删除日志, 失败时保留已落盘的区间供下次续传
+        if (!hasError()) {
+            if (use_journal_) {
+                journal_.remove();
+            }
+        } else {
+            saveJournal(true);
+        }
+    }
+
+    void configureSimpleRequest(CURL* curl, RangeContext& ctx) {
+        curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &Impl::writeCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        configureTimeouts(curl);
+        configureHttpVersion(curl);
+        configureCancel(curl);
+    }
+
+    // 不支持分片时无法续传, 重试只能截断文件从头开始
+    std::optional<std::chrono::milliseconds> finishSimple(RangeContext& ctx, CURLcode res) {
+        noteTransfer(ctx.curl.get(), res == CURLE_OK, host_);
+        if (res == CURLE_OK) {
+            if (!hasError() && checkExpectedSize(static_cast<std::uint64_t>(ctx.hasWritten))) {
+                verifyChecksum(ctx.hasWritten);
+            }
+            return std::nullopt;
+        }
+
+        if (!hasError() && ctx.attempts < options_.max_retries && isRetryable(ctx.curl.get(), res) &&
+            restartOutput()) {
+            if (stream_) {
+                // 已经输出的部分收不回来, 重新请求时跳过这么多字节
+                ctx.skip = ctx.hasWritten;
+            } else {
+                downloaded_bytes_.fetch_sub(static_cast<std::uint64_t>(ctx.hasWritten), std::memory_order_relaxed);
+                ctx.hasWritten = 0;
+                resetChecksum();
+            }
+            ++ctx.attempts;
+            noteRetry(host_);
+            return backoffDelay(ctx.attempts);
+        }
+
+        std::string message = describeFailure(ctx.curl.get(), res);
+        if (ctx.attempts > 0) {
+            message += " (after " + std::to_string(ctx.attempts) + " retries)";
+        }
+        registerError(std::move(message), false);
+        return std::nullopt;
+    }
+
+    // 不支持分片的下载从头重试前清空已写的内容; 按顺序输出时写出去的收不回来, 由写回调跳过
+    bool restartOutput() {
+        if (stream_) {
+            return true;
+        }
+        if (sink()) {
+            std::string error;
+            return sink()->open(Sink::kUnknownSize, error);
+        }
+        return ftruncate(file_.get(), 0) == 0;
     }
 
-    void downloadRange(curl_off_t start, curl_off_t end) {
-        using CurlHandle = std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>;
+    void runRangeWorker(RangeContext& ctx) {
+        while (true) {
+            if (shrinkWorker()) {
+                ctx.curl.reset();
+                return;
+            }
+            if (!nextLease(ctx)) {
+                break;
+            }
+            while (const auto retry = finishLease(ctx, curl_easy_perform(ctx.curl.get()))) {
+                waitForRetry(*retry);
+            }
+            growWorkers();
+        }
+        ctx.curl.reset();
+        retireWorker();
+    }
 
-        CurlHandle curl{curl_easy_init(), &curl_easy_cleanup};
-        if (!curl) {
+    void simplDownload() {
+        RangeContext ctx;
+        ctx.owner = this;
+        ctx.curl = newHandle();
+        if (!ctx.curl) {
             registerError("Failed to allocate curl handle", false);
             return;
         }
 
-        RangeContext ctx{this, start, 0};
-        const std::string range = std::to_string(start) + "-" + std::to_string(end - 1);
+        configureSimpleRequest(ctx.curl.get(), ctx);
+        while (const auto retry = finishSimple(ctx, curl_easy_perform(ctx.curl.get()))) {
+            waitForRetry(*retry);
+        }
+    }
+
+    // ---- 事件驱动模式: 以下回调都运行在引擎的事件循环线程上 ----
+
+    void onMetadata(const FileMetadata& metadata) {
+        if (hasError()) {
+            finishRun();
+            completeAsync();
+            return;
+        }
+
+        if (metadata.not_modified) {
+            finishFromCache();
+            finishRun();
+            completeAsync();
+            return;
+        }
+
+        if (metadata.whole_file) {
+            finishWholeFile();
+            finishRun();
+            completeAsync();
+            return;
+        }
+
+        if (!metadata.supports_range || metadata.content_length == 0) {
+            auto ctx = std::make_unique<RangeContext>();
+            ctx->owner = this;
+            ctx->curl = newHandle();
+            if (!ctx->curl) {
+                registerError("Failed to allocate curl handle", false);
+                finishRun();
+                completeAsync();
+                return;
+            }
 
-        curl_easy_setopt(curl.get(), CURLOPT_URL, url_.c_str());
-        curl_easy_setopt(curl.get(), CURLOPT_RANGE, range.c_str());
-        curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, &Impl::writeCallback);
-        curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &ctx);
-        curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl.get(), CURLOPT_FAILONERROR, 1L);
-        curl_easy_setopt(curl.get(), CURLOPT_NOPROGRESS, 1L);
+            if (!truncateFile()) {
+                finishRun();
+                completeAsync();
+                return;
+            }
 
-        const CURLcode res = curl_easy_perform(curl.get());
-        if (res != CURLE_OK) {
-            registerError(std::string{"curl error: "} + curl_easy_strerror(res), false);
+            configureSimpleRequest(ctx->curl.get(), *ctx);
+            RangeContext* raw = ctx.get();
+            ranges_.push_back(std::move(ctx));
+            submitSimple(*raw, std::chrono::milliseconds{0});
             return;
         }
 
-        const curl_off_t expected = end - start;
-        if (ctx.hasWritten != expected) {
-            registerError("Range download incomplete", false);
+        if (!prepareRanges(metadata)) {
+            finishRun();
+            completeAsync();
+            return;
+        }
+
+        if (scheduler_->complete() || !growWorkers(true)) {
+            finishRanges();
+            finishRun();
+            completeAsync();
         }
     }
 
-    void simplDownload() {
-        using CurlHandle = std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>;
+    void submitSimple(RangeContext& ctx, std::chrono::milliseconds delay) {
+        RangeContext* raw = &ctx;
+        engine_->submit(ctx.curl.get(), [this, raw](CURL*, CURLcode res) {
+            if (const auto retry = finishSimple(*raw, res)) {
+                submitSimple(*raw, *retry);
+                return;
+            }
+            finishRun();
+            completeAsync();
+        }, delay);
+    }
 
-        CurlHandle curl{curl_easy_init(), &curl_easy_cleanup};
-        if (!curl) {
-            registerError("Failed to allocate curl handle", false);
+    // 连接完成一段工作后立即领取下一段, 没有工作时该连接退出
+    void submitNextLease(RangeContext& ctx) {
+        if (shrinkWorker()) {
+            ctx.curl.reset();
+            return;
+        }
+        if (!nextLease(ctx)) {
+            ctx.curl.reset();
+            onRangeDone();
             return;
         }
+        submitLease(ctx, std::chrono::milliseconds{0});
+    }
 
-        RangeContext ctx{this, 0, 0};
-        curl_easy_setopt(curl.get(), CURLOPT_URL, url_.c_str());
-        curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, &Impl::writeCallback);
-        curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &ctx);
-        curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
+    void submitLease(RangeContext& ctx, std::chrono::milliseconds delay) {
+        RangeContext* raw = &ctx;
+        engine_->submit(ctx.curl.get(), [this, raw](CURL*, CURLcode res) {
+            if (const auto retry = finishLease(*raw, res)) {
+                submitLease(*raw, *retry);
+                return;
+            }
+            growWorkers();
+            submitNextLease(*raw);
+        }, delay);
+    }
 
-        const CURLcode res = curl_easy_perform(curl.get());
-        if (res != CURLE_OK) {
-            registerError(std::string{"curl error: "} + curl_easy_strerror(res), false);
+    void onRangeDone() {
+        if (!retireWorker()) {
             return;
         }
+        finishRanges();
+        finishRun();
+        completeAsync();
+    }
+
+    void completeAsync() {
+        std::function<void()> on_finished;
+        {
+            std::lock_guard<std::mutex> lock(async_mutex_);
+            on_finished = std::move(on_finished_);
+        }
+        if (on_finished) {
+            on_finished();
+        }
+
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_active_ = false;
+        async_cv_.notify_all();
+    }
+
+    void waitUntilFinished() {
+        std::unique_lock<std::mutex> lock(async_mutex_);
+        async_cv_.wait(lock, [this] { return !async_active_; });
+    }
+
+    // 阻塞线程模式下的重试退避, 取消时提前返回
+    void waitForRetry(std::chrono::milliseconds delay) {
+        std::unique_lock<std::mutex> lock(cancel_mutex_);
+        cancel_cv_.wait_for(lock, delay, [this] { return cancelled_.load(std::memory_order_relaxed); });
+    }
+
+    [[nodiscard]] bool rateLimited() const {
+        return global_limiter_ || task_limiter_;
+    }
+
+    [[nodiscard]] bool streaming() const {
+        return options_.stream_fd >= 0 && !options_.sink;
+    }
+
+    [[nodiscard]] Sink* sink() const {
+        return options_.sink.get();
+    }
+
+    // 在接收端限速: 按全局与任务两级令牌桶预约额度, 返回 false 表示这批数据要暂停后重新交付.
+    // 阻塞线程模式下直接在写回调里等待, 不读 socket 就是对服务器的反压;
+    // 事件驱动模式下不能阻塞事件循环, 改为暂停这个传输, 到期后由引擎恢复
+    bool throttle(RangeContext& ctx, std::uint64_t bytes) {
+        if (ctx.prepaid >= bytes) {
+            ctx.prepaid -= bytes;
+            return true;
+        }
+        const std::uint64_t need = bytes - ctx.prepaid;
+        ctx.prepaid = 0;
 
+        std::chrono::nanoseconds delay{0};
+        if (global_limiter_) {
+            delay = std::max(delay, global_limiter_->acquire(need));
+        }
+        if (task_limiter_) {
+            delay = std::max(delay, task_limiter_->acquire(need));
+        }
+        if (delay < std::chrono::milliseconds(1)) {
+            return true;
+        }
+
+        if (!engine_) {
+            std::this_thread::sleep_for(delay);
+            return true;
+        }
+        ctx.prepaid = need;
+        engine_->resumeAfter(ctx.curl.get(), delay);
+        return false;
+    }
+
+    // pwrite 全部数据, 返回实际写入的字节数
+    static size_t writeAt(int fd, const char* data, size_t length, curl_off_t offset) {
+        size_t written = 0;
+        while (written < length) {
+            const ssize_t n = ::pwrite(fd, data + written, length - written,
+                                       static_cast<off_t>(offset) + static_cast<off_t>(written));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return written;
+    }
+
+    // 写到 sink 或目标文件, 返回实际写入的字节数
+    size_t writeOutput(const char* data, size_t length, curl_off_t offset) {
+        if (sink()) {
+            return sink()->write(data, length, static_cast<std::uint64_t>(offset)) ? length : 0;
+        }
+        return writeAt(file_.get(), data, length, offset);
     }
 
     static size_t writeCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
@@ -253,91 +1911,314 @@ private:
             return 0;
         }
 
-        std::lock_guard<std::mutex> file_lock(self.file_mutex_);
-        FILE* file = self.file_.get();
-        if (!file) {
+        if (self.cancelled_.load(std::memory_order_relaxed) || (!self.file_ && !self.stream_ && !self.sink())) {
             return 0;
         }
 
-        if (fseeko(file, ctx->start + ctx->hasWritten, SEEK_SET) != 0) {
-            self.registerError("Failed to seek output file", false);
+        if (ctx->has_lease && !ctx->response_checked) {
+            if (!self.checkRangeResponse(*ctx)) {
+                ctx->rejected = true;
+                return 0;
+            }
+            ctx->response_checked = true;
+        }
+
+        // 先等重排窗口再限速, 暂停后重新交付的数据不会被重复计入限速额度
+        if (self.stream_ && ctx->has_lease && !self.waitForStreamRoom(*ctx, total)) {
+            return self.hasError() ? 0 : CURL_WRITEFUNC_PAUSE;
+        }
+        if (self.rateLimited() && !self.throttle(*ctx, total)) {
+            return CURL_WRITEFUNC_PAUSE;
+        }
+
+        if (!ctx->has_lease) {
+            size_t skipped = 0;
+            if (ctx->skip > 0) {
+                skipped = static_cast<size_t>(std::min<curl_off_t>(ctx->skip, static_cast<curl_off_t>(total)));
+                ctx->skip -= static_cast<curl_off_t>(skipped);
+                ptr += skipped;
+            }
+            const size_t length = total - skipped;
+            size_t written = 0;
+            if (self.stream_) {
+                written = length == 0 || self.stream_->push(ptr, length, ctx->hasWritten) ? length : 0;
+            } else {
+                written = self.writeOutput(ptr, length, ctx->hasWritten);
+                self.hashInOrder(ptr, written, ctx->hasWritten);
+            }
+            ctx->hasWritten += static_cast<curl_off_t>(written);
+            self.downloaded_bytes_.fetch_add(written, std::memory_order_relaxed);
+            if (written != length) {
+                self.registerError(self.stream_ ? "Failed to write output stream" : "Failed to write output file",
+                                   false);
+                return skipped + written;
+            }
+            return total;
+        }
+
+        // 分片可能已被窃取截断或由另一个连接完成, 此时只写允许的部分, 返回值不足会让 curl 中止这次传输
+        auto& scheduler = *self.scheduler_;
+        const size_t allowed = scheduler.reserve(ctx->lease, total);
+        if (allowed == 0) {
             return 0;
         }
 
-        const size_t written = std::fwrite(ptr, 1, total, file);
-        if (written != total) {
-            self.registerError("Failed to write output file", false);
-            return written;
+        // 每个连接只写自己的区间, pwrite 自带偏移, 无需加锁或 seek; 映射输出或有写入流水线时只做一次内存拷贝
+        size_t written = 0;
+        if (self.stream_) {
+            written = self.stream_->push(ptr, allowed, ctx->lease.cursor) ? allowed : 0;
+        } else if (self.map_) {
+            written = self.mapWrite(*ctx, ptr, allowed, ctx->lease.cursor);
+        } else if (self.writer_) {
+            written = self.bufferWrite(*ctx, ptr, allowed, ctx->lease.cursor);
+        } else {
+            written = self.writeOutput(ptr, allowed, ctx->lease.cursor);
+        }
+        if (!self.stream_) {
+            self.hashInOrder(ptr, written, ctx->lease.cursor);
+        }
+        const curl_off_t credit = scheduler.commit(ctx->lease, written);
+        self.downloaded_bytes_.fetch_add(static_cast<std::uint64_t>(credit), std::memory_order_relaxed);
+        if (self.tuner_host_) {
+            self.tuner_->addBytes(*self.tuner_host_, static_cast<std::uint64_t>(credit));
         }
 
-        ctx->hasWritten += static_cast<curl_off_t>(written);
-        {
-            std::lock_guard<std::mutex> state_lock(self.state_mutex_);
-            self.downloaded_bytes_ += static_cast<curl_off_t>(written);
+        // 大分片可能要下载很久, 期间也接手其他任务释放的连接名额; 平时只有几次 relaxed 读
+        const auto now = steadyNowNs();
+        if ((self.budget_ || self.tuner_host_) && now >= self.grow_due_ns_.load(std::memory_order_relaxed)) {
+            self.grow_due_ns_.store(now + kGrowIntervalNs, std::memory_order_relaxed);
+            if (self.tuner_host_) {
+                self.tuner_->maybeAdjust(*self.tuner_host_);
+            }
+            self.growWorkers();
+        }
+        if (self.checksum_ && now >= self.hash_due_ns_.load(std::memory_order_relaxed)) {
+            self.hash_due_ns_.store(now + kGrowIntervalNs, std::memory_order_relaxed);
+            self.catchUpHash(false, kHashCatchUp);
         }
 
-        return written;
+        if (written != allowed) {
+            self.registerError(self.stream_ ? "Failed to write output stream" : "Failed to write output file",
+                               false);
+            return written;
+        }
+        return allowed;
     }
 
-    void resetState() {
-        for (auto& worker : workers_) {
-            if (worker.joinable()) {
-                worker.join();
+    // 分片数据超出重排窗口时: 阻塞线程模式下在写回调里等, 事件驱动模式下暂停这个传输, 稍后由引擎恢复
+    // 再重新交付. 返回 false 表示现在不能接收(输出失败时已登记错误)
+    bool waitForStreamRoom(RangeContext& ctx, size_t length) {
+        const curl_off_t offset = ctx.lease.cursor;
+        while (!stream_->hasRoom(offset, length)) {
+            if (stream_->failed() || hasError()) {
+                if (stream_->failed()) {
+                    registerError("Failed to write output stream", false);
+                }
+                return false;
             }
+            if (engine_) {
+                engine_->resumeAfter(ctx.curl.get(), kStreamRetry);
+                return false;
+            }
+            stream_->waitForRoom(offset, length, std::chrono::milliseconds{100});
         }
-        workers_.clear();
-        file_.reset();
+        return true;
+    }
 
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        total_bytes_ = 0;
-        downloaded_bytes_ = 0;
-        has_error_ = false;
-        error_message_.clear();
-        is_running_ = false;
+    void resetState() {
+        waitUntilFinished();
+
+        joinWorkers();
+        stopJournalThread();
+        drainWrites();
+        unflushed_.clear();
+        ranges_.clear();
+        live_workers_ = 0;
+        max_workers_ = 1;
+        releaseAllSlots();
+        http2_.store(false, std::memory_order_relaxed);
+        multiplexed_.store(false, std::memory_order_relaxed);
+        scheduler_.reset();
+        use_journal_ = false;
+        metadata_curl_.reset();
+        unmapFile();
+        closeFiles();
+        for (auto& mirror : mirrors_) {
+            mirror.dropped = false;
+            mirror.failures = 0;
+            mirror.leases = 0;
+            mirror.rate = 0.0;
+        }
+
+        clearError();
+        total_bytes_.store(0, std::memory_order_relaxed);
+        downloaded_bytes_.store(0, std::memory_order_relaxed);
+        setRunning(false);
     }
 
+    // 错误路径很少走到, 只有错误信息字符串需要锁保护
     void registerError(std::string message, bool stop_immediately = true) {
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        has_error_ = true;
-        if (error_message_.empty()) {
-            error_message_ = std::move(message);
+        {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (error_message_.empty()) {
+                error_message_ = std::move(message);
+            }
         }
+        has_error_.store(true, std::memory_order_release);
         if (stop_immediately) {
-            is_running_ = false;
+            setRunning(false);
         }
     }
 
+    void clearError() {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        error_message_.clear();
+        has_error_.store(false, std::memory_order_release);
+    }
+
     void setRunning(bool running) {
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        is_running_ = running;
+        is_running_.store(running, std::memory_order_release);
     }
 
     std::string url_;
     std::string destination_;
+    DownloadOptions options_;
     int thread_count_;
-
-    std::unique_ptr<FILE, FileDeleter> file_{};
+    std::shared_ptr<detail::CurlMultiEngine> engine_;
+    std::shared_ptr<detail::ConnectionBudget> budget_;
+    std::shared_ptr<detail::CurlHandlePool> handles_;
+    std::shared_ptr<detail::ConcurrencyTuner> tuner_;
+    std::shared_ptr<detail::RateLimiter> global_limiter_;
+    std::unique_ptr<detail::RateLimiter> task_limiter_;
+    std::shared_ptr<detail::WriteBehind> writer_;
+    std::shared_ptr<detail::TransferMetrics> metrics_;
+    std::shared_ptr<detail::DownloadCache> cache_;
+    detail::ConcurrencyTuner::Host* tuner_host_{nullptr};
+    const std::string host_;
+    std::atomic<int> held_slots_{0};
+    std::atomic<int> free_streams_{0};          // 复用连接、没有占名额的分片数
+    std::atomic<bool> http2_{false};            // 探测请求协商到了 HTTP/2
+    std::atomic<bool> multiplexed_{false};      // ...并且由事件循环驱动, 分片可以作为流复用连接
+
+    // 下载源, 构造后数量不变; 连接名额和自动调整仍按主 URL 的主机计算
+    std::vector<Mirror> mirrors_;
+    mutable std::mutex mirrors_mutex_;
+
+    FileDescriptor file_;
+    std::unique_ptr<detail::OrderedStream> stream_;   // 按顺序输出时代替 file_
+    bool sink_open_{false};        // 本次运行已经 open 了 options_.sink, 结束时要 close
+    FileDescriptor direct_file_;   // --direct-io 时以 O_DIRECT 打开的同一个文件, 只给写线程用
+    char* map_{nullptr};           // --mmap 时整个目标文件的可写映射
+    size_t map_size_{0};
+
+    std::optional<detail::Checksum::Spec> checksum_spec_;
+    std::unique_ptr<detail::Checksum> checksum_;   // 未指定 --checksum 时为空
+    std::mutex hash_mutex_;
+    std::atomic<curl_off_t> hash_frontier_{0};     // 之前的数据都已经算进摘要
+    std::atomic<std::int64_t> hash_due_ns_{0};
+    std::vector<char> hash_buffer_;
+    std::unique_ptr<detail::ChunkScheduler> scheduler_;
+
+    // 交给写线程但还没写完的数据
+    std::mutex write_mutex_;
+    std::condition_variable write_cv_;
+    int inflight_writes_{0};
+    std::vector<detail::ResumeJournal::Range> unflushed_;   // 缓冲区覆盖的区间, 写完后移除
+
+    // 分片连接: 数量在 [1, max_workers_] 之间随预算和自动级别变化, 下面几项由 workers_mutex_ 保护
+    std::mutex workers_mutex_;
+    std::condition_variable workers_cv_;
     std::vector<std::thread> workers_;
-
-    mutable std::mutex state_mutex_;
-    mutable std::mutex file_mutex_;
-
-    curl_off_t total_bytes_{0};
-    curl_off_t downloaded_bytes_{0};
-    bool is_running_{false};
-    bool has_error_{false};
+    std::vector<std::unique_ptr<RangeContext>> ranges_;
+    int live_workers_{0};
+    int max_workers_{1};
+    std::atomic<std::int64_t> grow_due_ns_{0};
+
+    // 断点续传
+    detail::ResumeJournal journal_;
+    detail::ResumeJournal::Validators validators_;
+    bool use_journal_{false};
+    std::mutex journal_mutex_;
+    std::thread journal_thread_;
+    std::mutex journal_thread_mutex_;
+    std::condition_variable journal_cv_;
+    bool journal_stop_{false};
+
+    // 本地缓存: cached_ 是开始时查到的记录, cache_entry_ 收集这次下载的校验信息和摘要
+    std::optional<detail::DownloadCache::Entry> cached_;
+    detail::DownloadCache::Entry cache_entry_;
+    std::unique_ptr<curl_slist, void (*)(curl_slist*)> conditional_headers_{nullptr, curl_slist_free_all};
+
+    // 事件驱动模式的状态
+    CurlHandle metadata_curl_;
+    std::string metadata_headers_;
+    std::string probe_body_;          // 服务器忽略 Range 时探测请求收到的响应体
+    std::string probe_range_;
+    std::uint64_t probe_limit_{0};
+    CURL* probe_curl_{nullptr};
+    bool probe_checked_{false};       // 已按响应头决定了探测响应体的去向
+    bool probe_streaming_{false};     // 有效的 206: 响应体边收边写到输出开头, probe_meta_ 是它的元数据
+    FileMetadata probe_meta_;
+    curl_off_t probe_written_{0};
+    std::vector<detail::ResumeJournal::Range> resumed_ranges_;   // prepareOutput 从断点日志载入的区间
+    std::mutex async_mutex_;
+    std::condition_variable async_cv_;
+    bool async_active_{false};
+    std::function<void()> on_finished_;
+
+    std::atomic<bool> cancelled_{false};
+    std::mutex cancel_mutex_;
+    std::condition_variable cancel_cv_;
+
+    // 热路径计数器: 写回调只做一次 relaxed fetch_add, 进度面板随时读取
+    std::atomic<std::uint64_t> total_bytes_{0};
+    std::atomic<std::uint64_t> downloaded_bytes_{0};
+    std::atomic<bool> is_running_{false};
+    std::atomic<bool> has_error_{false};
+
+    mutable std::mutex error_mutex_;
     std::string error_message_;
 };
 
-MultiDownloader::MultiDownloader(std::string url, std::string destination, int thread_count)
-    : impl_(std::make_unique<Impl>(std::move(url), std::move(destination), thread_count)) {}
+namespace {
+DownloadOptions withThreads(int thread_count) {
+    DownloadOptions options;
+    options.thread_count = thread_count;
+    return options;
+}
+} // namespace
+
+MultiDownloader::MultiDownloader(std::string url, std::string destination, int thread_count,
+                                 detail::TransferContext context)
+    : MultiDownloader(std::move(url), std::move(destination), withThreads(thread_count),
+                      std::move(context)) {}
+
+MultiDownloader::MultiDownloader(std::string url, std::string destination,
+                                 const DownloadOptions& options,
+                                 detail::TransferContext context)
+    : impl_(std::make_unique<Impl>(std::move(url), std::move(destination), options,
+                                   std::move(context))) {}
 
 MultiDownloader::~MultiDownloader() = default;
 
 void MultiDownloader::start() { impl_->start(); }
 
+bool MultiDownloader::startAsync(std::function<void()> on_finished) {
+    return impl_->startAsync(std::move(on_finished));
+}
+
+void MultiDownloader::cancel() { impl_->cancel(); }
+
 Progress MultiDownloader::getProgress() const { return impl_->getProgress(); }
 
+ProgressSnapshot MultiDownloader::snapshot() const { return impl_->snapshot(); }
+
+const std::string& MultiDownloader::url() const { return impl_->url(); }
+
+const std::string& MultiDownloader::filename() const { return impl_->filename(); }
+
+std::string MultiDownloader::errorMessage() const { return impl_->errorMessage(); }
+
 bool MultiDownloader::isRunning() const { return impl_->isRunning(); }
 
 bool MultiDownloader::hasError() const { return impl_->hasError(); }
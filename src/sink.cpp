@@ -0,0 +1,239 @@
+#include "downloader/sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace downloader {
+
+namespace {
+std::size_t roundUpPow2(std::size_t value, std::size_t minimum) {
+    std::size_t capacity = minimum;
+    while (capacity < value && capacity <= std::numeric_limits<std::size_t>::max() / 2) {
+        capacity *= 2;
+    }
+    return std::max(capacity, value);
+}
+
+// 写入的区间 [offset, offset + length) 是否落在 capacity 之内, 顺便防止溢出
+bool fits(std::uint64_t offset, std::size_t length, std::size_t capacity) {
+    return offset <= capacity && length <= capacity - offset;
+}
+} // namespace
+
+// ---- BufferPool ----
+
+BufferPool::BufferPool(std::size_t max_idle_bytes) : max_idle_bytes_(max_idle_bytes) {}
+
+BufferPool::Block BufferPool::acquire(std::size_t capacity) {
+    const std::size_t rounded = roundUpPow2(capacity, kMinBlock);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 只复用同一档的块, 免得小对象占着大块
+        auto it = idle_.find(rounded);
+        if (it != idle_.end()) {
+            Block block{std::move(it->second), it->first};
+            idle_bytes_ -= it->first;
+            idle_.erase(it);
+            return block;
+        }
+    }
+    return Block{std::unique_ptr<char[]>(new char[rounded]), rounded};
+}
+
+void BufferPool::release(Block block) {
+    if (!block.data) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_bytes_ + block.capacity > max_idle_bytes_) {
+        return;
+    }
+    idle_bytes_ += block.capacity;
+    idle_.emplace(block.capacity, std::move(block.data));
+}
+
+std::size_t BufferPool::idleBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_bytes_;
+}
+
+// ---- MemorySink ----
+
+MemorySink::MemorySink(std::shared_ptr<BufferPool> pool) : pool_(std::move(pool)) {}
+
+MemorySink::~MemorySink() {
+    if (pool_) {
+        pool_->release(std::move(block_));
+    }
+}
+
+bool MemorySink::open(std::uint64_t size, std::string& error) {
+    fixed_ = size != kUnknownSize;
+    size_ = 0;
+    if (!fixed_) {
+        return true;
+    }
+    if (size > std::numeric_limits<std::size_t>::max() || !reserve(static_cast<std::size_t>(size))) {
+        error = "Cannot allocate " + std::to_string(size) + " bytes for download buffer";
+        return false;
+    }
+    size_ = static_cast<std::size_t>(size);
+    return true;
+}
+
+bool MemorySink::reserve(std::size_t capacity) {
+    if (capacity <= block_.capacity) {
+        return true;
+    }
+    try {
+        BufferPool::Block bigger = pool_ ? pool_->acquire(capacity)
+                                         : BufferPool::Block{std::unique_ptr<char[]>(new char[capacity]), capacity};
+        if (size_ > 0) {
+            std::memcpy(bigger.data.get(), block_.data.get(), size_);
+        }
+        if (pool_) {
+            pool_->release(std::move(block_));
+        }
+        block_ = std::move(bigger);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    return true;
+}
+
+bool MemorySink::write(const char* data, std::size_t length, std::uint64_t offset) {
+    if (length == 0) {
+        return true;
+    }
+    if (fixed_) {
+        if (!fits(offset, length, size_)) {
+            return false;
+        }
+    } else {
+        // 大小未知时只有一个连接顺序追加, 扩容不会和别的写入冲突
+        if (offset > std::numeric_limits<std::size_t>::max() - length) {
+            return false;
+        }
+        const auto end = static_cast<std::size_t>(offset) + length;
+        if (end > block_.capacity && !reserve(std::max(end, block_.capacity * 2))) {
+            return false;
+        }
+        size_ = std::max(size_, end);
+    }
+    std::memcpy(block_.data.get() + offset, data, length);
+    return true;
+}
+
+bool MemorySink::read(char* out, std::size_t length, std::uint64_t offset) const {
+    if (!fits(offset, length, size_)) {
+        return false;
+    }
+    std::memcpy(out, block_.data.get() + offset, length);
+    return true;
+}
+
+// ---- BufferSink ----
+
+bool BufferSink::open(std::uint64_t size, std::string& error) {
+    fixed_ = size != kUnknownSize;
+    size_ = 0;
+    if (!fixed_) {
+        return true;
+    }
+    if (size > capacity_) {
+        error = "Output buffer too small: need " + std::to_string(size) + " bytes, have " +
+                std::to_string(capacity_);
+        return false;
+    }
+    size_ = static_cast<std::size_t>(size);
+    return true;
+}
+
+bool BufferSink::write(const char* data, std::size_t length, std::uint64_t offset) {
+    if (!fits(offset, length, fixed_ ? size_ : capacity_)) {
+        return false;
+    }
+    std::memcpy(data_ + offset, data, length);
+    if (!fixed_) {
+        size_ = std::max(size_, static_cast<std::size_t>(offset) + length);
+    }
+    return true;
+}
+
+bool BufferSink::read(char* out, std::size_t length, std::uint64_t offset) const {
+    if (!fits(offset, length, size_)) {
+        return false;
+    }
+    std::memcpy(out, data_ + offset, length);
+    return true;
+}
+
+// ---- FileSink ----
+
+FileSink::~FileSink() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool FileSink::open(std::uint64_t size, std::string& error) {
+    if (fd_ < 0) {
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            error = "Cannot create destination file";
+            return false;
+        }
+    }
+    if (ftruncate(fd_, 0) == -1 ||
+        (size != kUnknownSize && size > 0 && ftruncate(fd_, static_cast<off_t>(size)) == -1)) {
+        error = "Cannot resize destination file";
+        return false;
+    }
+    return true;
+}
+
+bool FileSink::write(const char* data, std::size_t length, std::uint64_t offset) {
+    std::size_t written = 0;
+    while (written < length) {
+        const ssize_t n = ::pwrite(fd_, data + written, length - written,
+                                   static_cast<off_t>(offset + written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool FileSink::read(char* out, std::size_t length, std::uint64_t offset) const {
+    std::size_t done = 0;
+    while (done < length) {
+        const ssize_t n = ::pread(fd_, out + done, length - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+void FileSink::close(bool, std::uint64_t) {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+} // namespace downloader